@@ -0,0 +1,288 @@
+/* Copyright (c) 2025 The Xfce development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Cost of the plugin's own hot paths, built around wavelan.c itself:
+ *
+ *  render      a sample that changes every value shown, repainting
+ *              the icon and signal bar of the indicator
+ *  steady      a sample identical to the previous one
+ *
+ * The sampler is replaced by mock devices whose stats are set by the
+ * benchmark. Interface enumeration is measured by bench-sampler and
+ * bench-wi.
+ */
+
+#include <stdlib.h>
+
+#include "wavelan.c"
+
+#include "bench.h"
+
+struct sampler_device
+{
+  gchar *interface;
+  struct wi_stats stats;
+  int result;
+};
+
+static GPtrArray *mock_devices = NULL;
+
+static gchar *radios = NULL;
+static gint iterations = 10000;
+
+static GOptionEntry entries[] =
+{
+  { "radios", 'r', 0, G_OPTION_ARG_STRING, &radios, "Interfaces shown by the plugin", "LIST" },
+  { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Iterations per case", "N" },
+  { NULL }
+};
+
+struct sampler_device *
+sampler_device_ref(const char *interface)
+{
+  struct sampler_device *device = g_new0(struct sampler_device, 1);
+
+  device->interface = g_strdup(interface);
+  device->result = WI_OK;
+  g_strlcpy(device->stats.ws_netname, "benchmark", sizeof(device->stats.ws_netname));
+  g_strlcpy(device->stats.ws_qunit, "%", sizeof(device->stats.ws_qunit));
+  device->stats.ws_rate = 54;
+
+  if (mock_devices == NULL)
+    mock_devices = g_ptr_array_new();
+  g_ptr_array_add(mock_devices, device);
+
+  return(device);
+}
+
+void
+sampler_device_unref(struct sampler_device *device)
+{
+  g_ptr_array_remove(mock_devices, device);
+  g_free(device->interface);
+  g_free(device);
+}
+
+const char *
+sampler_device_get_interface(struct sampler_device *device)
+{
+  return(device->interface);
+}
+
+const struct wi_stats *
+sampler_device_get_stats(struct sampler_device *device, int *result)
+{
+  if (result != NULL)
+    *result = device->result;
+
+  return(&device->stats);
+}
+
+gboolean
+sampler_device_get_throughput(struct sampler_device *device, gdouble *rx, gdouble *tx)
+{
+  if (rx != NULL)
+    *rx = -1.0;
+  if (tx != NULL)
+    *tx = -1.0;
+
+  return(FALSE);
+}
+
+const char *
+sampler_device_get_gateway(struct sampler_device *device)
+{
+  return(NULL);
+}
+
+void
+sampler_device_lookup_gateway(struct sampler_device *device)
+{
+}
+
+gboolean
+sampler_device_get_timings(struct sampler_device *device, struct wi_timing *timings)
+{
+  return(FALSE);
+}
+
+void
+sampler_device_keep_history(struct sampler_device *device, gboolean keep)
+{
+}
+
+const struct wi_history *
+sampler_device_get_history(struct sampler_device *device)
+{
+  return(NULL);
+}
+
+void
+sampler_subscribe(sampler_func func, void *data)
+{
+}
+
+void
+service_ref(void)
+{
+}
+
+void
+service_unref(void)
+{
+}
+
+void
+sampler_unsubscribe(sampler_func func, void *data)
+{
+}
+
+void
+sampler_set_interval(sampler_func func, void *data,
+                     unsigned int min_interval, unsigned int max_interval)
+{
+}
+
+void
+sampler_refresh(void)
+{
+}
+
+gchar **
+sampler_list_interfaces(void)
+{
+  return(g_new0(gchar *, 1));
+}
+
+static void
+mock_set_quality(int quality)
+{
+  guint i;
+
+  for (i = 0; mock_devices != NULL && i < mock_devices->len; i++) {
+    struct sampler_device *device = g_ptr_array_index(mock_devices, i);
+    device->stats.ws_quality = quality;
+  }
+}
+
+static t_wavelan *
+bench_wavelan_new(void)
+{
+  t_wavelan *wavelan = g_new0(t_wavelan, 1);
+
+  wavelan->interface = g_strdup(radios != NULL ? radios : "wlan0");
+  wavelan->signal_colors = TRUE;
+  wavelan->show_icon = TRUE;
+  wavelan->show_bar = TRUE;
+  wavelan->visible = -1;
+  wavelan->image_size = 16;
+  wavelan->orientation = GTK_ORIENTATION_HORIZONTAL;
+
+  wavelan->ebox = gtk_event_box_new();
+  wavelan->box = gtk_box_new(wavelan->orientation, 0);
+  gtk_container_add(GTK_CONTAINER(wavelan->ebox), wavelan->box);
+  wavelan->tooltip_grid = gtk_grid_new();
+
+  wavelan_refresh_icons(wavelan);
+  wavelan_reset(wavelan);
+  wavelan_update_state(wavelan);
+
+  return(wavelan);
+}
+
+static void
+bench_wavelan_free(t_wavelan *wavelan)
+{
+  wavelan_close_radios(wavelan);
+  gtk_widget_destroy(wavelan->ebox);
+  gtk_widget_destroy(wavelan->tooltip_grid);
+  g_free(wavelan->interface);
+  g_free(wavelan);
+}
+
+static void
+bench_sampled(gboolean steady)
+{
+  t_wavelan *wavelan = bench_wavelan_new();
+  t_bench bench;
+  gint i;
+
+  bench_init(&bench, steady ? "wavelan_sampled_steady" : "wavelan_sampled_render", iterations);
+  for (i = 0; i < iterations; i++) {
+    /* crossing color bands recolors the bar and changes the icon */
+    mock_set_quality(steady ? 70 : ((i & 1) ? 90 : 10));
+    bench_start(&bench);
+    wavelan_sampled(wavelan);
+    bench_stop(&bench);
+
+    while (gtk_events_pending())
+      gtk_main_iteration();
+  }
+  bench_report(&bench);
+
+  bench_wavelan_free(wavelan);
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  const gchar *name;
+
+  context = g_option_context_new("render|steady");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return(EXIT_FAILURE);
+  }
+  g_option_context_free(context);
+
+  if (iterations <= 0) {
+    g_printerr("--iterations must be positive\n");
+    return(EXIT_FAILURE);
+  }
+
+  name = (argc > 1) ? argv[1] : "render";
+
+  if (!gtk_init_check(&argc, &argv)) {
+    g_printerr("No display available, skipping\n");
+    return(BENCH_SKIP);
+  }
+
+  wavelan_init_formats();
+
+  if (g_strcmp0(name, "render") == 0)
+    bench_sampled(FALSE);
+  else if (g_strcmp0(name, "steady") == 0)
+    bench_sampled(TRUE);
+  else {
+    g_printerr("Unknown benchmark %s\n", name);
+    return(EXIT_FAILURE);
+  }
+
+  return(EXIT_SUCCESS);
+}
@@ -0,0 +1,153 @@
+/* Copyright (c) 2025 The Xfce development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Cost of the list of wireless interfaces the sampler keeps from link
+ * events, at a scale no host provides:
+ *
+ *  events      a link appearing, then going away, for each of N
+ *              interfaces
+ *  list        sampler_list_interfaces() with N interfaces cached
+ *
+ * The backend listing and wi_is_wireless() are replaced by mocks that
+ * take every "wlan" link for a radio.
+ */
+
+#include <stdlib.h>
+
+#define wi_list_interfaces bench_wi_list_interfaces
+#define wi_is_wireless bench_wi_is_wireless
+
+#include "sampler.c"
+
+#include "bench.h"
+
+static gint iterations = 1000;
+static gint n_interfaces = 4096;
+
+static GOptionEntry entries[] =
+{
+  { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Iterations of the list case", "N" },
+  { "interfaces", 'i', 0, G_OPTION_ARG_INT, &n_interfaces, "Interfaces coming and going", "N" },
+  { NULL }
+};
+
+/* freed by wi_free_interfaces(), the cache starts out empty */
+char **
+bench_wi_list_interfaces(void)
+{
+  return(calloc(1, sizeof(char *)));
+}
+
+int
+bench_wi_is_wireless(const char *interface)
+{
+  return(strncmp(interface, "wlan", 4) == 0);
+}
+
+static void
+bench_events(gchar **names)
+{
+  t_bench bench;
+  gint i;
+
+  bench_init(&bench, "sampler_interface_event", 2 * n_interfaces);
+  for (i = 0; i < n_interfaces; i++) {
+    bench_start(&bench);
+    sampler_interface_event(names[i], WI_EVENT_LINK);
+    bench_stop(&bench);
+  }
+  for (i = 0; i < n_interfaces; i++) {
+    bench_start(&bench);
+    sampler_interface_event(names[i], WI_EVENT_GONE);
+    bench_stop(&bench);
+  }
+  bench_report(&bench);
+}
+
+static void
+bench_list(gchar **names)
+{
+  gchar **listed;
+  t_bench bench;
+  gint i;
+
+  for (i = 0; i < n_interfaces; i++)
+    sampler_interface_event(names[i], WI_EVENT_LINK);
+
+  bench_init(&bench, "sampler_list_interfaces", iterations);
+  for (i = 0; i < iterations; i++) {
+    bench_start(&bench);
+    listed = sampler_list_interfaces();
+    bench_stop(&bench);
+    g_strfreev(listed);
+  }
+  bench_report(&bench);
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  gchar **names;
+  static gchar mock_monitor;
+  gint i;
+
+  context = g_option_context_new(NULL);
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return(EXIT_FAILURE);
+  }
+  g_option_context_free(context);
+
+  if (iterations <= 0) {
+    g_printerr("--iterations must be positive\n");
+    return(EXIT_FAILURE);
+  }
+  if (n_interfaces < 0) {
+    g_printerr("--interfaces must not be negative\n");
+    return(EXIT_FAILURE);
+  }
+
+  names = g_new0(gchar *, n_interfaces + 1);
+  for (i = 0; i < n_interfaces; i++)
+    names[i] = g_strdup_printf("wlan%d", i);
+
+  /* listed once by the worker while link events keep the list up to
+   * date, the monitor itself is never used here */
+  sampler.monitor = (struct wi_monitor *) &mock_monitor;
+  sampler_list_wireless();
+
+  bench_events(names);
+  bench_list(names);
+
+  g_clear_pointer(&sampler.wireless, g_hash_table_destroy);
+  sampler.monitor = NULL;
+  g_strfreev(names);
+
+  return(EXIT_SUCCESS);
+}
@@ -0,0 +1,389 @@
+/* Copyright (c) 2025 The Xfce development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Cost of reading the service from another connection, on the private
+ * session bus of dbus-run-session:
+ *
+ *  devices     Get of org.xfce.Wavelan.Devices
+ *  properties  GetAll of the device listed there
+ *
+ * The device replays a synthetic trace, so that it has samples on any
+ * host. The values read are checked as well, and Refresh() must be
+ * followed by a PropertiesChanged carrying a replayed Quality within
+ * the timeout; any mismatch fails the case. It is skipped without a
+ * session bus.
+ */
+
+#include <stdlib.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "bench.h"
+#include "sampler.h"
+#include "service.h"
+
+#define SERVICE_NAME  "org.xfce.Wavelan"
+#define SERVICE_PATH  "/org/xfce/Wavelan"
+#define TRACE_SAMPLES 64
+#define TIMEOUT 30
+
+/* the quality of the replayed trace, alternating so every sample changes it */
+static const gint trace_qualities[] = { 40, 80 };
+
+static gint iterations = 1000;
+
+static GOptionEntry entries[] =
+{
+  { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Iterations per case", "N" },
+  { NULL }
+};
+
+static GMainLoop *loop = NULL;
+static GThread *client = NULL;
+static gchar *interface = NULL;
+static gboolean failed = FALSE;
+static guint timeout_id = 0;
+
+/* org.freedesktop.DBus.Properties, NULL on error */
+static GVariant *
+bench_call(GDBusConnection *connection, const gchar *path, const gchar *method,
+           GVariant *parameters, const gchar *type)
+{
+  GError *error = NULL;
+  GVariant *reply;
+
+  reply = g_dbus_connection_call_sync(connection, SERVICE_NAME, path,
+                                      "org.freedesktop.DBus.Properties", method, parameters,
+                                      G_VARIANT_TYPE(type), G_DBUS_CALL_FLAGS_NONE, -1,
+                                      NULL, &error);
+  if (reply == NULL) {
+    g_printerr("%s on %s: %s\n", method, path, error->message);
+    g_error_free(error);
+  }
+
+  return(reply);
+}
+
+static void
+bench_print_unexpected(const gchar *what, GVariant *value)
+{
+  gchar *text = g_variant_print(value, TRUE);
+
+  g_printerr("Unexpected %s: %s\n", what, text);
+  g_free(text);
+}
+
+/* the path of the only device, NULL if Devices lists anything else */
+static gchar *
+bench_devices(GDBusConnection *connection)
+{
+  GVariant *reply, *paths;
+  gchar *path = NULL;
+
+  if ((reply = bench_call(connection, SERVICE_PATH, "Get",
+                          g_variant_new("(ss)", SERVICE_NAME, "Devices"), "(v)")) == NULL)
+    return(NULL);
+
+  g_variant_get(reply, "(v)", &paths);
+  if (g_variant_is_of_type(paths, G_VARIANT_TYPE_OBJECT_PATH_ARRAY) &&
+      g_variant_n_children(paths) == 1)
+    g_variant_get_child(paths, 0, "o", &path);
+  else
+    bench_print_unexpected("Devices", paths);
+
+  g_variant_unref(paths);
+  g_variant_unref(reply);
+
+  return(path);
+}
+
+/* whether the device properties hold the replayed device */
+static gboolean
+bench_properties(GDBusConnection *connection, const gchar *path)
+{
+  GVariant *reply, *properties;
+  const gchar *value = NULL;
+  gboolean valid;
+
+  if ((reply = bench_call(connection, path, "GetAll",
+                          g_variant_new("(s)", SERVICE_NAME ".Device"), "(a{sv})")) == NULL)
+    return(FALSE);
+
+  properties = g_variant_get_child_value(reply, 0);
+  valid = g_variant_lookup(properties, "Interface", "&s", &value) &&
+          g_strcmp0(value, interface) == 0 &&
+          g_variant_lookup(properties, "Status", "&s", &value);
+  if (!valid)
+    bench_print_unexpected("Properties", properties);
+
+  g_variant_unref(properties);
+  g_variant_unref(reply);
+
+  return(valid);
+}
+
+static gboolean
+bench_expire(gpointer data)
+{
+  *(gboolean *) data = TRUE;
+
+  return(G_SOURCE_REMOVE);
+}
+
+static void
+bench_changed(GDBusConnection *connection, const gchar *sender, const gchar *path,
+              const gchar *interface, const gchar *signal, GVariant *parameters,
+              gpointer data)
+{
+  GVariant *changed;
+  gint32 quality;
+  guint i;
+
+  if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(sa{sv}as)")))
+    return;
+
+  changed = g_variant_get_child_value(parameters, 1);
+  if (g_variant_lookup(changed, "Quality", "i", &quality)) {
+    for (i = 0; i < G_N_ELEMENTS(trace_qualities); i++) {
+      if (quality == trace_qualities[i])
+        *(gboolean *) data = TRUE;
+    }
+  }
+  g_variant_unref(changed);
+}
+
+/* whether Refresh() is followed by a PropertiesChanged of the device
+ * carrying one of the replayed qualities; the signals are dispatched
+ * on a context of this thread, not on the main loop of the service */
+static gboolean
+bench_refresh(GDBusConnection *connection, const gchar *path)
+{
+  GMainContext *context;
+  GSource *timeout;
+  GError *error = NULL;
+  GVariant *reply;
+  gboolean received = FALSE, expired = FALSE;
+  guint id;
+
+  context = g_main_context_new();
+  g_main_context_push_thread_default(context);
+
+  id = g_dbus_connection_signal_subscribe(connection, NULL, "org.freedesktop.DBus.Properties",
+                                          "PropertiesChanged", path, SERVICE_NAME ".Device",
+                                          G_DBUS_SIGNAL_FLAGS_NONE, bench_changed,
+                                          &received, NULL);
+
+  reply = g_dbus_connection_call_sync(connection, SERVICE_NAME, SERVICE_PATH, SERVICE_NAME,
+                                      "Refresh", NULL, G_VARIANT_TYPE_UNIT,
+                                      G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+  if (reply == NULL) {
+    g_printerr("Refresh on %s: %s\n", SERVICE_PATH, error->message);
+    g_error_free(error);
+  }
+  else {
+    g_variant_unref(reply);
+
+    timeout = g_timeout_source_new_seconds(TIMEOUT);
+    g_source_set_callback(timeout, bench_expire, &expired, NULL);
+    g_source_attach(timeout, context);
+    while (!received && !expired)
+      g_main_context_iteration(context, TRUE);
+    g_source_destroy(timeout);
+    g_source_unref(timeout);
+
+    if (!received)
+      g_printerr("No PropertiesChanged with a replayed Quality on %s within %d s\n",
+                 path, TIMEOUT);
+  }
+
+  /* callbacks already queued still point at received */
+  g_dbus_connection_signal_unsubscribe(connection, id);
+  while (g_main_context_iteration(context, FALSE));
+
+  g_main_context_pop_thread_default(context);
+  g_main_context_unref(context);
+
+  return(received);
+}
+
+static gboolean
+bench_quit(gpointer data)
+{
+  g_main_loop_quit(loop);
+
+  return(G_SOURCE_REMOVE);
+}
+
+/* the other end of the bus, sync calls from a thread of its own while
+ * the service answers on the main loop */
+static gpointer
+bench_client(gpointer data)
+{
+  GDBusConnection *connection;
+  GError *error = NULL;
+  GVariant *reply;
+  gchar *address, *path = NULL;
+  t_bench bench;
+  gint i;
+
+  address = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, NULL, &error);
+  connection = (address == NULL) ? NULL :
+    g_dbus_connection_new_for_address_sync(address,
+                                           G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                           G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                           NULL, NULL, &error);
+  g_free(address);
+  if (connection == NULL) {
+    g_printerr("Unable to connect to the session bus: %s\n", error->message);
+    g_error_free(error);
+    failed = TRUE;
+    goto out;
+  }
+
+  if ((path = bench_devices(connection)) == NULL || !bench_properties(connection, path) ||
+      !bench_refresh(connection, path)) {
+    failed = TRUE;
+    goto out;
+  }
+
+  bench_init(&bench, "service_devices", iterations);
+  for (i = 0; i < iterations; i++) {
+    bench_start(&bench);
+    reply = bench_call(connection, SERVICE_PATH, "Get",
+                       g_variant_new("(ss)", SERVICE_NAME, "Devices"), "(v)");
+    bench_stop(&bench);
+    if (reply != NULL)
+      g_variant_unref(reply);
+  }
+  bench_report(&bench);
+
+  bench_init(&bench, "service_properties", iterations);
+  for (i = 0; i < iterations; i++) {
+    bench_start(&bench);
+    reply = bench_call(connection, path, "GetAll",
+                       g_variant_new("(s)", SERVICE_NAME ".Device"), "(a{sv})");
+    bench_stop(&bench);
+    if (reply != NULL)
+      g_variant_unref(reply);
+  }
+  bench_report(&bench);
+
+out:
+  g_free(path);
+  if (connection != NULL)
+    g_object_unref(connection);
+  g_idle_add(bench_quit, NULL);
+
+  return(NULL);
+}
+
+static void
+bench_name_appeared(GDBusConnection *connection, const gchar *name,
+                    const gchar *owner, gpointer data)
+{
+  /* the client checks the time it waits for signals itself */
+  if (timeout_id != 0) {
+    g_source_remove(timeout_id);
+    timeout_id = 0;
+  }
+
+  if (client == NULL)
+    client = g_thread_new("bench-client", bench_client, NULL);
+}
+
+static gboolean
+bench_timeout(gpointer data)
+{
+  g_printerr("%s did not appear within %d s\n", SERVICE_NAME, TIMEOUT);
+  failed = TRUE;
+  timeout_id = 0;
+  g_main_loop_quit(loop);
+
+  return(G_SOURCE_REMOVE);
+}
+
+int
+main(int argc, char **argv)
+{
+  struct sampler_device *device;
+  GOptionContext *context;
+  GError *error = NULL;
+  gchar *trace;
+  guint watch_id;
+
+  context = g_option_context_new(NULL);
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return(EXIT_FAILURE);
+  }
+  g_option_context_free(context);
+
+  if (iterations <= 0) {
+    g_printerr("--iterations must be positive\n");
+    return(EXIT_FAILURE);
+  }
+
+  if (g_getenv("DBUS_SESSION_BUS_ADDRESS") == NULL) {
+    g_printerr("No session bus, run under dbus-run-session; skipping\n");
+    return(BENCH_SKIP);
+  }
+
+  if ((trace = bench_trace_new(TRACE_SAMPLES, trace_qualities, G_N_ELEMENTS(trace_qualities))) == NULL) {
+    g_printerr("Unable to write a trace, skipping\n");
+    return(BENCH_SKIP);
+  }
+  interface = g_strconcat(WI_REPLAY_FAST_PREFIX, trace, NULL);
+
+  loop = g_main_loop_new(NULL, FALSE);
+
+  /* the panel plugin does the same: its devices, then the service */
+  device = sampler_device_ref(interface);
+  service_ref();
+
+  watch_id = g_bus_watch_name(G_BUS_TYPE_SESSION, SERVICE_NAME, G_BUS_NAME_WATCHER_FLAGS_NONE,
+                              bench_name_appeared, NULL, NULL, NULL);
+  timeout_id = g_timeout_add_seconds(TIMEOUT, bench_timeout, NULL);
+
+  g_main_loop_run(loop);
+
+  if (client != NULL)
+    g_thread_join(client);
+  if (timeout_id != 0)
+    g_source_remove(timeout_id);
+  g_bus_unwatch_name(watch_id);
+
+  service_unref();
+  sampler_device_unref(device);
+  g_main_loop_unref(loop);
+
+  g_unlink(trace);
+  g_free(trace);
+  g_free(interface);
+
+  return(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
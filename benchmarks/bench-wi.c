@@ -0,0 +1,220 @@
+/* Copyright (c) 2025 The Xfce development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Latency of the backend of the host: wi_open()/wi_close(), wi_query(),
+ * wi_query_many() and wi_list_interfaces(). The interface defaults to
+ * $WAVELAN_BENCH_INTERFACE; without one, a synthetic trace is replayed
+ * as fast as possible. The case is skipped if the interface cannot be
+ * opened.
+ *
+ * With $WAVELAN_BACKEND set, the Linux backend it names is measured on
+ * the interface, else on the first radio of the host. The case is
+ * skipped if there is none, or if that backend cannot query it.
+ */
+
+#include <stdlib.h>
+
+#include <glib/gstdio.h>
+
+#include "bench.h"
+#include "wi.h"
+
+#define BATCH_SIZE 4
+#define TRACE_SAMPLES 256
+
+/* the quality of the synthetic trace, steps of 7 from 30 */
+static const gint trace_qualities[] = { 30, 37, 44, 51, 58, 65, 72, 79, 86, 93 };
+
+static gchar *interface = NULL;
+static gint iterations = 1000;
+
+static GOptionEntry entries[] =
+{
+  { "interface", 'i', 0, G_OPTION_ARG_STRING, &interface, "Interface to query", "NAME" },
+  { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Iterations per case", "N" },
+  { NULL }
+};
+
+static void
+bench_list_interfaces(void)
+{
+  char **names;
+  t_bench bench;
+  gint i, n = MAX(iterations / 10, 10);
+
+  bench_init(&bench, "wi_list_interfaces", n);
+  for (i = 0; i < n; i++) {
+    bench_start(&bench);
+    names = wi_list_interfaces();
+    bench_stop(&bench);
+    wi_free_interfaces(names);
+  }
+  bench_report(&bench);
+}
+
+static void
+bench_open_close(void)
+{
+  struct wi_device *device;
+  t_bench bench;
+  gint i;
+
+  bench_init(&bench, "wi_open_close", iterations);
+  for (i = 0; i < iterations; i++) {
+    bench_start(&bench);
+    device = wi_open(interface);
+    wi_close(device);
+    bench_stop(&bench);
+  }
+  bench_report(&bench);
+}
+
+static void
+bench_query(struct wi_device *device, gboolean cold)
+{
+  struct wi_stats stats;
+  t_bench bench;
+  gint i;
+
+  /* cold queries reload the cached capabilities every time */
+  bench_init(&bench, cold ? "wi_query_cold" : "wi_query", iterations);
+  for (i = 0; i < iterations; i++) {
+    if (cold)
+      wi_invalidate(device);
+    bench_start(&bench);
+    wi_query(device, &stats);
+    bench_stop(&bench);
+  }
+  bench_report(&bench);
+}
+
+static void
+bench_query_many(struct wi_device *device)
+{
+  struct wi_device *devices[BATCH_SIZE];
+  struct wi_stats stats[BATCH_SIZE];
+  int results[BATCH_SIZE];
+  t_bench bench;
+  gint i;
+
+  for (i = 0; i < BATCH_SIZE; i++)
+    devices[i] = device;
+
+  bench_init(&bench, "wi_query_many", iterations);
+  for (i = 0; i < iterations; i++) {
+    bench_start(&bench);
+    wi_query_many(devices, stats, results, BATCH_SIZE);
+    bench_stop(&bench);
+  }
+  bench_report(&bench);
+}
+
+/* the first radio of the host, NULL if there is none */
+static gchar *
+bench_first_interface(void)
+{
+  char **names;
+  gchar *name;
+
+  names = wi_list_interfaces();
+  name = (names != NULL) ? g_strdup(names[0]) : NULL;
+  wi_free_interfaces(names);
+
+  return(name);
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context;
+  struct wi_device *device;
+  struct wi_stats stats;
+  GError *error = NULL;
+  const gchar *backend;
+  gchar *trace = NULL;
+
+  context = g_option_context_new(NULL);
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return(EXIT_FAILURE);
+  }
+  g_option_context_free(context);
+
+  if (iterations <= 0) {
+    g_printerr("--iterations must be positive\n");
+    return(EXIT_FAILURE);
+  }
+
+  /* the host's own interfaces, whatever is queried below */
+  bench_list_interfaces();
+
+  if (interface == NULL)
+    interface = g_strdup(g_getenv("WAVELAN_BENCH_INTERFACE"));
+
+  /* a replayed trace would never reach the backend */
+  backend = g_getenv("WAVELAN_BACKEND");
+  if (interface == NULL && backend != NULL &&
+      (interface = bench_first_interface()) == NULL) {
+    g_printerr("No wireless interface for the %s backend, skipping\n", backend);
+    return(BENCH_SKIP);
+  }
+
+  if (interface == NULL) {
+    if ((trace = bench_trace_new(TRACE_SAMPLES, trace_qualities, G_N_ELEMENTS(trace_qualities))) == NULL) {
+      g_printerr("Unable to write a trace, skipping\n");
+      return(BENCH_SKIP);
+    }
+    interface = g_strconcat(WI_REPLAY_FAST_PREFIX, trace, NULL);
+  }
+
+  if ((device = wi_open(interface)) == NULL) {
+    g_printerr("Unable to open %s, skipping\n", interface);
+    return(BENCH_SKIP);
+  }
+
+  /* a forced backend that does not handle the driver finds no device */
+  if (backend != NULL && wi_query(device, &stats) == WI_NOSUCHDEV) {
+    g_printerr("The %s backend cannot query %s, skipping\n", backend, interface);
+    wi_close(device);
+    return(BENCH_SKIP);
+  }
+
+  bench_open_close();
+  bench_query(device, FALSE);
+  bench_query(device, TRUE);
+  bench_query_many(device);
+
+  wi_close(device);
+  g_free(interface);
+
+  if (trace != NULL) {
+    g_unlink(trace);
+    g_free(trace);
+  }
+
+  return(EXIT_SUCCESS);
+}
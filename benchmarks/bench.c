@@ -0,0 +1,150 @@
+/* Copyright (c) 2025 The Xfce development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "bench.h"
+#include "wi.h"
+
+gint64
+bench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return((gint64)ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec);
+}
+
+void
+bench_init(t_bench *bench, const gchar *name, guint iterations)
+{
+  bench->name = name;
+  bench->n = 0;
+  bench->iterations = MAX(iterations, 1);
+  bench->samples = g_new(gint64, bench->iterations);
+}
+
+void
+bench_start(t_bench *bench)
+{
+  bench->start = bench_now();
+}
+
+void
+bench_stop(t_bench *bench)
+{
+  if (bench->n < bench->iterations)
+    bench->samples[bench->n++] = bench_now() - bench->start;
+}
+
+static int
+bench_compare(const void *a, const void *b)
+{
+  gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+
+  return((x > y) - (x < y));
+}
+
+void
+bench_report(t_bench *bench)
+{
+  gint64 total = 0;
+  guint i;
+
+  if (bench->n == 0) {
+    printf("{\"benchmark\": \"%s\", \"iterations\": 0}\n", bench->name);
+    g_free(bench->samples);
+    return;
+  }
+
+  qsort(bench->samples, bench->n, sizeof(*bench->samples), bench_compare);
+  for (i = 0; i < bench->n; i++)
+    total += bench->samples[i];
+
+  printf("{\"benchmark\": \"%s\", \"iterations\": %u, "
+         "\"min_ns\": %" G_GINT64_FORMAT ", \"median_ns\": %" G_GINT64_FORMAT ", "
+         "\"p99_ns\": %" G_GINT64_FORMAT ", \"max_ns\": %" G_GINT64_FORMAT ", "
+         "\"mean_ns\": %" G_GINT64_FORMAT "}\n",
+         bench->name, bench->n,
+         bench->samples[0], bench->samples[bench->n / 2],
+         bench->samples[(bench->n - 1) * 99 / 100], bench->samples[bench->n - 1],
+         total / bench->n);
+  fflush(stdout);
+
+  g_free(bench->samples);
+  bench->samples = NULL;
+}
+
+/*
+ * A synthetic trace to stand in for real hardware, replayed with
+ * WI_REPLAY_FAST_PREFIX: a link moving to another access point every
+ * 64 samples and losing its carrier just before, sample i having the
+ * quality qualities[i % n_qualities]. Returns the path of the trace,
+ * NULL on failure.
+ */
+gchar *
+bench_trace_new(guint samples, const gint *qualities, guint n_qualities)
+{
+  struct wi_recorder *recorder;
+  struct wi_stats stats;
+  gchar *path;
+  gint fd;
+  guint i;
+
+  g_return_val_if_fail(qualities != NULL && n_qualities > 0, NULL);
+
+  if ((fd = g_file_open_tmp("wavelan-bench-XXXXXX.wltrace", &path, NULL)) < 0)
+    return(NULL);
+  close(fd);
+
+  if ((recorder = wi_recorder_open(path)) == NULL) {
+    g_unlink(path);
+    g_free(path);
+    return(NULL);
+  }
+
+  memset(&stats, 0, sizeof(stats));
+  g_strlcpy(stats.ws_qunit, "%", sizeof(stats.ws_qunit));
+  g_strlcpy(stats.ws_vendor, "bench", sizeof(stats.ws_vendor));
+  for (i = 0; i < samples; i++) {
+    g_snprintf(stats.ws_netname, sizeof(stats.ws_netname), "ap%u", i / 64);
+    stats.ws_quality = qualities[i % n_qualities];
+    stats.ws_rate = (i % 3 + 1) * 54;
+    stats.ws_link.wl_valid = WI_LINK_SIGNAL | WI_LINK_TX_RATE | WI_LINK_BYTES;
+    stats.ws_link.wl_signal = -90 + stats.ws_quality / 2;
+    stats.ws_link.wl_tx_rate.wr_bitrate = stats.ws_rate * 10;
+    stats.ws_link.wl_rx_bytes += 1500 * (i % 50);
+    stats.ws_link.wl_tx_bytes += 100 * (i % 7);
+    wi_recorder_write(recorder, &stats, (i % 64 == 63) ? WI_NOCARRIER : WI_OK);
+  }
+  wi_recorder_close(recorder);
+
+  return(path);
+}
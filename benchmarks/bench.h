@@ -0,0 +1,56 @@
+/* Copyright (c) 2025 The Xfce development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <glib.h>
+
+/*
+ * Minimal timing harness shared by the benchmarks. Every case records
+ * the duration of each iteration and prints one JSON object per line
+ * on stdout, which meson keeps in meson-logs/benchmarklog.json.
+ */
+
+typedef struct
+{
+  const gchar *name;
+  guint n;
+  guint iterations;
+  gint64 *samples;  /* ns */
+  gint64 start;
+} t_bench;
+
+extern gint64 bench_now(void);
+extern void bench_init(t_bench *, const gchar *, guint);
+extern void bench_start(t_bench *);
+extern void bench_stop(t_bench *);
+extern void bench_report(t_bench *);
+
+extern gchar *bench_trace_new(guint, const gint *, guint);
+
+/* exit status telling meson the case was skipped */
+#define BENCH_SKIP 77
+
+#endif  /* !__BENCH_H__ */
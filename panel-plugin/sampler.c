@@ -0,0 +1,1380 @@
+/* Copyright (c) 2025 The Xfce development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib-unix.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include "sampler.h"
+
+struct sampler_device
+{
+  gint refcount;
+  gchar *interface;
+
+  /* only the worker touches the backend device, NULL while the adapter
+   * is unplugged; open tells the main thread whether the latest
+   * snapshot had it open */
+  struct wi_device *device;
+  gboolean open;
+
+  /* interface the device is opened on: name as of the latest snapshot
+   * for the main thread, link for the worker, empty while parked */
+  gchar *name;
+  char link[IFNAMSIZ];
+
+  /* the adapter is also recognised by its hardware address, so that it
+   * is found again if it comes back under another name; when the
+   * interface is configured as an address, that is all there is. Only
+   * the worker looks them up once the device is created */
+  guint8 hwaddr[WI_HWADDR_LEN];
+  gboolean has_hwaddr;
+  gboolean by_hwaddr;
+
+  /* SAMPLER_AUTO_INTERFACE, moves with the default route */
+  gboolean follow_route;
+
+  /* next hop of the default route through the link, looked up by the
+   * worker into next_hop when asked to; gateway is the main thread's
+   * copy as of the latest snapshot, empty if unknown */
+  gint lookup_gateway;
+  char next_hop[INET6_ADDRSTRLEN];
+  char gateway[INET6_ADDRSTRLEN];
+
+  /* trace of every sample, if $WAVELAN_RECORD names a directory */
+  struct wi_recorder *recorder;
+
+  /* samples kept on disk while some subscriber asks for them */
+  struct wi_history *history;
+  guint history_users;
+
+  /* set on link events, consumed by the worker before its next query */
+  gint invalidate;
+
+  /* latest sample */
+  struct wi_stats stats;
+  int result;
+  gint64 time;                  /* monotonic time of the sample, 0 if none */
+
+  /* traffic between the last two samples in bit/s, -1 if unknown */
+  gdouble rx_throughput;
+  gdouble tx_throughput;
+
+  /* moving average of the squared quality change between samples */
+  gdouble variance;
+
+  /* latencies of the backend calls, as of the latest sample */
+  struct wi_timing timings[WI_CALL_COUNT];
+};
+
+typedef struct
+{
+  sampler_func func;
+  void *data;
+  guint min_interval;
+  guint max_interval;
+} t_subscriber;
+
+/* work for the worker, which alone looks up, opens, queries and
+ * closes the backend devices, see sampler_command() */
+typedef enum
+{
+  COMMAND_LOOKUP,               /* find the adapter, open it there or park */
+  COMMAND_CLOSE,                /* park the device */
+  COMMAND_FREE,                 /* close and free the device */
+  COMMAND_LINK,                 /* a link came or went */
+} t_command_type;
+
+typedef struct
+{
+  t_command_type type;
+  struct sampler_device *device;
+  gchar *name;                  /* the link of the event, if any */
+  int events;
+  guint generation;
+} t_command;
+
+typedef char t_link[IFNAMSIZ];
+typedef char t_gateway[INET6_ADDRSTRLEN];
+
+/* results of one wi_query_many() round, see sampler_publish(); the
+ * open devices come first, then the parked ones with an empty link */
+typedef struct
+{
+  guint generation;
+  guint n;
+  guint size;
+  gint64 time;                  /* when the devices were queried */
+  struct sampler_device **devices;
+  t_link *links;
+  t_gateway *gateways;
+  struct wi_stats *stats;
+  int *results;
+  struct wi_timing *timings;    /* WI_CALL_COUNT per device */
+} t_snapshot;
+
+#define SNAPSHOT_INDEX  0x3
+#define SNAPSHOT_FRESH  0x4
+
+/* quality variance above which the link is considered moving, and below
+ * which it is considered steady (in squared percent per sample) */
+#define VARIANCE_UNSTABLE  9.0
+#define VARIANCE_STABLE    1.0
+#define VARIANCE_WEIGHT    0.25
+
+static struct
+{
+  GHashTable *devices;          /* interface name -> struct sampler_device */
+  GSList *subscribers;
+  guint timer_id;
+  guint interval;               /* current sampling interval in ms */
+  guint min_interval;
+  guint max_interval;
+
+  /* link notifications, NULL if the platform has none */
+  struct wi_monitor *monitor;
+  guint monitor_id;
+  gboolean refresh_pending;
+
+  /* names of the wireless interfaces, listed by the worker and then
+   * kept up to date from link events, or listed again whenever needed
+   * without them; only the worker changes it, under lock */
+  GHashTable *wireless;
+
+  /* the worker thread makes every call on the backend devices and
+   * looks the interfaces up, so a driver that blocks in an ioctl or a
+   * slow netlink dump never stalls the panel */
+  GThread *worker;
+  GMutex lock;                  /* protects request, quit, commands and wireless */
+  GCond cond;
+  gboolean request;
+  gboolean quit;
+  GQueue commands;
+  guint generation;             /* of the last command queued */
+
+  /* owned by the worker: the devices it has open, those it parked,
+   * and the generation of the last command it ran */
+  GPtrArray *batch;
+  GPtrArray *parked;
+  struct wi_device **batch_devices;
+  guint batch_size;
+  guint batch_generation;
+
+  /* triple buffer handing snapshots from the worker to the main thread
+   * without locking: the worker owns snapshots[back], the main thread
+   * owns snapshots[front] and the third one is parked in slot, along
+   * with a flag telling whether it holds a sample not collected yet */
+  t_snapshot snapshots[3];
+  gint slot;
+  guint back;
+  guint front;
+  gint collect_queued;
+} sampler;
+
+static gboolean sampler_timer(gpointer data);
+
+/* g_atomic_int_exchange() is not available before GLib 2.74 */
+static gint
+sampler_slot_exchange(gint value)
+{
+  gint old;
+
+  do
+    old = g_atomic_int_get(&sampler.slot);
+  while (!g_atomic_int_compare_and_exchange(&sampler.slot, old, value));
+
+  return(old);
+}
+
+static void
+sampler_snapshot_reserve(t_snapshot *snapshot, guint n)
+{
+  if (snapshot->size >= n)
+    return;
+
+  snapshot->devices = g_renew(struct sampler_device *, snapshot->devices, n);
+  snapshot->links = g_renew(t_link, snapshot->links, n);
+  snapshot->gateways = g_renew(t_gateway, snapshot->gateways, n);
+  snapshot->stats = g_renew(struct wi_stats, snapshot->stats, n);
+  snapshot->results = g_renew(int, snapshot->results, n);
+  snapshot->timings = g_renew(struct wi_timing, snapshot->timings, n * WI_CALL_COUNT);
+  snapshot->size = n;
+}
+
+/* only the signal drifts; without a link, wait for the next link event */
+static gboolean
+sampler_needs_polling(gboolean associated)
+{
+  return(associated ||
+         (sampler.monitor == NULL && g_hash_table_size(sampler.devices) > 0));
+}
+
+/* the tightest bounds requested by the subscribers */
+static void
+sampler_update_bounds(void)
+{
+  gboolean first = TRUE;
+  GSList *lp;
+
+  sampler.min_interval = SAMPLER_MIN_INTERVAL;
+  sampler.max_interval = SAMPLER_MAX_INTERVAL;
+
+  for (lp = sampler.subscribers; lp != NULL; lp = lp->next) {
+    t_subscriber *subscriber = lp->data;
+    if (subscriber->min_interval == SAMPLER_ANY_INTERVAL)
+      continue;
+    if (first || subscriber->min_interval < sampler.min_interval)
+      sampler.min_interval = subscriber->min_interval;
+    if (first || subscriber->max_interval < sampler.max_interval)
+      sampler.max_interval = subscriber->max_interval;
+    first = FALSE;
+  }
+
+  sampler.max_interval = MAX(sampler.max_interval, sampler.min_interval);
+  sampler.interval = CLAMP(sampler.interval, sampler.min_interval, sampler.max_interval);
+}
+
+/* fold a new sample into the device's variance, returns TRUE if the
+ * link came or went */
+static gboolean
+sampler_track(struct sampler_device *device, const struct wi_stats *stats, int result)
+{
+  gdouble delta;
+
+  if (result != device->result) {
+    device->variance = 0.0;
+    return(TRUE);
+  }
+
+  if (result != WI_OK)
+    return(FALSE);
+
+  delta = stats->ws_quality - device->stats.ws_quality;
+  device->variance += VARIANCE_WEIGHT * (delta * delta - device->variance);
+
+  return(FALSE);
+}
+
+/* traffic since the previous sample, from the deltas of the byte
+ * counters; they restart after a reassociation or a replug, so a
+ * counter that went back or another access point means unknown */
+static void
+sampler_throughput(struct sampler_device *device, const struct wi_stats *stats,
+                   int result, gint64 time)
+{
+  const struct wi_link *prev = &device->stats.ws_link;
+  const struct wi_link *link = &stats->ws_link;
+  gdouble dt;
+
+  device->rx_throughput = device->tx_throughput = -1.0;
+
+  if (result != WI_OK || device->result != WI_OK || device->time == 0 || time <= device->time ||
+      (link->wl_valid & prev->wl_valid & WI_LINK_BYTES) == 0 ||
+      link->wl_rx_bytes < prev->wl_rx_bytes || link->wl_tx_bytes < prev->wl_tx_bytes)
+    return;
+
+  if ((link->wl_valid & prev->wl_valid & WI_LINK_BSSID) != 0 &&
+      memcmp(link->wl_bssid, prev->wl_bssid, WI_HWADDR_LEN) != 0)
+    return;
+
+  dt = (time - device->time) / (gdouble) G_USEC_PER_SEC;
+  device->rx_throughput = (link->wl_rx_bytes - prev->wl_rx_bytes) * 8.0 / dt;
+  device->tx_throughput = (link->wl_tx_bytes - prev->wl_tx_bytes) * 8.0 / dt;
+}
+
+/* poll fast while the signal moves, back off while it is steady */
+static void
+sampler_adapt(gboolean changed, gdouble variance)
+{
+  if (changed || variance >= VARIANCE_UNSTABLE)
+    sampler.interval = sampler.min_interval;
+  else if (variance < VARIANCE_STABLE)
+    sampler.interval = MIN(sampler.interval + sampler.interval / 2, sampler.max_interval);
+
+  DBG ("Sampling every %u ms (variance %.2f)", sampler.interval, variance);
+}
+
+static void
+sampler_schedule(gboolean associated)
+{
+  if (sampler.timer_id != 0) {
+    g_source_remove(sampler.timer_id);
+    sampler.timer_id = 0;
+  }
+
+  if (!sampler_needs_polling(associated))
+    return;
+
+  /* let long intervals be grouped with other wakeups */
+  if (sampler.interval >= 1000)
+    sampler.timer_id = g_timeout_add_seconds((sampler.interval + 500) / 1000,
+                                             sampler_timer, NULL);
+  else
+    sampler.timer_id = g_timeout_add(sampler.interval, sampler_timer, NULL);
+}
+
+/* ask the worker for a new sample, never blocks on the driver */
+static void
+sampler_request(void)
+{
+  g_mutex_lock(&sampler.lock);
+  sampler.request = TRUE;
+  g_cond_signal(&sampler.cond);
+  g_mutex_unlock(&sampler.lock);
+}
+
+/* hand a device or a link event over to the worker; the samples
+ * published before it runs a device command no longer line up with
+ * the devices */
+static void
+sampler_command(t_command_type type, struct sampler_device *device, const gchar *name,
+                int events)
+{
+  t_command *command;
+
+  command = g_new0(t_command, 1);
+  command->type = type;
+  command->device = device;
+  command->name = g_strdup(name);
+  command->events = events;
+  command->generation = (type == COMMAND_LINK) ? sampler.generation : ++sampler.generation;
+
+  g_mutex_lock(&sampler.lock);
+  g_queue_push_tail(&sampler.commands, command);
+  g_cond_signal(&sampler.cond);
+  g_mutex_unlock(&sampler.lock);
+}
+
+/* only link events can bring a device back */
+static gboolean
+sampler_can_wait(struct sampler_device *device)
+{
+  return(sampler.monitor != NULL && !wi_replay_match(device->interface));
+}
+
+/* forget the samples of a device that is no longer open */
+static void
+sampler_device_clear(struct sampler_device *device)
+{
+  device->open = FALSE;
+
+  memset(&device->stats, 0, sizeof(device->stats));
+  device->result = WI_NOSUCHDEV;
+  device->gateway[0] = '\0';
+  device->variance = 0.0;
+  device->time = 0;
+  device->rx_throughput = device->tx_throughput = -1.0;
+  memset(device->timings, 0, sizeof(device->timings));
+  wi_timings_init(device->timings);
+}
+
+/* close an unplugged adapter, it costs nothing until it comes back */
+static void
+sampler_device_park(struct sampler_device *device)
+{
+  DBG ("Waiting for %s to come back", device->interface);
+
+  sampler_command(COMMAND_CLOSE, device, NULL, 0);
+  sampler_device_clear(device);
+}
+
+/* runs on the worker: list the wireless interfaces again */
+static void
+sampler_list_wireless(void)
+{
+  GHashTable *wireless, *old;
+  char **listed;
+  guint i;
+
+  listed = wi_list_interfaces();
+  wireless = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  for (i = 0; listed != NULL && listed[i] != NULL; i++)
+    g_hash_table_add(wireless, g_strdup(listed[i]));
+  wi_free_interfaces(listed);
+
+  g_mutex_lock(&sampler.lock);
+  old = sampler.wireless;
+  sampler.wireless = wireless;
+  g_mutex_unlock(&sampler.lock);
+
+  if (old != NULL)
+    g_hash_table_destroy(old);
+}
+
+/* runs on the worker: the wireless interfaces, listed again every time
+ * if no link event keeps them up to date */
+static GHashTable *
+sampler_wireless(void)
+{
+  if (sampler.wireless == NULL || sampler.monitor == NULL)
+    sampler_list_wireless();
+
+  return(sampler.wireless);
+}
+
+/* runs on the worker: whether the link called name is the adapter of a
+ * device */
+static gboolean
+sampler_device_matches(struct sampler_device *device, const gchar *name)
+{
+  guint8 hwaddr[WI_HWADDR_LEN];
+
+  if (!device->by_hwaddr && strcmp(device->interface, name) == 0)
+    return(TRUE);
+
+  return(device->has_hwaddr &&
+         wi_get_hwaddr(name, hwaddr) == WI_OK &&
+         memcmp(hwaddr, device->hwaddr, WI_HWADDR_LEN) == 0);
+}
+
+/* runs on the worker: the radio of the default route, else the first
+ * one present */
+static gchar *
+sampler_route_lookup(void)
+{
+  char route[IFNAMSIZ];
+  GHashTableIter iter;
+  gpointer key;
+  const gchar *first = NULL;
+
+  if (wi_get_route_interface(route, sizeof(route)) == WI_OK)
+    return(g_strdup(route));
+
+  g_hash_table_iter_init(&iter, sampler_wireless());
+  while (g_hash_table_iter_next(&iter, &key, NULL)) {
+    if (first == NULL || strcmp(key, first) < 0)
+      first = key;
+  }
+
+  return(g_strdup(first));
+}
+
+/* runs on the worker: find the link of a device among the interfaces
+ * present, if any */
+static gchar *
+sampler_device_lookup(struct sampler_device *device)
+{
+  GHashTableIter iter;
+  gpointer key;
+
+  if (device->follow_route)
+    return(sampler_route_lookup());
+
+  if (!device->by_hwaddr && if_nametoindex(device->interface) != 0)
+    return(g_strdup(device->interface));
+
+  if (!device->has_hwaddr)
+    return(NULL);
+
+  g_hash_table_iter_init(&iter, sampler_wireless());
+  while (g_hash_table_iter_next(&iter, &key, NULL)) {
+    if (sampler_device_matches(device, key))
+      return(g_strdup(key));
+  }
+
+  return(NULL);
+}
+
+/* runs on the worker: close the backend device, if open, and take it
+ * out of the batch or the parked devices */
+static void
+sampler_device_close(struct sampler_device *device)
+{
+  g_ptr_array_remove(sampler.batch, device);
+  g_ptr_array_remove(sampler.parked, device);
+
+  if (device->device != NULL) {
+    wi_close(device->device);
+    device->device = NULL;
+  }
+  device->link[0] = '\0';
+  device->next_hop[0] = '\0';
+}
+
+/*
+ * Runs on the worker: open the device on the link it is found on, or
+ * park it until a link event or a refresh looks for it again. A link
+ * that appeared is only tried for the parked devices it matches.
+ * Returns TRUE if the device was opened or closed.
+ */
+static gboolean
+sampler_device_resolve(struct sampler_device *device, const gchar *appeared)
+{
+  gboolean was_open = device->device != NULL;
+  gchar *name;
+
+  if (appeared != NULL && !device->follow_route) {
+    if (was_open || !sampler_device_matches(device, appeared))
+      return(FALSE);
+    name = g_strdup(appeared);
+  }
+  else if ((name = sampler_device_lookup(device)) == NULL &&
+           !sampler_can_wait(device) && !device->follow_route) {
+    /* opened anyway, without link events nothing would tell it came */
+    name = g_strdup(device->interface);
+  }
+
+  if (was_open && g_strcmp0(name, device->link) == 0) {
+    g_free(name);
+    return(FALSE);
+  }
+
+  sampler_device_close(device);
+
+  if (name != NULL && (device->device = wi_open(name)) != NULL) {
+    DBG ("Opened %s on %s", device->interface, name);
+    g_strlcpy(device->link, name, sizeof(device->link));
+    g_ptr_array_add(sampler.batch, device);
+
+    /* another adapter may have taken the configured name */
+    if (!device->by_hwaddr)
+      device->has_hwaddr = FALSE;
+  }
+  else {
+    if (name != NULL)
+      DBG ("Unable to open %s on %s, waiting for it", device->interface, name);
+    g_ptr_array_add(sampler.parked, device);
+  }
+
+  g_free(name);
+
+  return(was_open || device->device != NULL);
+}
+
+/* runs on the main thread once the worker published a snapshot */
+static gboolean
+sampler_collect(gpointer data)
+{
+  gboolean associated = FALSE, changed = FALSE;
+  gdouble variance = 0.0;
+  gint64 now = g_get_real_time() / 1000;
+  t_snapshot *snapshot;
+  GHashTableIter iter;
+  gpointer value;
+  GSList *lp;
+  guint i;
+  WI_TRACE_DECLARE(begin);
+
+  TRACE ("Entered sampler_collect");
+
+  g_atomic_int_set(&sampler.collect_queued, 0);
+
+  if (sampler.devices == NULL ||
+      (g_atomic_int_get(&sampler.slot) & SNAPSHOT_FRESH) == 0)
+    return(G_SOURCE_REMOVE);
+
+  /* take the latest snapshot, leaving ours to the worker */
+  sampler.front = sampler_slot_exchange(sampler.front) & SNAPSHOT_INDEX;
+  snapshot = &sampler.snapshots[sampler.front];
+
+  /* devices were added or removed while sampling, try again */
+  if (snapshot->generation != sampler.generation) {
+    sampler_request();
+    return(G_SOURCE_REMOVE);
+  }
+
+  for (i = 0; i < snapshot->n; i++) {
+    struct sampler_device *device = snapshot->devices[i];
+
+    /* parked by the worker: unplugged, not found or failing to open */
+    if (snapshot->links[i][0] == '\0') {
+      if (device->open)
+        sampler_device_clear(device);
+      continue;
+    }
+
+    /* opened since the last snapshot, maybe on another link */
+    if (!device->open || strcmp(device->name, snapshot->links[i]) != 0) {
+      sampler_device_clear(device);
+      device->open = TRUE;
+      g_free(device->name);
+      device->name = g_strdup(snapshot->links[i]);
+    }
+
+    if (sampler_track(device, &snapshot->stats[i], snapshot->results[i]))
+      changed = TRUE;
+    variance = MAX(variance, device->variance);
+
+    sampler_throughput(device, &snapshot->stats[i], snapshot->results[i], snapshot->time);
+
+    device->stats = snapshot->stats[i];
+    device->result = snapshot->results[i];
+    device->time = snapshot->time;
+    g_strlcpy(device->gateway, snapshot->gateways[i], sizeof(device->gateway));
+    memcpy(device->timings, &snapshot->timings[i * WI_CALL_COUNT], sizeof(device->timings));
+
+    if (device->history != NULL)
+      wi_history_append(device->history, now - (g_get_monotonic_time() - snapshot->time) / 1000,
+                        &device->stats, device->result);
+    if (device->result == WI_OK)
+      associated = TRUE;
+  }
+
+  /* without link events, look for the adapters on every tick instead */
+  if (sampler.monitor == NULL) {
+    g_hash_table_iter_init(&iter, sampler.devices);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+      struct sampler_device *device = value;
+
+      if (!device->open || (device->follow_route && device->result == WI_NOSUCHDEV))
+        sampler_command(COMMAND_LOOKUP, device, NULL, 0);
+    }
+  }
+
+  /* the panel side of a sample, from the worker's results to the
+   * last subscriber */
+  WI_TRACE_BEGIN(begin);
+  for (lp = sampler.subscribers; lp != NULL; lp = lp->next) {
+    t_subscriber *subscriber = lp->data;
+    subscriber->func(subscriber->data);
+  }
+  WI_TRACE_END(begin, "notify");
+
+  sampler_adapt(changed, variance);
+  sampler_schedule(associated);
+
+  return(G_SOURCE_REMOVE);
+}
+
+/* called by the worker, makes snapshots[back] visible to sampler_collect() */
+static void
+sampler_publish(void)
+{
+  sampler.back = sampler_slot_exchange(sampler.back | SNAPSHOT_FRESH) & SNAPSHOT_INDEX;
+
+  /* a single pending idle is enough, it always takes the latest */
+  if (g_atomic_int_compare_and_exchange(&sampler.collect_queued, 0, 1))
+    g_idle_add(sampler_collect, NULL);
+}
+
+/* runs on the worker: follow interfaces coming and going instead of
+ * listing them again; an interface is only checked for a radio when it
+ * appears, renames are reported as the old name gone and the new one
+ * appearing */
+static void
+sampler_interface_event(const char *interface, int events)
+{
+  /* events were lost, list everything again */
+  if (interface == NULL) {
+    sampler_list_wireless();
+    return;
+  }
+
+  if (sampler.wireless == NULL)
+    return;
+
+  if (events & WI_EVENT_GONE) {
+    g_mutex_lock(&sampler.lock);
+    g_hash_table_remove(sampler.wireless, interface);
+    g_mutex_unlock(&sampler.lock);
+  }
+  else if (!g_hash_table_contains(sampler.wireless, interface) && wi_is_wireless(interface)) {
+    g_mutex_lock(&sampler.lock);
+    g_hash_table_add(sampler.wireless, g_strdup(interface));
+    g_mutex_unlock(&sampler.lock);
+  }
+}
+
+/* worker side of sampler_command(), returns TRUE if a device was
+ * opened or closed, which the main thread learns from a new sample */
+static gboolean
+sampler_run_command(t_command *command)
+{
+  struct sampler_device *device = command->device;
+  gboolean changed = FALSE;
+
+  switch (command->type) {
+  case COMMAND_LOOKUP:
+    changed = sampler_device_resolve(device, command->name);
+    break;
+
+  case COMMAND_CLOSE:
+    sampler_device_close(device);
+    g_ptr_array_add(sampler.parked, device);
+    break;
+
+  case COMMAND_FREE:
+    sampler_device_close(device);
+    wi_recorder_close(device->recorder);
+    g_free(device->interface);
+    g_free(device->name);
+    g_free(device);
+    break;
+
+  case COMMAND_LINK:
+    sampler_interface_event(command->name, command->events);
+    break;
+  }
+
+  sampler.batch_generation = command->generation;
+  g_free(command->name);
+  g_free(command);
+
+  return(changed);
+}
+
+static gpointer
+sampler_worker(gpointer data)
+{
+  struct sampler_device *device;
+  t_snapshot *snapshot;
+  t_command *command;
+  gboolean request, changed;
+  guint i, n, n_open;
+  WI_TRACE_DECLARE(begin);
+
+  sampler_list_wireless();
+
+  for (;;) {
+    g_mutex_lock(&sampler.lock);
+    while (!sampler.request && !sampler.quit && g_queue_is_empty(&sampler.commands))
+      g_cond_wait(&sampler.cond, &sampler.lock);
+
+    /* devices looked up or closed since the last round, the queued
+     * frees are run before quitting as well */
+    changed = FALSE;
+    while ((command = g_queue_pop_head(&sampler.commands)) != NULL) {
+      g_mutex_unlock(&sampler.lock);
+      if (sampler_run_command(command))
+        changed = TRUE;
+      g_mutex_lock(&sampler.lock);
+    }
+
+    if (sampler.quit) {
+      g_mutex_unlock(&sampler.lock);
+      break;
+    }
+    request = sampler.request || changed;
+    sampler.request = FALSE;
+    g_mutex_unlock(&sampler.lock);
+
+    if (!request)
+      continue;
+
+    WI_TRACE_BEGIN(begin);
+
+    n_open = sampler.batch->len;
+    n = n_open + sampler.parked->len;
+    if (sampler.batch_size < n_open) {
+      sampler.batch_devices = g_renew(struct wi_device *, sampler.batch_devices, n_open);
+      sampler.batch_size = n_open;
+    }
+
+    snapshot = &sampler.snapshots[sampler.back];
+    sampler_snapshot_reserve(snapshot, n);
+    snapshot->generation = sampler.batch_generation;
+    snapshot->n = n;
+
+    for (i = 0; i < n_open; i++) {
+      device = g_ptr_array_index(sampler.batch, i);
+      snapshot->devices[i] = device;
+      g_strlcpy(snapshot->links[i], device->link, IFNAMSIZ);
+      sampler.batch_devices[i] = device->device;
+
+      /* the link changed, cached capabilities may be stale */
+      if (g_atomic_int_compare_and_exchange(&device->invalidate, 1, 0))
+        wi_invalidate(device->device);
+    }
+
+    for (i = n_open; i < n; i++) {
+      snapshot->devices[i] = g_ptr_array_index(sampler.parked, i - n_open);
+      snapshot->links[i][0] = '\0';
+      snapshot->results[i] = WI_NOSUCHDEV;
+    }
+
+    wi_query_many(sampler.batch_devices, snapshot->stats, snapshot->results, n_open);
+    snapshot->time = g_get_monotonic_time();
+
+    for (i = 0; i < n_open; i++) {
+      device = snapshot->devices[i];
+      wi_get_timings(device->device, &snapshot->timings[i * WI_CALL_COUNT]);
+      if (device->recorder != NULL)
+        wi_recorder_write(device->recorder, &snapshot->stats[i], snapshot->results[i]);
+
+      /* remembered to recognise the adapter after a replug */
+      if (snapshot->results[i] != WI_NOSUCHDEV) {
+        if (!device->has_hwaddr && sampler_can_wait(device) &&
+            wi_get_hwaddr(device->link, device->hwaddr) == WI_OK)
+          device->has_hwaddr = TRUE;
+
+        /* a route dump, only when a subscriber asked for it */
+        if (g_atomic_int_compare_and_exchange(&device->lookup_gateway, 1, 0) &&
+            wi_get_gateway(device->link, device->next_hop, sizeof(device->next_hop)) != WI_OK)
+          device->next_hop[0] = '\0';
+      }
+      /* stop querying adapters that went away, their link event brings
+       * them back */
+      else if (sampler_can_wait(device) && if_nametoindex(device->link) == 0) {
+        DBG ("Waiting for %s to come back", device->interface);
+        snapshot->links[i][0] = '\0';
+        sampler_device_close(device);
+        g_ptr_array_add(sampler.parked, device);
+      }
+
+      g_strlcpy(snapshot->gateways[i], device->next_hop, INET6_ADDRSTRLEN);
+    }
+
+    WI_TRACE_END(begin, "sample");
+
+    sampler_publish();
+  }
+
+  return(NULL);
+}
+
+static gboolean
+sampler_timer(gpointer data)
+{
+  TRACE ("Entered sampler_timer");
+
+  /* sampler_collect() arms the next tick */
+  sampler.timer_id = 0;
+  sampler_request();
+
+  return(G_SOURCE_REMOVE);
+}
+
+static void
+sampler_link_event(const char *interface, int events, void *data)
+{
+  struct sampler_device *device;
+  GHashTableIter iter;
+  gpointer value;
+
+  /* ahead of the lookups, which go through the wireless interfaces */
+  sampler_command(COMMAND_LINK, NULL, interface, events);
+
+  g_hash_table_iter_init(&iter, sampler.devices);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    device = value;
+
+    if (device->follow_route) {
+      /* re-evaluated when a default route changes, when the current
+       * link goes away or when a radio appears while there is none */
+      if (interface == NULL || (events & (WI_EVENT_ROUTE | WI_EVENT_GONE)) != 0 ||
+          (!device->open && (events & WI_EVENT_LINK) != 0))
+        sampler_command(COMMAND_LOOKUP, device, NULL, 0);
+      else if (!device->open || g_strcmp0(interface, device->name) != 0)
+        continue;
+      g_atomic_int_set(&device->invalidate, 1);
+      sampler.refresh_pending = TRUE;
+    }
+    else if (!device->open) {
+      /* a parked adapter may be back, maybe under another name; the
+       * worker samples it as soon as it opened it */
+      if (interface == NULL)
+        sampler_command(COMMAND_LOOKUP, device, NULL, 0);
+      else if ((events & WI_EVENT_LINK) != 0)
+        sampler_command(COMMAND_LOOKUP, device, interface, 0);
+    }
+    else if (interface == NULL || g_strcmp0(interface, device->name) == 0) {
+      if ((events & WI_EVENT_GONE) != 0 && sampler_can_wait(device))
+        sampler_device_park(device);
+      else
+        g_atomic_int_set(&device->invalidate, 1);
+      sampler.refresh_pending = TRUE;
+    }
+  }
+}
+
+static gboolean
+sampler_monitor_cb(gint fd, GIOCondition condition, gpointer data)
+{
+  TRACE ("Entered sampler_monitor_cb");
+
+  /* coalesce a burst of events into a single sample */
+  sampler.refresh_pending = FALSE;
+  wi_monitor_dispatch(sampler.monitor, sampler_link_event, NULL);
+
+  /* a roam or reassociation is coming, follow it closely */
+  if (sampler.refresh_pending) {
+    sampler.interval = sampler.min_interval;
+    sampler_request();
+  }
+
+  return(G_SOURCE_CONTINUE);
+}
+
+static void
+sampler_init(void)
+{
+  if (sampler.devices != NULL)
+    return;
+
+  sampler.devices = g_hash_table_new(g_str_hash, g_str_equal);
+  sampler.interval = SAMPLER_MIN_INTERVAL;
+  sampler_update_bounds();
+
+  /* watch for link changes instead of polling disconnected devices */
+  if ((sampler.monitor = wi_monitor_open()) != NULL)
+    sampler.monitor_id = g_unix_fd_add(wi_monitor_get_fd(sampler.monitor), G_IO_IN,
+                                       sampler_monitor_cb, NULL);
+
+  g_mutex_init(&sampler.lock);
+  g_cond_init(&sampler.cond);
+  g_queue_init(&sampler.commands);
+  sampler.request = FALSE;
+  sampler.quit = FALSE;
+  sampler.batch = g_ptr_array_new();
+  sampler.parked = g_ptr_array_new();
+
+  sampler.back = 0;
+  sampler.slot = 1;
+  sampler.front = 2;
+
+  sampler.worker = g_thread_new("wavelan-sampler", sampler_worker, NULL);
+}
+
+static void
+sampler_shutdown(void)
+{
+  guint i;
+
+  if (sampler.devices == NULL ||
+      g_hash_table_size(sampler.devices) > 0 || sampler.subscribers != NULL)
+    return;
+
+  TRACE ("Shutting down the sampler");
+
+  g_mutex_lock(&sampler.lock);
+  sampler.quit = TRUE;
+  g_cond_signal(&sampler.cond);
+  g_mutex_unlock(&sampler.lock);
+  g_thread_join(sampler.worker);
+  sampler.worker = NULL;
+
+  g_mutex_clear(&sampler.lock);
+  g_cond_clear(&sampler.cond);
+
+  if (sampler.timer_id != 0) {
+    g_source_remove(sampler.timer_id);
+    sampler.timer_id = 0;
+  }
+
+  if (sampler.monitor != NULL) {
+    g_source_remove(sampler.monitor_id);
+    wi_monitor_close(sampler.monitor);
+    sampler.monitor = NULL;
+  }
+  g_clear_pointer(&sampler.wireless, g_hash_table_destroy);
+
+  g_hash_table_destroy(sampler.devices);
+  sampler.devices = NULL;
+  /* the worker freed every device before quitting */
+  g_ptr_array_free(sampler.batch, TRUE);
+  sampler.batch = NULL;
+  g_ptr_array_free(sampler.parked, TRUE);
+  sampler.parked = NULL;
+  g_clear_pointer(&sampler.batch_devices, g_free);
+  sampler.batch_size = 0;
+
+  /* a collect idle may still be queued, it finds devices == NULL */
+  for (i = 0; i < G_N_ELEMENTS(sampler.snapshots); i++) {
+    g_clear_pointer(&sampler.snapshots[i].devices, g_free);
+    g_clear_pointer(&sampler.snapshots[i].links, g_free);
+    g_clear_pointer(&sampler.snapshots[i].gateways, g_free);
+    g_clear_pointer(&sampler.snapshots[i].stats, g_free);
+    g_clear_pointer(&sampler.snapshots[i].results, g_free);
+    g_clear_pointer(&sampler.snapshots[i].timings, g_free);
+    sampler.snapshots[i].size = 0;
+  }
+}
+
+/* $WAVELAN_RECORD/<interface>.wltrace, replayed with "replay:<path>" */
+static struct wi_recorder *
+sampler_recorder_open(const char *interface)
+{
+  struct wi_recorder *recorder;
+  const gchar *directory;
+  gchar *name, *path;
+
+  if ((directory = g_getenv("WAVELAN_RECORD")) == NULL)
+    return(NULL);
+
+  name = g_strdup_printf("%s.wltrace", interface);
+  g_strdelimit(name, G_DIR_SEPARATOR_S ":", '_');
+  path = g_build_filename(directory, name, NULL);
+
+  if ((recorder = wi_recorder_open(path)) == NULL)
+    g_warning("Unable to record %s to %s", interface, path);
+  else
+    DBG ("Recording %s to %s", interface, path);
+
+  g_free(name);
+  g_free(path);
+
+  return(recorder);
+}
+
+/* <user data>/xfce4/wavelan/<interface>.wlhist, NULL on failure */
+gchar *
+sampler_history_path(const char *interface, gboolean create)
+{
+  gchar *name, *resource, *path;
+
+  name = g_strdup_printf("%s.wlhist", interface);
+  g_strdelimit(name, G_DIR_SEPARATOR_S ":", '_');
+  resource = g_build_filename(SAMPLER_HISTORY_DIR, name, NULL);
+
+  if (create)
+    path = xfce_resource_save_location(XFCE_RESOURCE_DATA, resource, TRUE);
+  else
+    path = xfce_resource_lookup(XFCE_RESOURCE_DATA, resource);
+
+  g_free(name);
+  g_free(resource);
+
+  return(path);
+}
+
+/* "aa:bb:cc:dd:ee:ff" */
+static gboolean
+sampler_parse_hwaddr(const gchar *text, guint8 *hwaddr)
+{
+  unsigned int bytes[WI_HWADDR_LEN];
+  int i, n = 0;
+
+  if (strlen(text) != 3 * WI_HWADDR_LEN - 1 ||
+      sscanf(text, "%2x:%2x:%2x:%2x:%2x:%2x%n", &bytes[0], &bytes[1], &bytes[2],
+             &bytes[3], &bytes[4], &bytes[5], &n) != WI_HWADDR_LEN ||
+      n != 3 * WI_HWADDR_LEN - 1)
+    return(FALSE);
+
+  for (i = 0; i < WI_HWADDR_LEN; i++)
+    hwaddr[i] = bytes[i];
+
+  return(TRUE);
+}
+
+struct sampler_device *
+sampler_device_ref(const char *interface)
+{
+  struct sampler_device *device;
+  guint8 hwaddr[WI_HWADDR_LEN];
+  gboolean by_hwaddr;
+
+  g_return_val_if_fail(interface != NULL, NULL);
+
+  sampler_init();
+
+  if ((device = g_hash_table_lookup(sampler.devices, interface)) != NULL) {
+    device->refcount++;
+    return(device);
+  }
+
+  device = g_new0(struct sampler_device, 1);
+  device->interface = g_strdup(interface);
+  device->follow_route = strcmp(interface, SAMPLER_AUTO_INTERFACE) == 0;
+
+  /* an adapter may be configured by its hardware address */
+  by_hwaddr = sampler_parse_hwaddr(interface, hwaddr);
+  if (by_hwaddr) {
+    memcpy(device->hwaddr, hwaddr, WI_HWADDR_LEN);
+    device->has_hwaddr = device->by_hwaddr = TRUE;
+  }
+
+  device->refcount = 1;
+  device->name = g_strdup(interface);
+  device->result = WI_NOSUCHDEV;
+  device->rx_throughput = device->tx_throughput = -1.0;
+  wi_timings_init(device->timings);
+  device->recorder = sampler_recorder_open(interface);
+  g_hash_table_insert(sampler.devices, device->interface, device);
+
+  /* the worker looks the adapter up and opens the WaveLAN device, or
+   * waits for its link event; until then it reports WI_NOSUCHDEV */
+  TRACE ("Looking up device %s", interface);
+  sampler_command(COMMAND_LOOKUP, device, NULL, 0);
+
+  return(device);
+}
+
+void
+sampler_device_unref(struct sampler_device *device)
+{
+  g_return_if_fail(device != NULL);
+
+  if (--device->refcount > 0)
+    return;
+
+  TRACE ("Closing device %s", device->interface);
+
+  g_hash_table_remove(sampler.devices, device->interface);
+  g_clear_pointer(&device->history, wi_history_close);
+
+  /* the worker frees it once done with the query in progress */
+  sampler_command(COMMAND_FREE, device, NULL, 0);
+
+  sampler_shutdown();
+}
+
+/* the link sampled, which auto and hardware address devices resolve */
+const char *
+sampler_device_get_interface(struct sampler_device *device)
+{
+  return(device->name);
+}
+
+/* the interface as given to sampler_device_ref() */
+const char *
+sampler_device_get_configured(struct sampler_device *device)
+{
+  return(device->interface);
+}
+
+const struct wi_stats *
+sampler_device_get_stats(struct sampler_device *device, int *result)
+{
+  if (result != NULL)
+    *result = device->result;
+
+  return(&device->stats);
+}
+
+/* rx and tx traffic in bit/s, FALSE until two samples could be compared */
+gboolean
+sampler_device_get_throughput(struct sampler_device *device, gdouble *rx, gdouble *tx)
+{
+  if (rx != NULL)
+    *rx = device->rx_throughput;
+  if (tx != NULL)
+    *tx = device->tx_throughput;
+
+  return(device->rx_throughput >= 0.0);
+}
+
+/* the next hop of the default route through the link sampled, as of
+ * the latest sample; NULL until sampler_device_lookup_gateway() had it
+ * looked up, or if there is none */
+const char *
+sampler_device_get_gateway(struct sampler_device *device)
+{
+  return((device->gateway[0] != '\0') ? device->gateway : NULL);
+}
+
+/* have the worker look the gateway up again with the next sample, e.g.
+ * after the link moved or a probe to it was lost */
+void
+sampler_device_lookup_gateway(struct sampler_device *device)
+{
+  g_atomic_int_set(&device->lookup_gateway, 1);
+}
+
+/* latencies of the backend calls of the device as of its latest
+ * sample, WI_CALL_COUNT of them; FALSE while the adapter is unplugged,
+ * they start over when it is back */
+gboolean
+sampler_device_get_timings(struct sampler_device *device, struct wi_timing *timings)
+{
+  if (!device->open)
+    return(FALSE);
+
+  memcpy(timings, device->timings, sizeof(device->timings));
+  return(TRUE);
+}
+
+/*
+ * Append every sample of the device to its history file for as long as
+ * one caller at least asks for it. Replays are not kept.
+ */
+void
+sampler_device_keep_history(struct sampler_device *device, gboolean keep)
+{
+  gchar *path;
+
+  g_return_if_fail(device != NULL);
+
+  if (!keep) {
+    g_return_if_fail(device->history_users > 0);
+    if (--device->history_users == 0)
+      g_clear_pointer(&device->history, wi_history_close);
+    return;
+  }
+
+  if (device->history_users++ > 0 || wi_replay_match(device->interface))
+    return;
+
+  if ((path = sampler_history_path(device->interface, TRUE)) == NULL)
+    g_warning("Unable to keep the history of %s", device->interface);
+  else if ((device->history = wi_history_open(path, WI_HISTORY_CAPACITY)) == NULL)
+    g_warning("Unable to keep the history of %s in %s: %s",
+              device->interface, path, g_strerror(errno));
+  else
+    DBG ("Keeping the history of %s in %s", device->interface, path);
+
+  g_free(path);
+}
+
+/* the history being written, NULL if none; read it in place with the
+ * wi_history_* functions */
+const struct wi_history *
+sampler_device_get_history(struct sampler_device *device)
+{
+  return(device->history);
+}
+
+void
+sampler_subscribe(sampler_func func, void *data)
+{
+  t_subscriber *subscriber;
+
+  g_return_if_fail(func != NULL);
+
+  sampler_init();
+
+  subscriber = g_new0(t_subscriber, 1);
+  subscriber->func = func;
+  subscriber->data = data;
+  subscriber->min_interval = SAMPLER_MIN_INTERVAL;
+  subscriber->max_interval = SAMPLER_MAX_INTERVAL;
+  sampler.subscribers = g_slist_append(sampler.subscribers, subscriber);
+
+  sampler_update_bounds();
+}
+
+void
+sampler_unsubscribe(sampler_func func, void *data)
+{
+  GSList *lp;
+
+  for (lp = sampler.subscribers; lp != NULL; lp = lp->next) {
+    t_subscriber *subscriber = lp->data;
+    if (subscriber->func == func && subscriber->data == data) {
+      sampler.subscribers = g_slist_remove(sampler.subscribers, subscriber);
+      g_free(subscriber);
+      break;
+    }
+  }
+
+  sampler_update_bounds();
+  sampler_shutdown();
+}
+
+/* bounds of the adaptive interval in ms, applied from the next sample */
+void
+sampler_set_interval(sampler_func func, void *data,
+                     unsigned int min_interval, unsigned int max_interval)
+{
+  GSList *lp;
+
+  min_interval = MAX(min_interval, SAMPLER_INTERVAL_FLOOR);
+  max_interval = MAX(max_interval, min_interval);
+
+  for (lp = sampler.subscribers; lp != NULL; lp = lp->next) {
+    t_subscriber *subscriber = lp->data;
+    if (subscriber->func == func && subscriber->data == data) {
+      subscriber->min_interval = min_interval;
+      subscriber->max_interval = max_interval;
+      break;
+    }
+  }
+
+  sampler_update_bounds();
+}
+
+/* every device currently referenced, in no particular order */
+void
+sampler_foreach_device(sampler_device_func func, void *data)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  if (sampler.devices == NULL)
+    return;
+
+  g_hash_table_iter_init(&iter, sampler.devices);
+  while (g_hash_table_iter_next(&iter, NULL, &value))
+    func(value, data);
+}
+
+/* sample as soon as possible, e.g. after devices were added, and look
+ * again for the adapters that are not open; the subscribers are
+ * notified once the worker is done */
+void
+sampler_refresh(void)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  if (sampler.devices == NULL)
+    return;
+
+  g_hash_table_iter_init(&iter, sampler.devices);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    struct sampler_device *device = value;
+
+    if (!device->open)
+      sampler_command(COMMAND_LOOKUP, device, NULL, 0);
+  }
+
+  sampler_request();
+}
+
+static gint
+sampler_compare_names(gconstpointer a, gconstpointer b)
+{
+  return(g_strcmp0(*(const gchar * const *) a, *(const gchar * const *) b));
+}
+
+/*
+ * Wireless interfaces present as last listed by the worker, sorted, as
+ * a NULL terminated array to free with g_strfreev(). Without link
+ * events, they are listed again for the next call.
+ */
+gchar **
+sampler_list_interfaces(void)
+{
+  GPtrArray *names;
+  GHashTableIter iter;
+  gpointer key;
+
+  TRACE ("Entered sampler_list_interfaces");
+
+  names = g_ptr_array_new();
+
+  g_mutex_lock(&sampler.lock);
+  if (sampler.wireless != NULL) {
+    g_hash_table_iter_init(&iter, sampler.wireless);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+      g_ptr_array_add(names, g_strdup(key));
+  }
+  g_mutex_unlock(&sampler.lock);
+
+  if (sampler.monitor == NULL && sampler.worker != NULL)
+    sampler_command(COMMAND_LINK, NULL, NULL, 0);
+
+  g_ptr_array_sort(names, sampler_compare_names);
+  g_ptr_array_add(names, NULL);
+
+  return((gchar **) g_ptr_array_free(names, FALSE));
+}
@@ -0,0 +1,95 @@
+/* Copyright (c) 2025 The Xfce development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __SAMPLER_H__
+#define __SAMPLER_H__
+
+#include "wi.h"
+
+/*
+ * Process wide registry of devices. Every interface is opened once,
+ * whatever the number of plugin instances showing it, and all of them
+ * are sampled together by a single clock. Subscribers are notified
+ * after every sample and read the results from their devices.
+ *
+ * The clock speeds up while the signal moves and backs off while it is
+ * steady or absent, within the tightest bounds asked for by any of the
+ * subscribers.
+ *
+ * Where the platform reports link changes, a device whose adapter is
+ * unplugged is closed and costs nothing until its link comes back,
+ * under the same name or the same hardware address. An interface may
+ * also be given as a hardware address, "aa:bb:cc:dd:ee:ff", or as
+ * SAMPLER_AUTO_INTERFACE to follow the radio carrying the default route.
+ *
+ * The adapters are looked up, opened, queried and closed on a worker
+ * thread, which hands the samples, the interfaces they were found on
+ * and the call latencies over with each snapshot; everything declared
+ * here, including the subscriber callbacks, stays on the main thread
+ * and never waits for a driver. An adapter that fails to open is
+ * looked for again on its next link event or sampler_refresh().
+ */
+
+struct sampler_device;
+
+typedef void (*sampler_func)(void *data);
+typedef void (*sampler_device_func)(struct sampler_device *device, void *data);
+
+/* bounds of the adaptive sampling interval, in milliseconds */
+#define SAMPLER_MIN_INTERVAL  500
+#define SAMPLER_MAX_INTERVAL  30000
+#define SAMPLER_INTERVAL_FLOOR  100
+
+/* bounds of a subscriber that follows whatever pace the others set */
+#define SAMPLER_ANY_INTERVAL  G_MAXUINT
+
+/* where histories are kept, under the user data directory */
+#define SAMPLER_HISTORY_DIR  "xfce4" G_DIR_SEPARATOR_S "wavelan"
+
+/* the wireless interface of the default route, whichever it is */
+#define SAMPLER_AUTO_INTERFACE  "auto"
+
+extern struct sampler_device *sampler_device_ref(const char *);
+extern void sampler_device_unref(struct sampler_device *);
+extern const char *sampler_device_get_interface(struct sampler_device *);
+extern const char *sampler_device_get_configured(struct sampler_device *);
+extern const struct wi_stats *sampler_device_get_stats(struct sampler_device *, int *);
+extern gboolean sampler_device_get_throughput(struct sampler_device *, gdouble *, gdouble *);
+extern const char *sampler_device_get_gateway(struct sampler_device *);
+extern void sampler_device_lookup_gateway(struct sampler_device *);
+extern gboolean sampler_device_get_timings(struct sampler_device *, struct wi_timing *);
+extern void sampler_device_keep_history(struct sampler_device *, gboolean);
+extern const struct wi_history *sampler_device_get_history(struct sampler_device *);
+extern gchar *sampler_history_path(const char *, gboolean);
+
+extern void sampler_foreach_device(sampler_device_func, void *);
+
+extern void sampler_subscribe(sampler_func, void *);
+extern void sampler_unsubscribe(sampler_func, void *);
+extern void sampler_set_interval(sampler_func, void *, unsigned int, unsigned int);
+extern void sampler_refresh(void);
+
+extern gchar **sampler_list_interfaces(void);
+
+#endif  /* !__SAMPLER_H__ */
@@ -0,0 +1,478 @@
+/* Copyright (c) 2025 The Xfce development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include "sampler.h"
+#include "service.h"
+
+#define SERVICE_NAME              "org.xfce.Wavelan"
+#define SERVICE_PATH              "/org/xfce/Wavelan"
+#define SERVICE_DEVICE_PATH       SERVICE_PATH "/Device/"
+#define SERVICE_INTERFACE         "org.xfce.Wavelan"
+#define SERVICE_DEVICE_INTERFACE  "org.xfce.Wavelan.Device"
+
+static const gchar service_xml[] =
+  "<node>"
+  "  <interface name='" SERVICE_INTERFACE "'>"
+  "    <method name='Refresh'/>"
+  "    <property name='Devices' type='ao' access='read'/>"
+  "  </interface>"
+  "  <interface name='" SERVICE_DEVICE_INTERFACE "'>"
+  "    <property name='Interface' type='s' access='read'/>"
+  "    <property name='Name' type='s' access='read'/>"
+  "    <property name='Status' type='s' access='read'/>"
+  "    <property name='Quality' type='i' access='read'/>"
+  "    <property name='QualityUnit' type='s' access='read'/>"
+  "    <property name='Rate' type='i' access='read'/>"
+  "    <property name='NetworkName' type='s' access='read'/>"
+  "    <property name='Vendor' type='s' access='read'/>"
+  "    <property name='Details' type='a{sv}' access='read'/>"
+  "    <property name='RxThroughput' type='d' access='read'/>"
+  "    <property name='TxThroughput' type='d' access='read'/>"
+  "  </interface>"
+  "</node>";
+
+/* in the order of service_xml */
+enum
+{
+  PROP_INTERFACE,
+  PROP_NAME,
+  PROP_STATUS,
+  PROP_QUALITY,
+  PROP_QUALITY_UNIT,
+  PROP_RATE,
+  PROP_NETWORK_NAME,
+  PROP_VENDOR,
+  PROP_DETAILS,
+  PROP_RX_THROUGHPUT,
+  PROP_TX_THROUGHPUT,
+  N_PROPS
+};
+
+static const gchar *property_names[N_PROPS] = {
+  "Interface", "Name", "Status", "Quality", "QualityUnit", "Rate",
+  "NetworkName", "Vendor", "Details", "RxThroughput", "TxThroughput",
+};
+
+typedef struct
+{
+  gchar *path;
+  guint registration_id;
+  gboolean seen;                /* still in the sampler after a sync */
+  GVariant *values[N_PROPS];    /* as last published */
+} t_exported;
+
+static struct
+{
+  gint refcount;
+  guint owner_id;
+  GDBusConnection *connection;
+  GDBusNodeInfo *info;
+  guint root_id;
+  GHashTable *devices;          /* configured interface -> t_exported */
+  GVariant *paths;              /* Devices, as last published */
+} service;
+
+/* D-Bus strings are UTF-8, an SSID is any bytes */
+static GVariant *
+service_string(const gchar *s)
+{
+  GString *valid;
+  const gchar *end;
+
+  if (g_utf8_validate(s, -1, &end))
+    return(g_variant_new_string(s));
+
+  valid = g_string_new(NULL);
+  do {
+    g_string_append_len(valid, s, end - s);
+    g_string_append(valid, "\xef\xbf\xbd");
+    s = end + 1;
+  } while (!g_utf8_validate(s, -1, &end));
+  g_string_append(valid, s);
+
+  return(g_variant_new_take_string(g_string_free(valid, FALSE)));
+}
+
+/* "aa:bb" is not a valid path element, nor is anything but [A-Za-z0-9_] */
+static gchar *
+service_device_path(const gchar *interface)
+{
+  GString *path = g_string_new(SERVICE_DEVICE_PATH);
+  const guchar *p;
+
+  for (p = (const guchar *) interface; *p != '\0'; p++) {
+    if (g_ascii_isalnum(*p))
+      g_string_append_c(path, *p);
+    else
+      g_string_append_printf(path, "_%02x", *p);
+  }
+
+  return(g_string_free(path, FALSE));
+}
+
+static GVariant *
+service_rate(const struct wi_rate *rate)
+{
+  GVariantBuilder builder;
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add(&builder, "{sv}", "bitrate",
+                        g_variant_new_double(rate->wr_bitrate / 10.0));
+  if (rate->wr_mcs >= 0) {
+    g_variant_builder_add(&builder, "{sv}", "mode", g_variant_new_string(rate->wr_mode));
+    g_variant_builder_add(&builder, "{sv}", "mcs", g_variant_new_int32(rate->wr_mcs));
+  }
+  if (rate->wr_nss > 0)
+    g_variant_builder_add(&builder, "{sv}", "nss", g_variant_new_int32(rate->wr_nss));
+  if (rate->wr_width > 0)
+    g_variant_builder_add(&builder, "{sv}", "width", g_variant_new_int32(rate->wr_width));
+
+  return(g_variant_builder_end(&builder));
+}
+
+/* the link details the backend reported, with the keys of wavelan-probe */
+static GVariant *
+service_details(const struct wi_link *link)
+{
+  const struct wi_link_field *field;
+  GVariantBuilder builder;
+  const guchar *b;
+  GVariant *value;
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+
+  for (field = wi_link_fields; field->wf_key != NULL; field++) {
+    if ((link->wl_valid & field->wf_valid) == 0)
+      continue;
+
+    switch (field->wf_type) {
+    case WI_FIELD_INT:
+      value = g_variant_new_int32(*(const int *) WI_LINK_FIELD(link, field));
+      break;
+    case WI_FIELD_UINT:
+      value = g_variant_new_uint32(*(const unsigned int *) WI_LINK_FIELD(link, field));
+      break;
+    case WI_FIELD_UINT64:
+      value = g_variant_new_uint64(*(const unsigned long long *) WI_LINK_FIELD(link, field));
+      break;
+    case WI_FIELD_RATE:
+      value = service_rate(WI_LINK_FIELD(link, field));
+      break;
+    case WI_FIELD_BSSID:
+      b = WI_LINK_FIELD(link, field);
+      value = g_variant_new_take_string(g_strdup_printf("%02x:%02x:%02x:%02x:%02x:%02x",
+                                                        b[0], b[1], b[2], b[3], b[4], b[5]));
+      break;
+    default:
+      continue;
+    }
+    g_variant_builder_add(&builder, "{sv}", field->wf_key, value);
+  }
+
+  return(g_variant_builder_end(&builder));
+}
+
+/* the properties of a device, from its latest sample */
+static void
+service_device_values(struct sampler_device *device, GVariant **values)
+{
+  static const struct wi_stats none;
+  const struct wi_stats *stats;
+  gdouble rx, tx;
+  int result;
+
+  stats = sampler_device_get_stats(device, &result);
+  sampler_device_get_throughput(device, &rx, &tx);
+  if (result != WI_OK && result != WI_NOCARRIER)
+    stats = &none;
+
+  values[PROP_INTERFACE] = service_string(sampler_device_get_configured(device));
+  values[PROP_NAME] = service_string(sampler_device_get_interface(device));
+  values[PROP_STATUS] = g_variant_new_string(wi_result_name(result));
+  values[PROP_QUALITY] = g_variant_new_int32(result == WI_OK ? stats->ws_quality : 0);
+  values[PROP_QUALITY_UNIT] = service_string(stats->ws_qunit);
+  values[PROP_RATE] = g_variant_new_int32(result == WI_OK ? stats->ws_rate : 0);
+  values[PROP_NETWORK_NAME] = service_string(result == WI_OK ? stats->ws_netname : "");
+  values[PROP_VENDOR] = service_string(stats->ws_vendor);
+  values[PROP_DETAILS] = service_details(result == WI_OK ? &stats->ws_link : &none.ws_link);
+  values[PROP_RX_THROUGHPUT] = g_variant_new_double(rx);
+  values[PROP_TX_THROUGHPUT] = g_variant_new_double(tx);
+}
+
+static void
+service_emit_changed(const gchar *path, const gchar *interface, GVariantBuilder *changed)
+{
+  GError *error = NULL;
+
+  if (!g_dbus_connection_emit_signal(service.connection, NULL, path,
+                                     "org.freedesktop.DBus.Properties", "PropertiesChanged",
+                                     g_variant_new("(sa{sv}as)", interface, changed, NULL),
+                                     &error)) {
+    DBG ("PropertiesChanged on %s: %s", path, error->message);
+    g_error_free(error);
+  }
+}
+
+static GVariant *
+service_get_property(GDBusConnection *connection, const gchar *sender,
+                     const gchar *path, const gchar *interface,
+                     const gchar *property, GError **error, gpointer data)
+{
+  t_exported *exported = data;
+  guint i;
+
+  if (exported == NULL)
+    return(g_variant_ref(service.paths));
+
+  for (i = 0; i < N_PROPS; i++) {
+    if (strcmp(property, property_names[i]) == 0)
+      return(g_variant_ref(exported->values[i]));
+  }
+
+  g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+              "No such property: %s", property);
+  return(NULL);
+}
+
+static void
+service_method_call(GDBusConnection *connection, const gchar *sender,
+                    const gchar *path, const gchar *interface,
+                    const gchar *method, GVariant *parameters,
+                    GDBusMethodInvocation *invocation, gpointer data)
+{
+  /* the answer is the PropertiesChanged following the sample */
+  if (strcmp(method, "Refresh") == 0) {
+    sampler_refresh();
+    g_dbus_method_invocation_return_value(invocation, NULL);
+    return;
+  }
+
+  g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+                                        "No such method: %s", method);
+}
+
+static const GDBusInterfaceVTable service_vtable = {
+  service_method_call,
+  service_get_property,
+  NULL,
+};
+
+static void
+service_exported_free(gpointer data)
+{
+  t_exported *exported = data;
+  guint i;
+
+  if (exported->registration_id != 0)
+    g_dbus_connection_unregister_object(service.connection, exported->registration_id);
+  for (i = 0; i < N_PROPS; i++)
+    g_variant_unref(exported->values[i]);
+  g_free(exported->path);
+  g_free(exported);
+}
+
+/* publish a device, emitting what changed since the previous sample */
+static void
+service_device_sync(struct sampler_device *device, void *data)
+{
+  const gchar *interface = sampler_device_get_configured(device);
+  GVariant *values[N_PROPS];
+  GVariantBuilder changed;
+  t_exported *exported;
+  gboolean emit = FALSE;
+  GError *error = NULL;
+  guint i;
+
+  service_device_values(device, values);
+
+  if ((exported = g_hash_table_lookup(service.devices, interface)) == NULL) {
+    exported = g_new0(t_exported, 1);
+    exported->path = service_device_path(interface);
+    for (i = 0; i < N_PROPS; i++)
+      exported->values[i] = g_variant_ref_sink(values[i]);
+    exported->registration_id =
+      g_dbus_connection_register_object(service.connection, exported->path,
+                                        service.info->interfaces[1], &service_vtable,
+                                        exported, NULL, &error);
+    if (exported->registration_id == 0) {
+      DBG ("Could not export %s: %s", exported->path, error->message);
+      g_error_free(error);
+    }
+    exported->seen = TRUE;
+    g_hash_table_insert(service.devices, g_strdup(interface), exported);
+    return;
+  }
+
+  g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+  for (i = 0; i < N_PROPS; i++) {
+    g_variant_ref_sink(values[i]);
+    if (g_variant_equal(values[i], exported->values[i])) {
+      g_variant_unref(values[i]);
+      continue;
+    }
+    g_variant_builder_add(&changed, "{sv}", property_names[i], values[i]);
+    g_variant_unref(exported->values[i]);
+    exported->values[i] = values[i];
+    emit = TRUE;
+  }
+  exported->seen = TRUE;
+
+  if (emit)
+    service_emit_changed(exported->path, SERVICE_DEVICE_INTERFACE, &changed);
+  else
+    g_variant_builder_clear(&changed);
+}
+
+/* bring the published devices in line with those of the sampler */
+static void
+service_sync(void)
+{
+  GVariantBuilder builder, changed;
+  GHashTableIter iter;
+  GPtrArray *paths;
+  GVariant *value;
+  gpointer data;
+  guint i;
+
+  g_hash_table_iter_init(&iter, service.devices);
+  while (g_hash_table_iter_next(&iter, NULL, &data))
+    ((t_exported *) data)->seen = FALSE;
+
+  sampler_foreach_device(service_device_sync, NULL);
+
+  paths = g_ptr_array_new();
+  g_hash_table_iter_init(&iter, service.devices);
+  while (g_hash_table_iter_next(&iter, NULL, &data)) {
+    t_exported *exported = data;
+    if (!exported->seen)
+      g_hash_table_iter_remove(&iter);
+    else
+      g_ptr_array_add(paths, exported->path);
+  }
+
+  /* sorted, so that the list only changes with the devices */
+  g_ptr_array_sort(paths, (GCompareFunc) g_strcmp0);
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_OBJECT_PATH_ARRAY);
+  for (i = 0; i < paths->len; i++)
+    g_variant_builder_add(&builder, "o", g_ptr_array_index(paths, i));
+  g_ptr_array_free(paths, TRUE);
+  value = g_variant_ref_sink(g_variant_builder_end(&builder));
+
+  if (service.paths != NULL && g_variant_equal(value, service.paths)) {
+    g_variant_unref(value);
+    return;
+  }
+
+  if (service.paths != NULL) {
+    g_variant_unref(service.paths);
+    service.paths = value;
+    g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&changed, "{sv}", "Devices", value);
+    service_emit_changed(SERVICE_PATH, SERVICE_INTERFACE, &changed);
+  }
+  else
+    service.paths = value;
+}
+
+/* called by the sampler after every sample */
+static void
+service_sampled(void *data)
+{
+  if (service.connection != NULL)
+    service_sync();
+}
+
+static void
+service_bus_acquired(GDBusConnection *connection, const gchar *name, gpointer data)
+{
+  GError *error = NULL;
+
+  TRACE ("Exporting the devices on the session bus");
+
+  service.connection = g_object_ref(connection);
+  service_sync();
+
+  service.root_id = g_dbus_connection_register_object(connection, SERVICE_PATH,
+                                                      service.info->interfaces[0],
+                                                      &service_vtable, NULL, NULL, &error);
+  if (service.root_id == 0) {
+    DBG ("Could not export %s: %s", SERVICE_PATH, error->message);
+    g_error_free(error);
+  }
+}
+
+static void
+service_name_lost(GDBusConnection *connection, const gchar *name, gpointer data)
+{
+  /* another panel owns it, or there is no session bus at all */
+  DBG ("Not the owner of %s", name);
+}
+
+/* a subscriber like the plugins, the devices come from them */
+void
+service_ref(void)
+{
+  if (service.refcount++ > 0)
+    return;
+
+  service.info = g_dbus_node_info_new_for_xml(service_xml, NULL);
+  service.devices = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, service_exported_free);
+
+  sampler_subscribe(service_sampled, NULL);
+  sampler_set_interval(service_sampled, NULL, SAMPLER_ANY_INTERVAL, SAMPLER_ANY_INTERVAL);
+
+  service.owner_id = g_bus_own_name(G_BUS_TYPE_SESSION, SERVICE_NAME,
+                                    G_BUS_NAME_OWNER_FLAGS_NONE,
+                                    service_bus_acquired, NULL, service_name_lost,
+                                    NULL, NULL);
+}
+
+void
+service_unref(void)
+{
+  g_return_if_fail(service.refcount > 0);
+
+  if (--service.refcount > 0)
+    return;
+
+  g_bus_unown_name(service.owner_id);
+  service.owner_id = 0;
+
+  sampler_unsubscribe(service_sampled, NULL);
+
+  /* unregisters the device objects while the connection is still ours */
+  g_clear_pointer(&service.devices, g_hash_table_destroy);
+  if (service.root_id != 0)
+    g_dbus_connection_unregister_object(service.connection, service.root_id);
+  service.root_id = 0;
+  g_clear_pointer(&service.paths, g_variant_unref);
+  g_clear_object(&service.connection);
+  g_clear_pointer(&service.info, g_dbus_node_info_unref);
+}
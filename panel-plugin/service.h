@@ -0,0 +1,46 @@
+/* Copyright (c) 2025 The Xfce development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __SERVICE_H__
+#define __SERVICE_H__
+
+/*
+ * Publishes the devices of the sampler on the session bus, so that
+ * other programs read the samples of the panel instead of querying the
+ * kernel again. The name org.xfce.Wavelan is owned by the first panel
+ * process asking for it, the others queue behind it.
+ *
+ *   /org/xfce/Wavelan              org.xfce.Wavelan
+ *     Devices (ao), Refresh()
+ *   /org/xfce/Wavelan/Device/<if>  org.xfce.Wavelan.Device
+ *     Interface, Name, Status, Quality, QualityUnit, Rate, NetworkName,
+ *     Vendor, Details (a{sv}), RxThroughput, TxThroughput
+ *
+ * Every property emits PropertiesChanged when a sample changes it.
+ */
+
+extern void service_ref(void);
+extern void service_unref(void);
+
+#endif  /* !__SERVICE_H__ */
@@ -0,0 +1,491 @@
+/* Copyright (c) 2025 The Xfce development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Headless poller built from the same wi_* backends as the plugin.
+ * Every sample of every interface is printed on its own line, either
+ * tab separated
+ *
+ *   interface  status  quality+unit  rate  netname
+ *
+ * or, with --json, as one JSON object. With --ping, a line follows each
+ * sample with the round trips to a host, over the last WI_PING_WINDOW
+ * probes
+ *
+ *   address  ping  average  jitter  loss
+ *
+ * With --history, the samples kept by the plugin in a history file are
+ * printed instead, one per line, from the oldest
+ *
+ *   time  status  quality+unit  level  rate  netname
+ */
+
+#ifdef HAVE_XFCE_REVISION_H
+#include "xfce-revision.h"
+#endif
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "wi.h"
+
+static gchar **interfaces = NULL;
+static gdouble interval = 1.0;
+static gint count = 1;
+static gboolean json = FALSE;
+static gboolean watch = FALSE;
+static gchar *ping_address = NULL;
+static gchar *history_path = NULL;
+static gdouble since = 24.0;
+
+static GOptionEntry entries[] =
+{
+  { "interface", 'i', 0, G_OPTION_ARG_STRING_ARRAY, &interfaces,
+    "Interface to query, may be repeated or a comma separated list "
+    "(default: every wireless interface)", "NAME" },
+  { "interval", 't', 0, G_OPTION_ARG_DOUBLE, &interval,
+    "Seconds between samples (default 1)", "SECONDS" },
+  { "count", 'c', 0, G_OPTION_ARG_INT, &count,
+    "Number of samples, 0 for no limit (default 1)", "N" },
+  { "json", 'j', 0, G_OPTION_ARG_NONE, &json,
+    "Print JSON objects instead of tab separated fields", NULL },
+  { "watch", 'w', 0, G_OPTION_ARG_NONE, &watch,
+    "Run until interrupted, printing only changes, right away on link events", NULL },
+  { "ping", 'p', 0, G_OPTION_ARG_STRING, &ping_address,
+    "Probe the round trip to an IP address on every sample", "ADDRESS" },
+  { "history", 'H', 0, G_OPTION_ARG_FILENAME, &history_path,
+    "Print the samples kept in a history file and exit", "FILE" },
+  { "since", 's', 0, G_OPTION_ARG_DOUBLE, &since,
+    "Hours of history printed, 0 for all of it (default 24)", "HOURS" },
+  { NULL }
+};
+
+typedef struct
+{
+  gchar *name;
+  struct wi_device *device;
+  struct wi_stats stats;
+  int result;
+  gboolean printed;
+} t_probe;
+
+/* SSIDs are arbitrary bytes: UTF-8 is kept, control characters are
+ * escaped and invalid sequences replaced like service_string() does */
+static void
+probe_json_string(GString *out, const gchar *s)
+{
+  const gchar *p, *next;
+
+  g_string_append_c(out, '"');
+  for (p = s; *p != '\0'; p = next) {
+    guchar c = *p;
+
+    next = p + 1;
+    if (c == '"' || c == '\\')
+      g_string_append_printf(out, "\\%c", c);
+    else if (c < 0x20 || c == 0x7f)
+      g_string_append_printf(out, "\\u%04x", c);
+    else if (c < 0x80)
+      g_string_append_c(out, c);
+    else if ((gint) g_utf8_get_char_validated(p, -1) < 0)
+      g_string_append(out, "\xef\xbf\xbd");
+    else {
+      next = g_utf8_next_char(p);
+      g_string_append_len(out, p, next - p);
+    }
+  }
+  g_string_append_c(out, '"');
+}
+
+static void
+probe_json_rate(GString *out, const gchar *key, const struct wi_rate *rate)
+{
+  g_string_append_printf(out, ", \"%s\": {\"bitrate\": %d.%d", key,
+                         rate->wr_bitrate / 10, rate->wr_bitrate % 10);
+  if (rate->wr_mcs >= 0)
+    g_string_append_printf(out, ", \"mode\": \"%s\", \"mcs\": %d", rate->wr_mode, rate->wr_mcs);
+  if (rate->wr_nss > 0)
+    g_string_append_printf(out, ", \"nss\": %d", rate->wr_nss);
+  if (rate->wr_width > 0)
+    g_string_append_printf(out, ", \"width\": %d", rate->wr_width);
+  g_string_append_c(out, '}');
+}
+
+/* the extended statistics, only those the backend reported */
+static void
+probe_json_link(GString *out, const struct wi_link *link)
+{
+  const struct wi_link_field *field;
+  const guchar *b;
+
+  for (field = wi_link_fields; field->wf_key != NULL; field++) {
+    if ((link->wl_valid & field->wf_valid) == 0)
+      continue;
+
+    switch (field->wf_type) {
+    case WI_FIELD_INT:
+      g_string_append_printf(out, ", \"%s\": %d", field->wf_key,
+                             *(const int *) WI_LINK_FIELD(link, field));
+      break;
+    case WI_FIELD_UINT:
+      g_string_append_printf(out, ", \"%s\": %u", field->wf_key,
+                             *(const unsigned int *) WI_LINK_FIELD(link, field));
+      break;
+    case WI_FIELD_UINT64:
+      g_string_append_printf(out, ", \"%s\": %llu", field->wf_key,
+                             *(const unsigned long long *) WI_LINK_FIELD(link, field));
+      break;
+    case WI_FIELD_RATE:
+      probe_json_rate(out, field->wf_key, WI_LINK_FIELD(link, field));
+      break;
+    case WI_FIELD_BSSID:
+      b = WI_LINK_FIELD(link, field);
+      g_string_append_printf(out, ", \"%s\": \"%02x:%02x:%02x:%02x:%02x:%02x\"",
+                             field->wf_key, b[0], b[1], b[2], b[3], b[4], b[5]);
+      break;
+    }
+  }
+}
+
+static void
+probe_print(GString *out, t_probe *probe)
+{
+  const struct wi_stats *stats = &probe->stats;
+
+  g_string_truncate(out, 0);
+
+  if (json) {
+    g_string_append_printf(out, "{\"time\": %" G_GINT64_FORMAT ", \"interface\": ",
+                           g_get_real_time() / 1000);
+    probe_json_string(out, probe->name);
+    g_string_append_printf(out, ", \"status\": \"%s\"", wi_result_name(probe->result));
+    if (probe->result == WI_OK) {
+      g_string_append(out, ", \"netname\": ");
+      probe_json_string(out, stats->ws_netname);
+      g_string_append_printf(out, ", \"quality\": %d, \"unit\": ", stats->ws_quality);
+      probe_json_string(out, stats->ws_qunit);
+      g_string_append_printf(out, ", \"rate\": %d", stats->ws_rate);
+      probe_json_link(out, &stats->ws_link);
+    }
+    if (probe->result == WI_OK || probe->result == WI_NOCARRIER) {
+      g_string_append(out, ", \"vendor\": ");
+      probe_json_string(out, stats->ws_vendor);
+    }
+    g_string_append(out, "}\n");
+  }
+  else if (probe->result == WI_OK)
+    g_string_append_printf(out, "%s\t%s\t%d%s\t%d\t%s\n", probe->name,
+                           wi_result_name(probe->result), stats->ws_quality,
+                           stats->ws_qunit, stats->ws_rate, stats->ws_netname);
+  else
+    g_string_append_printf(out, "%s\t%s\t\t\t\n", probe->name,
+                           wi_result_name(probe->result));
+
+  fputs(out->str, stdout);
+}
+
+static void
+probe_print_ping(GString *out, struct wi_ping *ping)
+{
+  struct wi_ping_stats stats;
+
+  wi_ping_get_stats(ping, &stats);
+  g_string_truncate(out, 0);
+
+  if (json) {
+    g_string_append_printf(out, "{\"time\": %" G_GINT64_FORMAT ", \"ping\": ",
+                           g_get_real_time() / 1000);
+    probe_json_string(out, wi_ping_get_address(ping));
+    g_string_append_printf(out, ", \"sent\": %d, \"received\": %d",
+                           stats.wp_sent, stats.wp_received);
+    if (stats.wp_received > 0)
+      g_string_append_printf(out, ", \"last\": %d, \"min\": %d, \"avg\": %d, \"max\": %d",
+                             stats.wp_last, stats.wp_min, stats.wp_avg, stats.wp_max);
+    if (stats.wp_jitter >= 0)
+      g_string_append_printf(out, ", \"jitter\": %d", stats.wp_jitter);
+    g_string_append(out, "}\n");
+  }
+  else if (stats.wp_received > 0)
+    g_string_append_printf(out, "%s\tping\t%.3f\t%.3f\t%d%%\n", wi_ping_get_address(ping),
+                           stats.wp_avg / 1000.0, MAX(stats.wp_jitter, 0) / 1000.0,
+                           100 * (stats.wp_sent - stats.wp_received) / stats.wp_sent);
+  else
+    g_string_append_printf(out, "%s\tping\t\t\t%s\n", wi_ping_get_address(ping),
+                           stats.wp_sent > 0 ? "100%" : "");
+
+  fputs(out->str, stdout);
+}
+
+static gboolean
+probe_changed(const t_probe *probe, const struct wi_stats *stats, int result)
+{
+  return(!probe->printed || result != probe->result ||
+         (result == WI_OK &&
+          (stats->ws_quality != probe->stats.ws_quality ||
+           stats->ws_rate != probe->stats.ws_rate ||
+           strcmp(stats->ws_netname, probe->stats.ws_netname) != 0)));
+}
+
+static void
+probe_link_event(const char *interface, int events, void *data)
+{
+  gboolean *pending = data;
+
+  *pending = TRUE;
+}
+
+/* sleep for an interval, answering probes; in watch mode, a link event
+ * cuts it short */
+static void
+probe_wait(struct wi_monitor *monitor, struct wi_ping *ping,
+           struct wi_device **devices, gint n)
+{
+  gint64 deadline = g_get_monotonic_time() + interval * G_USEC_PER_SEC;
+  gint64 now;
+  gboolean pending;
+  gint i;
+
+  while ((now = g_get_monotonic_time()) < deadline) {
+    struct pollfd pfds[2] = {
+      { monitor != NULL ? wi_monitor_get_fd(monitor) : -1, POLLIN, 0 },
+      { ping != NULL ? wi_ping_get_fd(ping) : -1, POLLIN, 0 },
+    };
+
+    if (poll(pfds, 2, (deadline - now + 999) / 1000) <= 0)
+      continue;
+
+    if (pfds[1].revents != 0)
+      wi_ping_dispatch(ping);
+
+    if (pfds[0].revents != 0) {
+      pending = FALSE;
+      wi_monitor_dispatch(monitor, probe_link_event, &pending);
+      if (pending) {
+        for (i = 0; i < n; i++)
+          wi_invalidate(devices[i]);
+        return;
+      }
+    }
+  }
+}
+
+/* the file is mapped, the records are read in place */
+static int
+probe_history(const gchar *path)
+{
+  const struct wi_history_record *record;
+  struct wi_history *history;
+  unsigned long long n, end;
+  gchar netname[WI_HISTORY_NAMELEN + 1];
+  char qunit[4];
+  GString *out;
+
+  if ((history = wi_history_map(path)) == NULL) {
+    g_printerr("wavelan-probe: unable to read the history in %s\n", path);
+    return(EXIT_FAILURE);
+  }
+
+  wi_history_get_qunit(history, qunit, sizeof(qunit));
+  out = g_string_sized_new(256);
+
+  end = wi_history_end(history);
+  n = (since > 0.0) ?
+    wi_history_find(history, g_get_real_time() / 1000 - (gint64)(since * 3600 * 1000)) :
+    wi_history_first(history);
+
+  for (; n < end; n++) {
+    if ((record = wi_history_get(history, n)) == NULL)
+      continue;
+    wi_history_get_network(history, record->wh_network, netname, sizeof(netname));
+
+    g_string_truncate(out, 0);
+    if (json) {
+      g_string_append_printf(out, "{\"time\": %" G_GINT64_FORMAT ", \"status\": \"%s\"",
+                             (gint64)record->wh_time, wi_result_name(record->wh_result));
+      if (record->wh_result == WI_OK) {
+        g_string_append(out, ", \"netname\": ");
+        probe_json_string(out, netname);
+        g_string_append_printf(out, ", \"quality\": %d, \"unit\": ", record->wh_quality);
+        probe_json_string(out, qunit);
+        g_string_append_printf(out, ", \"rate\": %u", record->wh_rate);
+        if (record->wh_level != WI_HISTORY_NO_LEVEL)
+          g_string_append_printf(out, ", \"signal\": %d", record->wh_level);
+      }
+      g_string_append(out, "}\n");
+    }
+    else if (record->wh_result == WI_OK) {
+      g_string_append_printf(out, "%" G_GINT64_FORMAT "\t%s\t%d%s\t", (gint64)record->wh_time,
+                             wi_result_name(record->wh_result), record->wh_quality, qunit);
+      if (record->wh_level != WI_HISTORY_NO_LEVEL)
+        g_string_append_printf(out, "%d", record->wh_level);
+      g_string_append_printf(out, "\t%u\t%s\n", record->wh_rate, netname);
+    }
+    else
+      g_string_append_printf(out, "%" G_GINT64_FORMAT "\t%s\t\t\t\t\n", (gint64)record->wh_time,
+                             wi_result_name(record->wh_result));
+
+    fputs(out->str, stdout);
+  }
+
+  g_string_free(out, TRUE);
+  wi_history_close(history);
+
+  return(EXIT_SUCCESS);
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  struct wi_monitor *monitor = NULL;
+  struct wi_ping *ping = NULL;
+  struct wi_device **devices;
+  struct wi_stats *stats;
+  t_probe *probes;
+  GPtrArray *names;
+  GString *out;
+  int *results;
+  gint n, i, j, sample;
+
+  context = g_option_context_new(NULL);
+  g_option_context_set_summary(context, "Print the state of wireless interfaces.");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("wavelan-probe: %s\n", error->message);
+    g_error_free(error);
+    return(EXIT_FAILURE);
+  }
+  g_option_context_free(context);
+
+  if (history_path != NULL) {
+    i = probe_history(history_path);
+    g_free(history_path);
+    return(i);
+  }
+
+  names = g_ptr_array_new_with_free_func(g_free);
+  for (i = 0; interfaces != NULL && interfaces[i] != NULL; i++) {
+    gchar **list = g_strsplit(interfaces[i], ",", -1);
+    for (j = 0; list[j] != NULL; j++) {
+      g_strstrip(list[j]);
+      if (*list[j] != '\0')
+        g_ptr_array_add(names, g_strdup(list[j]));
+    }
+    g_strfreev(list);
+  }
+  g_strfreev(interfaces);
+
+  /* every wireless interface present by default */
+  if (names->len == 0) {
+    gchar **listed = wi_list_interfaces();
+    for (i = 0; listed != NULL && listed[i] != NULL; i++)
+      g_ptr_array_add(names, g_strdup(listed[i]));
+    wi_free_interfaces(listed);
+  }
+  if (names->len == 0 && ping_address == NULL) {
+    g_printerr("wavelan-probe: no wireless interface found, see --help\n");
+    return(EXIT_FAILURE);
+  }
+  if (interval <= 0.0 || count < 0) {
+    g_printerr("wavelan-probe: invalid interval or count\n");
+    return(EXIT_FAILURE);
+  }
+
+  n = names->len;
+  probes = g_new0(t_probe, n);
+  devices = g_new0(struct wi_device *, n);
+  stats = g_new0(struct wi_stats, n);
+  results = g_new0(int, n);
+
+  for (i = 0; i < n; i++) {
+    probes[i].name = g_ptr_array_index(names, i);
+    if ((devices[i] = probes[i].device = wi_open(probes[i].name)) == NULL) {
+      g_printerr("wavelan-probe: unable to open %s\n", probes[i].name);
+      return(EXIT_FAILURE);
+    }
+  }
+
+  if (watch)
+    monitor = wi_monitor_open();
+
+  if (ping_address != NULL && (ping = wi_ping_open(ping_address)) == NULL) {
+    g_printerr("wavelan-probe: unable to probe %s, it must be an IP address\n", ping_address);
+    return(EXIT_FAILURE);
+  }
+
+  out = g_string_sized_new(256);
+
+  for (sample = 0; watch || count == 0 || sample < count; sample++) {
+    if (sample > 0) {
+      probe_wait(monitor, ping, devices, n);
+      if (ping != NULL)
+        probe_print_ping(out, ping);
+    }
+
+    /* only the latency is printed without a wireless interface */
+    if (n > 0) {
+      wi_query_many(devices, stats, results, n);
+
+      for (i = 0; i < n; i++) {
+        if (watch && !probe_changed(&probes[i], &stats[i], results[i]))
+          continue;
+        probes[i].stats = stats[i];
+        probes[i].result = results[i];
+        probes[i].printed = TRUE;
+        probe_print(out, &probes[i]);
+      }
+    }
+    fflush(stdout);
+
+    if (ping != NULL)
+      wi_ping_send(ping);
+  }
+
+  /* the last probe gets an interval to come back */
+  if (ping != NULL) {
+    probe_wait(NULL, ping, devices, n);
+    probe_print_ping(out, ping);
+    wi_ping_close(ping);
+  }
+
+  if (monitor != NULL)
+    wi_monitor_close(monitor);
+  for (i = 0; i < n; i++)
+    wi_close(devices[i]);
+
+  g_string_free(out, TRUE);
+  g_ptr_array_free(names, TRUE);
+  g_free(probes);
+  g_free(devices);
+  g_free(stats);
+  g_free(results);
+  g_free(ping_address);
+
+  return(EXIT_SUCCESS);
+}
@@ -29,80 +29,230 @@
 
 #include <gdk/gdk.h>
 #include <gtk/gtk.h>
+#include <glib-unix.h>
+#include <gmodule.h>
 
 #include <libxfce4util/libxfce4util.h>
 #include <libxfce4ui/libxfce4ui.h>
 #include <libxfce4panel/libxfce4panel.h>
 
 #include "wi.h"
+#include "sampler.h"
+#include "service.h"
 
 #include <string.h>
 #include <ctype.h>
-#include <sys/types.h>
-#include <sys/socket.h>
-#if defined(AF_LINK) /* BSD */
-#if defined(__OpenBSD__) || defined(__NetBSD__)
-#include <sys/ioctl.h>
-#include <net/if_media.h>
-#endif
-#include <net/if.h>
-#include <net/if_types.h>
-#endif
-#include <ifaddrs.h>
+#include <math.h>
 
 #define BORDER 8
+
+/* separates interfaces when several radios are monitored */
+#define INTERFACE_SEPARATOR ","
+
+/* samples kept for the history graph, one column each */
+#define HISTORY_LENGTH 256
+
+/* longest sampling interval while the throughput is shown, in ms */
+#define THROUGHPUT_MAX_INTERVAL 2000
+
+/* seconds between two latency tables logged as debug messages */
+#define TIMINGS_LOG_INTERVAL 60
+
+/* thickness of the bars of the indicator and gap between its parts, in px */
+#define INDICATOR_BAR_WIDTH 4
+#define INDICATOR_SPACING 1
+
+enum icon_values {
+    OFFLINE = 0,
+    EXCELLENT,
+    GOOD,
+    OK,
+    WEAK,
+    NONE,
+    INIT,
+    ICON_NUM
+};
+
+/* parts of the indicator, in their order along the panel */
+enum {
+    PART_ICON = 0,
+    PART_SIGNAL,
+    PART_LOAD,
+    PART_COUNT
+};
+
+/* stages of the handling of a sample, timed like the backend calls */
+enum {
+    STAGE_SAMPLE = 0,
+    STAGE_PING,
+    STAGE_RENDER,
+    STAGE_GRAPH,
+    STAGE_TOOLTIP,
+    STAGE_COUNT
+};
+
+static const gchar *stage_names[STAGE_COUNT] = {
+    "sample", "ping", "render", "graph", "tooltip"
+};
+
 typedef struct
 {
   gchar *interface;
-  struct wi_device *device;
-  guint timer_id;
+  struct sampler_device *device;
 
   gint state; /* can be -1 for disconnected devices */
+  int signal_strength;
+
+  /* last sample and what was rendered from it */
+  guint dirty;
+  int result;
+  struct wi_stats stats;
+  gboolean sampled; /* result and stats hold a sample */
+  gint band; /* signal color, -1 without colors */
+
+  /* traffic in bit/s, -1 if unknown, and its share of the link rate */
+  gdouble rx_throughput;
+  gdouble tx_throughput;
+  gdouble load;
+
+  GtkWidget *box;
+  GtkWidget *indicator; /* icon, signal and throughput bars */
+
+  /* latency probe, sent after each sample while associated */
+  struct wi_ping *ping;
+  guint ping_watch;
+  gchar *ping_interface; /* link whose gateway is probed */
+  struct wi_ping_stats ping_stats;
+
+  /* history graph: a ring of states and two surfaces, each new sample
+   * copies the front one shifted by a column into the back one */
+  GtkWidget *graph;
+  gint8 history[HISTORY_LENGTH];
+  guint history_head; /* slot of the next sample */
+  guint history_count;
+  cairo_surface_t *graph_surfaces[2];
+  guint graph_front;
+  gint graph_width, graph_height;
+  gboolean keep_history; /* asked the sampler for a history */
+} t_radio;
+
+typedef struct
+{
+  gchar *interface; /* as configured, possibly a list */
+
+  /* one entry per monitored interface, sampled by the shared clock */
+  t_radio *radios;
+  guint n_radios;
 
   gboolean autohide;
   gboolean autohide_missing;
   gboolean signal_colors;
   gboolean show_icon;
   gboolean show_bar;
+  gboolean show_graph;
+  gboolean show_throughput;
+  gboolean keep_history; /* samples written to disk, see sampler_device_keep_history() */
+  gboolean ping;
+  gchar *ping_host; /* numeric address, the gateway if empty */
   gchar *command;
 
-  int signal_strength;
+  /* bounds of the adaptive sampling interval, in ms */
+  guint min_interval;
+  guint max_interval;
+
   GtkOrientation orientation;
+  int image_size;
+
+  /* shared by the indicators, dropped when the size or theme changes */
+  cairo_surface_t *icon_surfaces[INIT];
+  gint icon_scale; /* 0 until the icons are rendered */
+  GdkRGBA fg_color;
+  GdkRGBA bar_color;
 
   GtkWidget *box;
   GtkWidget *ebox;
-  GtkWidget *image;
-  GtkWidget *signal;
-  GtkWidget *tooltip_text;
-  GtkCssProvider *css_provider;
+  GtkWidget *tooltip_grid;
+  gboolean tip_stale; /* rebuilt from the samples when next shown */
+  gint visible; /* -1 until first shown or hidden */
 
   XfcePanelPlugin *plugin;
   GtkWidget *settings_dialog;
+
+  /* latency of each stage, over all radios */
+  struct wi_timing timings[STAGE_COUNT];
+  gint64 timings_logged; /* monotonic time of the last debug table */
 } t_wavelan;
 
-enum icon_values {
-    OFFLINE = 0,
-    EXCELLENT,
-    GOOD,
-    OK,
-    WEAK,
-    NONE,
-    INIT,
-    ICON_NUM
+/* parts of a radio to redraw */
+enum {
+    DIRTY_BAR   = 1 << 0,
+    DIRTY_STYLE = 1 << 1, /* color of the signal */
+    DIRTY_ICON  = 1 << 2,
+    DIRTY_TIP   = 1 << 3,
+    DIRTY_LOAD  = 1 << 4,
+    DIRTY_ALL   = DIRTY_BAR | DIRTY_STYLE | DIRTY_ICON | DIRTY_TIP | DIRTY_LOAD
 };
 
 char* strength_to_icon[ICON_NUM];
 
+/* translated once, looked up whenever the tooltip is built */
+static struct {
+    const gchar *no_device;
+    const gchar *no_carrier;
+    /* names of the rows of the tooltip */
+    const gchar *network_row;
+    const gchar *quality_row;
+    const gchar *signal_row;
+    const gchar *tx_row;
+    const gchar *rx_row;
+    const gchar *channel_row;
+    const gchar *bssid_row;
+    const gchar *retries_row;
+    const gchar *connected_row;
+    const gchar *traffic_row;
+    const gchar *latency_row;
+    /* and their values */
+    const gchar *quality;
+    const gchar *signal;
+    const gchar *signal_avg;
+    const gchar *noise;
+    const gchar *rate;
+    const gchar *mcs;
+    const gchar *streams;
+    const gchar *width;
+    const gchar *channel;
+    const gchar *failed;
+    const gchar *beacon_loss;
+    const gchar *connected;
+    const gchar *inactive;
+    const gchar *traffic;
+    const gchar *latency;
+    const gchar *jitter;
+    const gchar *loss;
+    const gchar *unreachable;
+} formats;
+
 static void wavelan_set_size(XfcePanelPlugin* plugin, int size, t_wavelan *wavelan);
 static void wavelan_set_orientation(XfcePanelPlugin* plugin, GtkOrientation orientation, t_wavelan *wavelan);
 static void wavelan_refresh_icons(t_wavelan *wavelan);
-static void wavelan_update_icon(t_wavelan *wavelan);
-static void wavelan_update_signal(t_wavelan *wavelan);
+static void wavelan_update_icon(t_wavelan *wavelan, t_radio *radio);
+static void wavelan_update_signal(t_wavelan *wavelan, t_radio *radio);
+
+static void
+wavelan_free_icons(t_wavelan *wavelan)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(wavelan->icon_surfaces); i++)
+    g_clear_pointer(&wavelan->icon_surfaces[i], cairo_surface_destroy);
+  wavelan->icon_scale = 0;
+}
 
 static void
 wavelan_refresh_icons(t_wavelan *wavelan)
 {
   GtkIconTheme* theme = gtk_icon_theme_get_default();
+  guint i;
 
   if (gtk_icon_theme_has_icon(theme, "network-wireless-signal-excellent-symbolic"))
   {
@@ -124,248 +274,1276 @@ wavelan_refresh_icons(t_wavelan *wavelan)
   }
   strength_to_icon[INIT] = strength_to_icon[OFFLINE];
 
-  if (wavelan->signal_strength != INIT) /* only wavelan_new sets INIT */
-    gtk_image_set_from_icon_name(GTK_IMAGE(wavelan->image), strength_to_icon[wavelan->signal_strength], GTK_ICON_SIZE_BUTTON);
+  /* rendered again from the new theme on the next draw */
+  wavelan_free_icons(wavelan);
+  for (i = 0; i < wavelan->n_radios; i++)
+    gtk_widget_queue_draw(wavelan->radios[i].indicator);
 }
 
+/* render the icons at the current size and scale, symbolic ones
+ * recolored like the text of the panel */
 static void
-wavelan_update_icon(t_wavelan *wavelan)
+wavelan_load_icons(t_wavelan *wavelan, GtkWidget *widget)
 {
-  int signal_strength_prev = wavelan->signal_strength;
+  GtkIconTheme *theme = gtk_icon_theme_get_default();
+  GtkStyleContext *context = gtk_widget_get_style_context(widget);
+  gint scale = gtk_widget_get_scale_factor(widget);
+  GtkIconInfo *info;
+  GdkPixbuf *pixbuf;
+  guint i;
+
+  wavelan_free_icons(wavelan);
+  wavelan->icon_scale = scale;
+
+  for (i = 0; i < G_N_ELEMENTS(wavelan->icon_surfaces); i++) {
+    info = gtk_icon_theme_lookup_icon_for_scale(theme, strength_to_icon[i],
+        wavelan->image_size, scale, GTK_ICON_LOOKUP_FORCE_SIZE);
+    if (info == NULL)
+      continue;
+    pixbuf = gtk_icon_info_load_symbolic_for_context(info, context, NULL, NULL);
+    g_object_unref(info);
+    if (pixbuf == NULL)
+      continue;
+    wavelan->icon_surfaces[i] = gdk_cairo_surface_create_from_pixbuf(pixbuf, scale,
+        gtk_widget_get_window(widget));
+    g_object_unref(pixbuf);
+  }
 
-  if (!wavelan->show_icon) {
-    gtk_widget_hide(wavelan->image);
-    return;
+  /* a bar without signal colors looks like a progress bar of the theme */
+  gtk_style_context_get_color(context, gtk_style_context_get_state(context), &wavelan->fg_color);
+  if (!gtk_style_context_lookup_color(context, "theme_selected_bg_color", &wavelan->bar_color))
+    wavelan->bar_color = wavelan->fg_color;
+}
+
+/* where a part of the indicator is drawn, FALSE if it is not shown */
+static gboolean
+wavelan_indicator_area(t_wavelan *wavelan, t_radio *radio, gint part, GdkRectangle *rect)
+{
+  gboolean shown[PART_COUNT];
+  gboolean first = TRUE;
+  gint offset = 0, length = 0, i;
+
+  shown[PART_ICON] = wavelan->show_icon;
+  shown[PART_SIGNAL] = wavelan->show_bar;
+  shown[PART_LOAD] = wavelan->show_throughput;
+  if (!shown[part])
+    return(FALSE);
+
+  for (i = 0; i <= part; i++) {
+    if (!shown[i])
+      continue;
+    if (!first)
+      offset += length + INDICATOR_SPACING;
+    length = (i == PART_ICON) ? wavelan->image_size : INDICATOR_BAR_WIDTH;
+    first = FALSE;
   }
 
-  if (wavelan->state > 80)
-    wavelan->signal_strength = EXCELLENT;
-  else if (wavelan->state > 55)
-    wavelan->signal_strength = GOOD;
-  else if (wavelan->state > 30)
-    wavelan->signal_strength = OK;
-  else if (wavelan->state > 5)
-    wavelan->signal_strength = WEAK;
-  else if (wavelan->state >= 0)
-    wavelan->signal_strength = NONE;
+  if (wavelan->orientation == GTK_ORIENTATION_HORIZONTAL) {
+    rect->x = offset;
+    rect->y = 0;
+    rect->width = length;
+    rect->height = gtk_widget_get_allocated_height(radio->indicator);
+  } else {
+    rect->x = 0;
+    rect->y = offset;
+    rect->width = gtk_widget_get_allocated_width(radio->indicator);
+    rect->height = length;
+  }
+  return(TRUE);
+}
+
+/* as long as its parts along the panel, an icon thick across it */
+static void
+wavelan_indicator_set_size(t_wavelan *wavelan, t_radio *radio)
+{
+  GdkRectangle rect;
+  gint across = wavelan->show_icon ? wavelan->image_size : -1;
+  gint length = 0, part;
+
+  for (part = 0; part < PART_COUNT; part++) {
+    if (!wavelan_indicator_area(wavelan, radio, part, &rect))
+      continue;
+    if (wavelan->orientation == GTK_ORIENTATION_HORIZONTAL)
+      length = rect.x + rect.width;
+    else
+      length = rect.y + rect.height;
+  }
+
+  if (wavelan->orientation == GTK_ORIENTATION_HORIZONTAL)
+    gtk_widget_set_size_request(radio->indicator, length, across);
+  else
+    gtk_widget_set_size_request(radio->indicator, across, length);
+  gtk_widget_set_visible(radio->indicator, length > 0);
+}
+
+/* damage a single part, the draw handler repaints only that */
+static void
+wavelan_indicator_queue(t_wavelan *wavelan, t_radio *radio, gint part)
+{
+  GdkRectangle rect;
+
+  if (wavelan_indicator_area(wavelan, radio, part, &rect))
+    gtk_widget_queue_draw_area(radio->indicator, rect.x, rect.y, rect.width, rect.height);
+}
+
+static void
+wavelan_update_icon(t_wavelan *wavelan, t_radio *radio)
+{
+  int signal_strength_prev = radio->signal_strength;
+
+  if (radio->state > 80)
+    radio->signal_strength = EXCELLENT;
+  else if (radio->state > 55)
+    radio->signal_strength = GOOD;
+  else if (radio->state > 30)
+    radio->signal_strength = OK;
+  else if (radio->state > 5)
+    radio->signal_strength = WEAK;
+  else if (radio->state >= 0)
+    radio->signal_strength = NONE;
+  else
+    radio->signal_strength = OFFLINE; /* also for disconnected interfaces */
+
+  if (signal_strength_prev != radio->signal_strength)
+    wavelan_indicator_queue(wavelan, radio, PART_ICON);
+}
+
+/* color of the signal for a state, -1 without colors */
+static gint
+wavelan_signal_band(t_wavelan *wavelan, gint state)
+{
+  if (!wavelan->signal_colors)
+    return(-1);
+  else if (state > 80)
+    return(3);
+  else if (state > 55)
+    return(2);
+  else if (state > 30)
+    return(1);
+  else
+    return(0);
+}
+
+/* one per band returned by wavelan_signal_band() */
+static const gchar *signal_color_names[] = {
+  "#e00000",  /* bad */
+  "#e05200",  /* weak */
+  "#e6ff00",  /* good */
+  "#06c500",  /* strong */
+};
+
+static const GdkRGBA *
+wavelan_band_color(gint band)
+{
+  static GdkRGBA colors[G_N_ELEMENTS(signal_color_names)];
+  static gboolean colors_parsed = FALSE;
+  guint i;
+
+  if (!colors_parsed) {
+    for (i = 0; i < G_N_ELEMENTS(signal_color_names); i++)
+      gdk_rgba_parse(&colors[i], signal_color_names[i]);
+    colors_parsed = TRUE;
+  }
+  return(&colors[band]);
+}
+
+/* a bar across the panel, filled from the bottom or from the left */
+static void
+wavelan_indicator_bar(t_wavelan *wavelan, cairo_t *cr, const GdkRectangle *rect,
+                      gdouble fraction, const GdkRGBA *color)
+{
+  GdkRGBA trough = wavelan->fg_color;
+  gdouble length;
+
+  trough.alpha *= 0.2;
+  gdk_cairo_set_source_rgba(cr, &trough);
+  gdk_cairo_rectangle(cr, rect);
+  cairo_fill(cr);
+
+  gdk_cairo_set_source_rgba(cr, color);
+  if (wavelan->orientation == GTK_ORIENTATION_HORIZONTAL) {
+    length = rect->height * fraction;
+    cairo_rectangle(cr, rect->x, rect->y + rect->height - length, rect->width, length);
+  } else {
+    length = rect->width * fraction;
+    cairo_rectangle(cr, rect->x, rect->y, length, rect->height);
+  }
+  cairo_fill(cr);
+}
+
+static gboolean
+wavelan_indicator_draw(GtkWidget *widget, cairo_t *cr, t_wavelan *wavelan)
+{
+  t_radio *radio = NULL;
+  cairo_surface_t *icon;
+  GdkRectangle rect;
+  guint i;
+
+  for (i = 0; i < wavelan->n_radios; i++) {
+    if (wavelan->radios[i].indicator == widget)
+      radio = &wavelan->radios[i];
+  }
+  if (radio == NULL)
+    return(FALSE);
+
+  if (wavelan->icon_scale != gtk_widget_get_scale_factor(widget))
+    wavelan_load_icons(wavelan, widget);
+
+  /* centered across the panel */
+  icon = wavelan->icon_surfaces[radio->signal_strength == INIT ? OFFLINE : radio->signal_strength];
+  if (icon != NULL && wavelan_indicator_area(wavelan, radio, PART_ICON, &rect)) {
+    cairo_set_source_surface(cr, icon,
+        rect.x + (rect.width - wavelan->image_size) / 2,
+        rect.y + (rect.height - wavelan->image_size) / 2);
+    gdk_cairo_rectangle(cr, &rect);
+    cairo_fill(cr);
+  }
+
+  if (wavelan_indicator_area(wavelan, radio, PART_SIGNAL, &rect))
+    wavelan_indicator_bar(wavelan, cr, &rect, (gdouble) CLAMP(radio->state, 0, 100) / 100,
+        radio->band >= 0 ? wavelan_band_color(radio->band) : &wavelan->bar_color);
+
+  if (wavelan_indicator_area(wavelan, radio, PART_LOAD, &rect))
+    wavelan_indicator_bar(wavelan, cr, &rect, radio->load, &wavelan->bar_color);
+
+  return(FALSE);
+}
+
+/* a new theme or state of the panel, the icons follow its colors */
+static void
+wavelan_indicator_style_updated(GtkWidget *widget, t_wavelan *wavelan)
+{
+  guint i;
+
+  wavelan_free_icons(wavelan);
+  for (i = 0; i < wavelan->n_radios; i++)
+    gtk_widget_queue_draw(wavelan->radios[i].indicator);
+}
+
+static void
+wavelan_update_signal(t_wavelan *wavelan, t_radio *radio)
+{
+  wavelan_indicator_queue(wavelan, radio, PART_SIGNAL);
+}
+
+/* share of the link rate actually used, in the busier direction */
+static gdouble
+wavelan_radio_load(t_radio *radio)
+{
+  const struct wi_link *link = &radio->stats.ws_link;
+  gdouble rx_phy, tx_phy, load = 0.0;
+
+  if (radio->rx_throughput < 0.0 || radio->result != WI_OK)
+    return(0.0);
+
+  /* the station rates are finer than ws_rate, which is the tx rate */
+  rx_phy = (link->wl_valid & WI_LINK_RX_RATE) ? link->wl_rx_rate.wr_bitrate * 1e5 : radio->stats.ws_rate * 1e6;
+  tx_phy = (link->wl_valid & WI_LINK_TX_RATE) ? link->wl_tx_rate.wr_bitrate * 1e5 : radio->stats.ws_rate * 1e6;
+
+  if (rx_phy > 0.0)
+    load = MAX(load, radio->rx_throughput / rx_phy);
+  if (tx_phy > 0.0)
+    load = MAX(load, radio->tx_throughput / tx_phy);
+
+  return(MIN(load, 1.0));
+}
+
+/* state shown for a sample: -1 without device, 0 without link */
+static gint
+wavelan_quality_state(int result, int quality, const char *qunit)
+{
+  if (result != WI_OK)
+    return((result == WI_NOCARRIER) ? 0 : -1);
+  /*
+   * Usual formula is: qual = 4 * (signal - noise)
+   * where noise is typically about -96dBm, but we don't have
+   * the actual noise value here, so approximate one.
+   */
+  else if (strcmp(qunit, "dBm") == 0)
+    return(4 * (quality - (-96)));
   else
-    wavelan->signal_strength = OFFLINE; /* also for disconnected interfaces */
+    return(quality);
+}
 
-  if (signal_strength_prev != wavelan->signal_strength)
-    gtk_image_set_from_icon_name(GTK_IMAGE(wavelan->image), strength_to_icon[wavelan->signal_strength], GTK_ICON_SIZE_BUTTON);
+static void
+wavelan_graph_free_surfaces(t_radio *radio)
+{
+  guint i;
 
-  gtk_widget_show(wavelan->image);
+  for (i = 0; i < G_N_ELEMENTS(radio->graph_surfaces); i++)
+    g_clear_pointer(&radio->graph_surfaces[i], cairo_surface_destroy);
+  radio->graph_width = radio->graph_height = 0;
 }
 
+/* draw the column of a sample: state < 0 (no device) leaves it empty,
+ * 0 (no link) marks it with a single pixel at the bottom */
 static void
-wavelan_update_signal(t_wavelan *wavelan)
-{  
+wavelan_graph_column(t_wavelan *wavelan, t_radio *radio, cairo_t *cr, gint x, gint state)
+{
+  GtkStyleContext *context;
   GdkRGBA color;
-  gchar signal_color_bad[] = "#e00000";
-  gchar signal_color_weak[] = "#e05200";
-  gchar signal_color_good[] = "#e6ff00";
-  gchar signal_color_strong[] = "#06c500";
-  gchar *css, *color_str;
-  gchar * cssminsizes = "min-width: 4px; min-height: 0px";
-  if(gtk_orientable_get_orientation(GTK_ORIENTABLE(wavelan->signal)) == GTK_ORIENTATION_HORIZONTAL)
-    cssminsizes = "min-width: 0px; min-height: 4px";
-
-  if (!wavelan->show_bar) {
-    gtk_widget_hide(wavelan->signal);
+  gdouble height;
+
+  cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+  cairo_rectangle(cr, x, 0, 1, radio->graph_height);
+  cairo_fill(cr);
+
+  if (state < 0)
     return;
+
+  if (wavelan->signal_colors)
+    color = *wavelan_band_color(wavelan_signal_band(wavelan, state));
+  else {
+    context = gtk_widget_get_style_context(radio->graph);
+    gtk_style_context_get_color(context, gtk_style_context_get_state(context), &color);
   }
 
-  if (wavelan->state >= 1)
-   gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(wavelan->signal), (gdouble) wavelan->state / 100);
-  else
-   gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(wavelan->signal), 0.0);
-
-  if (wavelan->signal_colors) {
-     /* set color */
-   if (wavelan->state > 80)
-    gdk_rgba_parse(&color, signal_color_strong);
-   else if (wavelan->state > 55)
-    gdk_rgba_parse(&color, signal_color_good);
-   else if (wavelan->state > 30)
-    gdk_rgba_parse(&color, signal_color_weak);
-   else
-    gdk_rgba_parse(&color, signal_color_bad);
-
-     color_str = gdk_rgba_to_string(&color);
-     css = g_strdup_printf("progressbar trough { %s } \
-                            progressbar progress { %s ; background-color: %s; background-image: none; }",
-                           cssminsizes, cssminsizes,
-                           color_str);
-     g_free(color_str);
-  } else {
-     /* only set size... */
-     css = g_strdup_printf("progressbar trough { %s } \
-                            progressbar progress { %s }",
-                           cssminsizes, cssminsizes);
+  height = MAX((gdouble) radio->graph_height * MIN(state, 100) / 100, 1.0);
+  cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+  gdk_cairo_set_source_rgba(cr, &color);
+  cairo_rectangle(cr, x, radio->graph_height - height, 1, height);
+  cairo_fill(cr);
+}
+
+/* (re)create the surfaces for the current size and draw every sample */
+static void
+wavelan_graph_redraw(t_wavelan *wavelan, t_radio *radio)
+{
+  GdkWindow *window = gtk_widget_get_window(radio->graph);
+  gint width, height, scale, x;
+  guint i, n;
+  cairo_t *cr;
+
+  wavelan_graph_free_surfaces(radio);
+  if (window == NULL)
+    return;
+
+  width = gtk_widget_get_allocated_width(radio->graph);
+  height = gtk_widget_get_allocated_height(radio->graph);
+  if (width <= 0 || height <= 0)
+    return;
+
+  scale = gtk_widget_get_scale_factor(radio->graph);
+  for (i = 0; i < G_N_ELEMENTS(radio->graph_surfaces); i++)
+    radio->graph_surfaces[i] = gdk_window_create_similar_image_surface(window,
+        CAIRO_FORMAT_ARGB32, width * scale, height * scale, scale);
+  radio->graph_front = 0;
+  radio->graph_width = width;
+  radio->graph_height = height;
+
+  /* the latest samples, right aligned */
+  cr = cairo_create(radio->graph_surfaces[0]);
+  n = MIN(radio->history_count, (guint) width);
+  for (x = 0; x < width; x++) {
+    gint state = -1;
+    guint age = width - 1 - x;
+
+    if (age < n)
+      state = radio->history[(radio->history_head + HISTORY_LENGTH - 1 - age) % HISTORY_LENGTH];
+    wavelan_graph_column(wavelan, radio, cr, x, state);
   }
+  cairo_destroy(cr);
+}
+
+/* record a sample and scroll the graph by one column */
+static void
+wavelan_graph_push(t_wavelan *wavelan, t_radio *radio)
+{
+  cairo_surface_t *front, *back;
+  cairo_t *cr;
 
-  gtk_css_provider_load_from_data (wavelan->css_provider, css, strlen(css), NULL);
-  g_free(css);
+  radio->history[radio->history_head] = CLAMP(radio->state, -1, 100);
+  radio->history_head = (radio->history_head + 1) % HISTORY_LENGTH;
+  radio->history_count = MIN(radio->history_count + 1, HISTORY_LENGTH);
 
-  gtk_widget_show(wavelan->signal);
+  if (!gtk_widget_get_visible(radio->graph))
+    return;
+
+  /* not drawn yet, the draw handler starts from the history */
+  if (radio->graph_surfaces[0] == NULL) {
+    gtk_widget_queue_draw(radio->graph);
+    return;
+  }
+
+  front = radio->graph_surfaces[radio->graph_front];
+  back = radio->graph_surfaces[!radio->graph_front];
+
+  cr = cairo_create(back);
+  cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source_surface(cr, front, -1, 0);
+  cairo_paint(cr);
+  wavelan_graph_column(wavelan, radio, cr, radio->graph_width - 1, radio->state);
+  cairo_destroy(cr);
+
+  radio->graph_front = !radio->graph_front;
+  gtk_widget_queue_draw(radio->graph);
 }
 
+/* start the graph from the samples kept on disk, an empty column
+ * marking the time the panel was not running */
 static void
-wavelan_set_state(t_wavelan *wavelan, gint state)
+wavelan_graph_load(t_wavelan *wavelan, t_radio *radio)
+{
+  const struct wi_history *history;
+  const struct wi_history_record *record = NULL;
+  unsigned long long first, end, n;
+  char qunit[4];
+
+  if (radio->device == NULL ||
+      (history = sampler_device_get_history(radio->device)) == NULL)
+    return;
+
+  end = wi_history_end(history);
+  first = MAX(wi_history_first(history), end - MIN(end, HISTORY_LENGTH - 1));
+  wi_history_get_qunit(history, qunit, sizeof(qunit));
+
+  for (n = first; n < end; n++) {
+    if ((record = wi_history_get(history, n)) == NULL)
+      continue;
+    radio->history[radio->history_head] =
+      CLAMP(wavelan_quality_state(record->wh_result, record->wh_quality, qunit), -1, 100);
+    radio->history_head = (radio->history_head + 1) % HISTORY_LENGTH;
+    radio->history_count = MIN(radio->history_count + 1, HISTORY_LENGTH);
+  }
+
+  if (record != NULL &&
+      g_get_real_time() / 1000 - record->wh_time > wavelan->max_interval) {
+    radio->history[radio->history_head] = -1;
+    radio->history_head = (radio->history_head + 1) % HISTORY_LENGTH;
+    radio->history_count = MIN(radio->history_count + 1, HISTORY_LENGTH);
+  }
+}
+
+static gboolean
+wavelan_graph_draw(GtkWidget *widget, cairo_t *cr, t_wavelan *wavelan)
 {
+  t_radio *radio = NULL;
+  guint i;
+
+  for (i = 0; i < wavelan->n_radios; i++) {
+    if (wavelan->radios[i].graph == widget)
+      radio = &wavelan->radios[i];
+  }
+  if (radio == NULL)
+    return(FALSE);
+
+  if (radio->graph_surfaces[0] == NULL ||
+      radio->graph_width != gtk_widget_get_allocated_width(widget) ||
+      radio->graph_height != gtk_widget_get_allocated_height(widget))
+    wavelan_graph_redraw(wavelan, radio);
+
+  if (radio->graph_surfaces[0] != NULL) {
+    cairo_set_source_surface(cr, radio->graph_surfaces[radio->graph_front], 0, 0);
+    cairo_paint(cr);
+  }
+
+  return(FALSE);
+}
+
+static void
+wavelan_update_visibility(t_wavelan *wavelan)
+{
+  gboolean visible = FALSE;
+  guint i;
+
+  /* hide if no network & autohide or if no card found, for all radios */
+  for (i = 0; i < wavelan->n_radios; i++) {
+    gint state = wavelan->radios[i].state;
+    if (!(wavelan->autohide && state == 0) && !(wavelan->autohide_missing && state == -1)) {
+      visible = TRUE;
+      break;
+    }
+  }
+
+  if (wavelan->visible == visible)
+    return;
+
+  wavelan->visible = visible;
+  if (visible)
+    gtk_widget_show(wavelan->ebox);
+  else
+    gtk_widget_hide(wavelan->ebox);
+}
+
+/* track a new state, marking what it changes on screen */
+static void
+wavelan_set_state(t_wavelan *wavelan, t_radio *radio, gint state)
+{
+  gint band;
+
   /* state = 0 -> no link, =-1 -> error */
   DBG ("Entered wavelan_set_state, state = %d", state);
 
   if(state > 100)
     state = 100;
 
-  wavelan->state = state;
+  if (radio->state != state)
+    radio->dirty |= DIRTY_BAR | DIRTY_ICON;
+  radio->state = state;
+
+  band = wavelan_signal_band(wavelan, radio->state);
+  if (radio->band != band)
+    radio->dirty |= DIRTY_STYLE;
+  radio->band = band;
+}
+
+/* redraw the parts of a radio that changed since last time */
+static void
+wavelan_render(t_wavelan *wavelan, t_radio *radio)
+{
+  WI_TRACE_DECLARE(begin);
 
   /* update signal to reflect state */
-  wavelan_update_signal(wavelan);
+  if (radio->dirty & (DIRTY_BAR | DIRTY_STYLE)) {
+    WI_TRACE_BEGIN(begin);
+    wavelan_update_signal(wavelan, radio);
+    WI_TRACE_END(begin, "update-signal");
+  }
 
   /* update icon to reflect state */
-  wavelan_update_icon(wavelan);
+  if (radio->dirty & DIRTY_ICON) {
+    WI_TRACE_BEGIN(begin);
+    wavelan_update_icon(wavelan, radio);
+    WI_TRACE_END(begin, "update-icon");
+  }
 
-  /* hide if no network & autohide or if no card found */
-  if (wavelan->autohide && state == 0)
-    gtk_widget_hide(wavelan->ebox);
-  else if (wavelan->autohide_missing && state == -1)
-    gtk_widget_hide(wavelan->ebox);
-  else
-    gtk_widget_show(wavelan->ebox);
+  if (radio->dirty & DIRTY_LOAD)
+    wavelan_indicator_queue(wavelan, radio, PART_LOAD);
+
+  radio->dirty &= DIRTY_TIP;
+}
+
+/* re-apply the current state, e.g. after a setting changed */
+static void
+wavelan_update_state(t_wavelan *wavelan)
+{
+  guint i;
+
+  for (i = 0; i < wavelan->n_radios; i++) {
+    t_radio *radio = &wavelan->radios[i];
+
+    radio->dirty |= DIRTY_BAR | DIRTY_STYLE | DIRTY_ICON | DIRTY_LOAD;
+    wavelan_set_state(wavelan, radio, radio->state);
+    wavelan_render(wavelan, radio);
+
+    /* the parts shown may have changed too */
+    wavelan_indicator_set_size(wavelan, radio);
+    gtk_widget_queue_draw(radio->indicator);
+
+    /* colors or size may have changed, start over from the history */
+    wavelan_graph_free_surfaces(radio);
+    gtk_widget_set_visible(radio->graph, wavelan->show_graph);
+    gtk_widget_queue_draw(radio->graph);
+  }
+
+  wavelan->visible = -1;
+  wavelan_update_visibility(wavelan);
 }
 
 static gboolean
-wavelan_timer(gpointer data)
+wavelan_rate_equal(const struct wi_rate *a, const struct wi_rate *b)
+{
+  return(a->wr_bitrate == b->wr_bitrate && a->wr_mcs == b->wr_mcs &&
+         a->wr_nss == b->wr_nss && a->wr_width == b->wr_width &&
+         strcmp(a->wr_mode, b->wr_mode) == 0);
+}
+
+/* only what the tooltip shows, at the precision it shows it */
+static gboolean
+wavelan_link_equal(const struct wi_link *a, const struct wi_link *b)
+{
+  return(a->wl_valid == b->wl_valid &&
+         a->wl_signal == b->wl_signal && a->wl_signal_avg == b->wl_signal_avg &&
+         a->wl_noise == b->wl_noise &&
+         wavelan_rate_equal(&a->wl_tx_rate, &b->wl_tx_rate) &&
+         wavelan_rate_equal(&a->wl_rx_rate, &b->wl_rx_rate) &&
+         a->wl_frequency == b->wl_frequency &&
+         memcmp(a->wl_bssid, b->wl_bssid, sizeof(a->wl_bssid)) == 0 &&
+         a->wl_tx_retries == b->wl_tx_retries && a->wl_tx_failed == b->wl_tx_failed &&
+         a->wl_beacon_loss == b->wl_beacon_loss &&
+         a->wl_connected_time / 60 == b->wl_connected_time / 60 &&
+         a->wl_inactive_time / 1000 == b->wl_inactive_time / 1000);
+}
+
+static gboolean
+wavelan_stats_equal(const struct wi_stats *a, const struct wi_stats *b)
+{
+  return(a->ws_quality == b->ws_quality && a->ws_rate == b->ws_rate &&
+         strcmp(a->ws_qunit, b->ws_qunit) == 0 &&
+         strcmp(a->ws_netname, b->ws_netname) == 0 &&
+         wavelan_link_equal(&a->ws_link, &b->ws_link));
+}
+
+/* a row of the tooltip, the value alone across the grid without a name */
+static void
+wavelan_tip_row(GtkGrid *grid, gint *row, const gchar *name, const gchar *value)
+{
+  GtkWidget *label;
+
+  if (name != NULL) {
+    label = gtk_label_new(name);
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_style_context_add_class(gtk_widget_get_style_context(label), "dim-label");
+    gtk_grid_attach(grid, label, 0, *row, 1, 1);
+  }
+
+  label = gtk_label_new(value);
+  gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+  gtk_grid_attach(grid, label, name != NULL ? 1 : 0, *row, name != NULL ? 1 : 2, 1);
+  (*row)++;
+}
+
+static void
+wavelan_rate_tip(GtkGrid *grid, gint *row, const gchar *name, const struct wi_rate *rate, GString *value)
+{
+  g_string_printf(value, formats.rate, rate->wr_bitrate / 10, rate->wr_bitrate % 10);
+  if (rate->wr_mcs >= 0)
+    g_string_append_printf(value, formats.mcs, rate->wr_mode, rate->wr_mcs);
+  if (rate->wr_nss > 0)
+    g_string_append_printf(value, formats.streams, rate->wr_nss);
+  if (rate->wr_width > 0)
+    g_string_append_printf(value, formats.width, rate->wr_width);
+  wavelan_tip_row(grid, row, name, value->str);
+}
+
+/* one row per group of link details the backend reported */
+static void
+wavelan_link_tip(GtkGrid *grid, gint *row, const struct wi_link *link, GString *value)
+{
+  const guchar *b = link->wl_bssid;
+
+  if (link->wl_valid & (WI_LINK_SIGNAL | WI_LINK_SIGNAL_AVG | WI_LINK_NOISE)) {
+    g_string_truncate(value, 0);
+    if (link->wl_valid & WI_LINK_SIGNAL)
+      g_string_append_printf(value, formats.signal, link->wl_signal);
+    if (link->wl_valid & WI_LINK_SIGNAL_AVG)
+      g_string_append_printf(value, formats.signal_avg, link->wl_signal_avg);
+    if (link->wl_valid & WI_LINK_NOISE)
+      g_string_append_printf(value, formats.noise, link->wl_noise);
+    wavelan_tip_row(grid, row, formats.signal_row, value->str);
+  }
+
+  if (link->wl_valid & WI_LINK_TX_RATE)
+    wavelan_rate_tip(grid, row, formats.tx_row, &link->wl_tx_rate, value);
+  if (link->wl_valid & WI_LINK_RX_RATE)
+    wavelan_rate_tip(grid, row, formats.rx_row, &link->wl_rx_rate, value);
+
+  if (link->wl_valid & WI_LINK_FREQUENCY) {
+    g_string_printf(value, formats.channel, link->wl_channel, link->wl_frequency);
+    wavelan_tip_row(grid, row, formats.channel_row, value->str);
+  }
+  if (link->wl_valid & WI_LINK_BSSID) {
+    g_string_printf(value, "%02x:%02x:%02x:%02x:%02x:%02x", b[0], b[1], b[2], b[3], b[4], b[5]);
+    wavelan_tip_row(grid, row, formats.bssid_row, value->str);
+  }
+
+  if (link->wl_valid & (WI_LINK_TX_RETRIES | WI_LINK_TX_FAILED | WI_LINK_BEACON_LOSS)) {
+    g_string_printf(value, "%u", link->wl_tx_retries);
+    if (link->wl_valid & WI_LINK_TX_FAILED)
+      g_string_append_printf(value, formats.failed, link->wl_tx_failed);
+    if (link->wl_valid & WI_LINK_BEACON_LOSS)
+      g_string_append_printf(value, formats.beacon_loss, link->wl_beacon_loss);
+    wavelan_tip_row(grid, row, formats.retries_row, value->str);
+  }
+
+  if (link->wl_valid & WI_LINK_CONNECTED_TIME) {
+    g_string_printf(value, formats.connected, link->wl_connected_time / 3600,
+                    link->wl_connected_time / 60 % 60);
+    /* only worth a mention once the link stalls */
+    if ((link->wl_valid & WI_LINK_INACTIVE_TIME) && link->wl_inactive_time >= 1000)
+      g_string_append_printf(value, formats.inactive, link->wl_inactive_time / 1000);
+    wavelan_tip_row(grid, row, formats.connected_row, value->str);
+  }
+}
+
+static gint
+wavelan_ping_loss(const struct wi_ping_stats *stats)
+{
+  return(stats->wp_sent > 0 ? 100 * (stats->wp_sent - stats->wp_received) / stats->wp_sent : 0);
+}
+
+/* round trips to the gateway over the probe window */
+static void
+wavelan_ping_tip(GtkGrid *grid, gint *row, const struct wi_ping_stats *ping, const gchar *address, GString *value)
+{
+  if (ping->wp_received > 0) {
+    g_string_printf(value, formats.latency, ping->wp_avg / 1000.0, address);
+    if (ping->wp_jitter >= 0)
+      g_string_append_printf(value, formats.jitter, ping->wp_jitter / 1000.0);
+    g_string_append_printf(value, formats.loss, wavelan_ping_loss(ping));
+  } else
+    g_string_printf(value, formats.unreachable, address);
+  wavelan_tip_row(grid, row, formats.latency_row, value->str);
+}
+
+static void
+wavelan_radio_tip(GtkGrid *grid, gint *row, t_radio *radio, GString *value)
+{
+  const struct wi_stats *stats = &radio->stats;
+
+  if (radio->device == NULL) {
+    wavelan_tip_row(grid, row, NULL, formats.no_device);
+    return;
+  } else if (radio->result == WI_NOCARRIER) {
+    wavelan_tip_row(grid, row, NULL, formats.no_carrier);
+    return;
+  } else if (radio->result != WI_OK) {
+    wavelan_tip_row(grid, row, NULL, _(wi_strerror(radio->result)));
+    return;
+  }
+
+  if (strlen(stats->ws_netname) > 0)
+    wavelan_tip_row(grid, row, formats.network_row, stats->ws_netname);
+  g_string_printf(value, formats.quality, stats->ws_quality, stats->ws_qunit, stats->ws_rate);
+  wavelan_tip_row(grid, row, formats.quality_row, value->str);
+  wavelan_link_tip(grid, row, &stats->ws_link, value);
+
+  /* what goes through the link, next to what it was negotiated for */
+  if (radio->rx_throughput >= 0.0) {
+    g_string_printf(value, formats.traffic, radio->rx_throughput / 1e6,
+                    radio->tx_throughput / 1e6);
+    wavelan_tip_row(grid, row, formats.traffic_row, value->str);
+  }
+
+  if (radio->ping != NULL && radio->ping_stats.wp_sent > 0)
+    wavelan_ping_tip(grid, row, &radio->ping_stats, wi_ping_get_address(radio->ping), value);
+}
+
+/* the details of each radio from its last sample, under its name when
+ * there are several */
+static void
+wavelan_build_tip(t_wavelan *wavelan)
+{
+  GtkGrid *grid = GTK_GRID(wavelan->tooltip_grid);
+  unsigned long long begin = wi_timing_begin();
+  GString *value = g_string_new(NULL);
+  GList *children, *child;
+  GtkWidget *title;
+  gchar *markup;
+  gint row = 0;
+  guint i;
+
+  children = gtk_container_get_children(GTK_CONTAINER(grid));
+  for (child = children; child != NULL; child = child->next)
+    gtk_widget_destroy(child->data);
+  g_list_free(children);
+
+  for (i = 0; i < wavelan->n_radios; i++) {
+    t_radio *radio = &wavelan->radios[i];
+    const gchar *name = radio->interface;
+
+    /* "auto" names the radio it currently follows */
+    if (radio->device != NULL)
+      name = sampler_device_get_interface(radio->device);
+
+    if (wavelan->n_radios > 1 || g_strcmp0(name, radio->interface) != 0) {
+      markup = g_markup_printf_escaped("<b>%s</b>", name);
+      title = gtk_label_new(NULL);
+      gtk_label_set_markup(GTK_LABEL(title), markup);
+      gtk_label_set_xalign(GTK_LABEL(title), 0.0);
+      if (row > 0)
+        gtk_widget_set_margin_top(title, 6);
+      gtk_grid_attach(grid, title, 0, row++, 2, 1);
+      g_free(markup);
+    }
+    wavelan_radio_tip(grid, &row, radio, value);
+  }
+
+  gtk_widget_show_all(wavelan->tooltip_grid);
+  g_string_free(value, TRUE);
+  wavelan->tip_stale = FALSE;
+  wi_timing_end(&wavelan->timings[STAGE_TOOLTIP], begin, FALSE);
+}
+
+/* nothing is formatted until the tooltip is shown, unless it already is */
+static void
+wavelan_update_tip(t_wavelan *wavelan)
+{
+  wavelan->tip_stale = TRUE;
+  if (gtk_widget_get_mapped(wavelan->tooltip_grid))
+    wavelan_build_tip(wavelan);
+}
+
+static void
+wavelan_radio_retip(t_radio *radio)
+{
+  radio->dirty |= DIRTY_TIP;
+}
+
+/* take the probe's latest statistics, returns TRUE if the tip changed */
+static gboolean
+wavelan_ping_update(t_radio *radio)
+{
+  struct wi_ping_stats stats, *shown = &radio->ping_stats;
+  gboolean changed;
+
+  wi_ping_get_stats(radio->ping, &stats);
+
+  /* compared at the 0.1 ms shown */
+  changed = (stats.wp_sent > 0) != (shown->wp_sent > 0) ||
+            (stats.wp_received > 0) != (shown->wp_received > 0) ||
+            stats.wp_avg / 100 != shown->wp_avg / 100 ||
+            stats.wp_jitter / 100 != shown->wp_jitter / 100 ||
+            wavelan_ping_loss(&stats) != wavelan_ping_loss(shown);
+  *shown = stats;
+
+  if (changed)
+    wavelan_radio_retip(radio);
+  return(changed);
+}
+
+static void
+wavelan_ping_stop(t_radio *radio)
+{
+  if (radio->ping_watch != 0)
+    g_source_remove(radio->ping_watch);
+  radio->ping_watch = 0;
+  g_clear_pointer(&radio->ping, wi_ping_close);
+  g_clear_pointer(&radio->ping_interface, g_free);
+  memset(&radio->ping_stats, 0, sizeof(radio->ping_stats));
+}
+
+/* the configured host, else the gateway of the interface as the
+ * sampler last looked it up */
+static gchar *
+wavelan_ping_address(t_wavelan *wavelan, t_radio *radio, const gchar *interface)
+{
+  const char *address;
+
+  if (wavelan->ping_host != NULL && *wavelan->ping_host != '\0')
+    return(g_strdup(wavelan->ping_host));
+
+  if ((address = sampler_device_get_gateway(radio->device)) == NULL)
+    return(NULL);
+
+  /* a link-local gateway is only reachable through its interface */
+  if (g_str_has_prefix(address, "fe80:"))
+    return(g_strdup_printf("%s%%%s", address, interface));
+  return(g_strdup(address));
+}
+
+/* the answer came back, never waited for on the sampling path */
+static gboolean
+wavelan_ping_cb(gint fd, GIOCondition condition, gpointer data)
 {
-  struct wi_stats stats;
-  char *tip = NULL;
   t_wavelan *wavelan = (t_wavelan *)data;
+  guint i;
 
-  TRACE ("Entered wavelan_timer");
-  
-  if (wavelan->device != NULL) {
-    int result;
-
-    if ((result = wi_query(wavelan->device, &stats)) != WI_OK) {
-      TRACE ("result = %d", result);
-      /* reset quality indicator */
-      if (result == WI_NOCARRIER) {
-        tip = g_strdup(_("No carrier signal"));
-        wavelan_set_state(wavelan, 0);
-      }
-      else {
-        /* set error */
-        tip = g_strdup(_(wi_strerror(result)));
-        wavelan_set_state(wavelan, -1);
-      }
+  for (i = 0; i < wavelan->n_radios; i++) {
+    t_radio *radio = &wavelan->radios[i];
+
+    if (radio->ping != NULL && wi_ping_get_fd(radio->ping) == fd &&
+        wi_ping_dispatch(radio->ping) && wavelan_ping_update(radio)) {
+      wavelan_update_tip(wavelan);
+      radio->dirty &= ~DIRTY_TIP;
     }
-    else {
-      /*
-       * Usual formula is: qual = 4 * (signal - noise)
-       * where noise is typically about -96dBm, but we don't have
-       * the actual noise value here, so approximate one.
-       */
-      if (strcmp(stats.ws_qunit, "dBm") == 0)
-        wavelan_set_state(wavelan, 4 * (stats.ws_quality - (-96)));
-      else
-        wavelan_set_state(wavelan, stats.ws_quality);
+  }
 
-      if (strlen(stats.ws_netname) > 0)
-        /* Translators: net_name: quality quality_unit at rate Mb/s*/
-        tip = g_strdup_printf(_("%s: %d%s at %dMb/s"), stats.ws_netname, stats.ws_quality, stats.ws_qunit, stats.ws_rate);
-      else
-        /* Translators: quality quality_unit at rate Mb/s*/
-        tip = g_strdup_printf(_("%d%s at %dMb/s"), stats.ws_quality, stats.ws_qunit, stats.ws_rate);
+  return(G_SOURCE_CONTINUE);
+}
+
+/* send the probe of a sample, to whichever host answers for the link */
+static void
+wavelan_radio_ping(t_wavelan *wavelan, t_radio *radio)
+{
+  const gchar *interface;
+  gchar *address;
+
+  if (!wavelan->ping || radio->device == NULL || radio->result != WI_OK) {
+    if (radio->ping != NULL) {
+      wavelan_ping_stop(radio);
+      wavelan_radio_retip(radio);
     }
+    return;
   }
-  else {
-    tip = g_strdup(_("No device configured"));
-    wavelan_set_state(wavelan, -1);
+
+  /* the gateway is looked up again when the link moved or a probe was
+   * lost, it may have changed; the sampler's worker does it and hands
+   * it over with the next sample */
+  interface = sampler_device_get_interface(radio->device);
+  if (radio->ping == NULL || g_strcmp0(interface, radio->ping_interface) != 0 ||
+      (radio->ping_stats.wp_sent > 0 && radio->ping_stats.wp_last < 0)) {
+    if (wavelan->ping_host == NULL || *wavelan->ping_host == '\0')
+      sampler_device_lookup_gateway(radio->device);
+    address = wavelan_ping_address(wavelan, radio, interface);
+    if (radio->ping == NULL || g_strcmp0(address, wi_ping_get_address(radio->ping)) != 0) {
+      if (radio->ping != NULL)
+        wavelan_radio_retip(radio);
+      wavelan_ping_stop(radio);
+      if (address != NULL && (radio->ping = wi_ping_open(address)) != NULL) {
+        radio->ping_watch = g_unix_fd_add(wi_ping_get_fd(radio->ping), G_IO_IN | G_IO_ERR,
+                                          wavelan_ping_cb, wavelan);
+        DBG ("Probing latency to %s for %s", address, interface);
+      }
+    }
+    g_free(radio->ping_interface);
+    radio->ping_interface = g_strdup(interface);
+    g_free(address);
   }
 
-  /* set new tooltip */
-  if (tip != NULL) {
-    gtk_label_set_text(GTK_LABEL(wavelan->tooltip_text), tip);
-    g_free(tip);
+  /* the previous probe may only now count as lost */
+  if (radio->ping != NULL) {
+    wi_ping_send(radio->ping);
+    wavelan_ping_update(radio);
   }
+}
 
-  /* keep the timeout running */
-  return(TRUE);
+/* the history file of a radio is only created once its device answered,
+ * not for every name typed in the settings nor for missing devices */
+static void
+wavelan_radio_keep_history(t_wavelan *wavelan, t_radio *radio)
+{
+  if (!wavelan->keep_history || radio->keep_history || radio->device == NULL)
+    return;
+
+  sampler_device_keep_history(radio->device, TRUE);
+  radio->keep_history = TRUE;
+
+  /* the samples on disk replace the few taken without a link */
+  radio->history_head = radio->history_count = 0;
+  wavelan_graph_load(wavelan, radio);
+  wavelan_graph_free_surfaces(radio);
+  gtk_widget_queue_draw(radio->graph);
 }
 
+/* pick up the latest sample of a radio, the tip is only marked stale
+ * when one of the values it shows changed */
 static void
-wavelan_reset(t_wavelan *wavelan)
+wavelan_radio_sample(t_wavelan *wavelan, t_radio *radio)
 {
-  TRACE ("Entered wavelan_reset");
-  
-  if (wavelan->timer_id != 0) {
-    g_source_remove(wavelan->timer_id);
-    wavelan->timer_id = 0;
+  const struct wi_stats *stats = NULL;
+  gdouble rx = -1.0, tx = -1.0, load;
+  gboolean traffic;
+  gint state;
+  int result = WI_INVAL;
+
+  if (radio->device != NULL) {
+    stats = sampler_device_get_stats(radio->device, &result);
+    sampler_device_get_throughput(radio->device, &rx, &tx);
   }
 
-  if (wavelan->device != NULL) {
-    wi_close(wavelan->device);
-    wavelan->device = NULL;
+  /* compared at the 0.1 Mb/s shown */
+  traffic = rint(rx / 1e5) != rint(radio->rx_throughput / 1e5) ||
+            rint(tx / 1e5) != rint(radio->tx_throughput / 1e5);
+  radio->rx_throughput = rx;
+  radio->tx_throughput = tx;
+
+  if (result == WI_OK)
+    wavelan_radio_keep_history(wavelan, radio);
+
+  if (radio->sampled && result == radio->result && !traffic &&
+      (stats == NULL || result != WI_OK || wavelan_stats_equal(stats, &radio->stats)))
+    return;
+
+  radio->sampled = TRUE;
+  radio->result = result;
+  if (stats != NULL)
+    radio->stats = *stats;
+  wavelan_radio_retip(radio);
+
+  load = wavelan_radio_load(radio);
+  if (radio->load != load) {
+    radio->load = load;
+    radio->dirty |= DIRTY_LOAD;
   }
-  TRACE ("Using interface %s", wavelan->interface);
-  if (wavelan->interface != NULL) {
-    /* open the WaveLAN device */
-    if ((wavelan->device = wi_open(wavelan->interface)) != NULL) {
-      /* register the update timer */
-      TRACE ("Opened device");
-      wavelan->timer_id = g_timeout_add_seconds(1, wavelan_timer, wavelan);
+
+  if (stats == NULL)
+    state = -1;
+  else
+    state = wavelan_quality_state(result, stats->ws_quality, stats->ws_qunit);
+
+  wavelan_set_state(wavelan, radio, state);
+}
+
+static void
+wavelan_timing_row(GString *out, const gchar *name, const struct wi_timing *timing)
+{
+  g_string_append_printf(out, "  %-13s %8u %6u %9.1f %9.1f %9.1f %9.1f\n",
+                         name, timing->wt_calls, timing->wt_errors,
+                         timing->wt_total / 1e3 / MAX(timing->wt_calls, 1),
+                         wi_timing_percentile(timing, 0.5) / 1e3,
+                         wi_timing_percentile(timing, 0.99) / 1e3,
+                         timing->wt_max / 1e3);
+}
+
+/* g_log_writer_default_would_drop() is not available before GLib 2.68 */
+static gboolean
+wavelan_debug_enabled(void)
+{
+#if GLIB_CHECK_VERSION(2, 68, 0)
+  return(!g_log_writer_default_would_drop(G_LOG_LEVEL_DEBUG, G_LOG_DOMAIN));
+#else
+  const gchar *domains = g_getenv("G_MESSAGES_DEBUG");
+
+  return(domains != NULL &&
+         (strcmp(domains, "all") == 0 || strstr(domains, G_LOG_DOMAIN) != NULL));
+#endif
+}
+
+/* a table of the calls made for each radio, then of the stages of
+ * this instance; percentiles are the upper bounds of their buckets */
+static void
+wavelan_timings_dump(t_wavelan *wavelan, GString *out)
+{
+  struct wi_timing timings[WI_CALL_COUNT];
+  guint i, j;
+
+  g_string_append_printf(out, "  %-13s %8s %6s %9s %9s %9s %9s\n",
+                         "", "calls", "errors", "mean us", "p50 us", "p99 us", "max us");
+
+  for (i = 0; i < wavelan->n_radios; i++) {
+    t_radio *radio = &wavelan->radios[i];
+
+    if (radio->device == NULL || !sampler_device_get_timings(radio->device, timings))
+      continue;
+
+    g_string_append_printf(out, "%s\n", radio->interface);
+    for (j = 0; j < WI_CALL_COUNT; j++) {
+      if (timings[j].wt_calls > 0)
+        wavelan_timing_row(out, wi_call_name(j), &timings[j]);
     }
   }
+
+  g_string_append(out, "panel\n");
+  for (j = 0; j < STAGE_COUNT; j++)
+    wavelan_timing_row(out, stage_names[j], &wavelan->timings[j]);
 }
 
-/* query installed devices */
-static GList*
-wavelan_query_interfaces (void)
+/* called by the sampler after every sample */
+static void
+wavelan_sampled(void *data)
 {
-  GList *interfaces = NULL;
-  struct ifaddrs *ifaddr, *ifa;
-#if defined(__OpenBSD__) || defined(__NetBSD__)
-  int sock;
-#endif
+  t_wavelan *wavelan = (t_wavelan *)data;
+  struct wi_timing *timings = wavelan->timings;
+  gboolean tip_dirty = FALSE;
+  unsigned long long begin;
+  gint64 now;
+  guint i;
+
+  TRACE ("Entered wavelan_sampled");
+
+  for (i = 0; i < wavelan->n_radios; i++) {
+    t_radio *radio = &wavelan->radios[i];
+
+    begin = wi_timing_begin();
+    wavelan_radio_sample(wavelan, radio);
+    wi_timing_end(&timings[STAGE_SAMPLE], begin, FALSE);
+
+    begin = wi_timing_begin();
+    wavelan_radio_ping(wavelan, radio);
+    wi_timing_end(&timings[STAGE_PING], begin, FALSE);
+
+    begin = wi_timing_begin();
+    wavelan_render(wavelan, radio);
+    wi_timing_end(&timings[STAGE_RENDER], begin, FALSE);
 
-  TRACE ("Entered wavelan_query_interface");
+    begin = wi_timing_begin();
+    wavelan_graph_push(wavelan, radio);
+    wi_timing_end(&timings[STAGE_GRAPH], begin, FALSE);
 
-  if (getifaddrs(&ifaddr) == -1) {
-    return NULL;
+    if (radio->dirty & DIRTY_TIP)
+      tip_dirty = TRUE;
+    radio->dirty = 0;
   }
-#if defined(__OpenBSD__) || defined(__NetBSD__)
-  if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
-    return NULL;
-#endif
-  for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
-    if (ifa->ifa_addr == NULL)
-      continue;
-#if defined(AF_LINK) /* BSD */
-    if (ifa->ifa_addr->sa_family == AF_LINK &&
-        ((struct if_data *)ifa->ifa_data)->ifi_type == IFT_ETHER) {
-#if defined(__OpenBSD__) || defined(__NetBSD__)
-      struct ifmediareq ifmr;
-
-      bzero(&ifmr, sizeof(ifmr));
-      strlcpy(ifmr.ifm_name, ifa->ifa_name, sizeof(ifmr.ifm_name));
-      if (ioctl(sock, SIOCGIFMEDIA, &ifmr) < 0 || (ifmr.ifm_active & IFM_IEEE80211) == 0)
-        continue;
-#endif
-#elif defined(AF_PACKET) /* linux */
-    if (ifa->ifa_addr->sa_family == AF_PACKET) {
-#else
-#error "couldnt find a way to get address family on your system"
-#endif
-      interfaces = g_list_append (interfaces, g_strdup (ifa->ifa_name));
+  wavelan_update_visibility(wavelan);
+
+  /* a steady link leaves the tooltip alone */
+  if (tip_dirty)
+    wavelan_update_tip(wavelan);
+
+  /* shown with G_MESSAGES_DEBUG=xfce4-wavelan-plugin, and only
+   * formatted then */
+  now = g_get_monotonic_time();
+  if (now - wavelan->timings_logged >= TIMINGS_LOG_INTERVAL * G_USEC_PER_SEC) {
+    GString *out;
+
+    wavelan->timings_logged = now;
+    if (!wavelan_debug_enabled())
+      return;
+
+    out = g_string_new(NULL);
+    wavelan_timings_dump(wavelan, out);
+    g_debug("Latencies:\n%s", out->str);
+    g_string_free(out, TRUE);
+  }
+}
+
+static void
+wavelan_init_formats(void)
+{
+  if (formats.no_device != NULL)
+    return;
+
+  formats.no_device = _("No device configured");
+  formats.no_carrier = _("No carrier signal");
+
+  /* Translators: the rows below detail the link in the tooltip */
+  formats.network_row = _("Network");
+  formats.quality_row = _("Quality");
+  formats.signal_row = _("Signal");
+  formats.tx_row = _("Transmit");
+  formats.rx_row = _("Receive");
+  formats.channel_row = _("Channel");
+  formats.bssid_row = _("BSSID");
+  formats.retries_row = _("Retries");
+  formats.connected_row = _("Connected");
+  formats.traffic_row = _("Traffic");
+  formats.latency_row = _("Latency");
+
+  /* Translators: quality quality_unit at rate Mb/s*/
+  formats.quality = _("%d%s at %dMb/s");
+  formats.signal = _("%d dBm");
+  formats.signal_avg = _(", average %d dBm");
+  formats.noise = _(", noise %d dBm");
+  /* Translators: bitrate in Mb/s, with one decimal */
+  formats.rate = _("%d.%d Mb/s");
+  /* Translators: HT, VHT or HE, then the MCS index */
+  formats.mcs = _(", %s MCS %d");
+  formats.streams = _(", NSS %d");
+  formats.width = _(", %d MHz");
+  /* Translators: channel number, then its frequency */
+  formats.channel = _("%d (%d MHz)");
+  formats.failed = _(", failed: %u");
+  formats.beacon_loss = _(", beacons lost: %u");
+  /* Translators: hours:minutes */
+  formats.connected = _("for %u:%02u");
+  formats.inactive = _(", idle for %u s");
+  /* Translators: measured traffic in Mb/s, with one decimal */
+  formats.traffic = _("%.1f Mb/s down, %.1f Mb/s up");
+  /* Translators: average round trip in ms, then the host probed */
+  formats.latency = _("%.1f ms to %s");
+  formats.jitter = _(", jitter %.1f ms");
+  formats.loss = _(", %d%% lost");
+  formats.unreachable = _("No answer from %s");
+}
+
+/* a few icons long along the panel, as thick as the panel across it */
+static void
+wavelan_graph_set_size(t_wavelan *wavelan, t_radio *radio)
+{
+  gint length = MIN(3 * MAX(wavelan->image_size, 16), HISTORY_LENGTH);
+
+  if (wavelan->orientation == GTK_ORIENTATION_HORIZONTAL)
+    gtk_widget_set_size_request(radio->graph, length, -1);
+  else
+    gtk_widget_set_size_request(radio->graph, -1, length / 2);
+}
+
+static void
+wavelan_radio_init(t_wavelan *wavelan, t_radio *radio, const gchar *interface)
+{
+  radio->interface = g_strdup(interface);
+  radio->state = -2;
+  radio->result = WI_INVAL;
+  radio->band = -2;
+  radio->rx_throughput = radio->tx_throughput = -1.0;
+  radio->dirty = DIRTY_ALL;
+
+  /* create box for the indicator & graph */
+  radio->box = gtk_box_new(wavelan->orientation, 0);
+
+  /* icon and bars, painted together from the icons and colors cached
+   * in wavelan, a new value only damages its own part */
+  radio->signal_strength = INIT;
+  radio->indicator = gtk_drawing_area_new();
+  gtk_widget_set_no_show_all(radio->indicator, TRUE);
+  wavelan_indicator_set_size(wavelan, radio);
+  g_signal_connect(radio->indicator, "draw", G_CALLBACK(wavelan_indicator_draw), wavelan);
+  g_signal_connect(radio->indicator, "style-updated", G_CALLBACK(wavelan_indicator_style_updated), wavelan);
+
+  radio->graph = gtk_drawing_area_new();
+  gtk_widget_set_no_show_all(radio->graph, TRUE);
+  gtk_widget_set_visible(radio->graph, wavelan->show_graph);
+  wavelan_graph_set_size(wavelan, radio);
+  g_signal_connect(radio->graph, "draw", G_CALLBACK(wavelan_graph_draw), wavelan);
+
+  gtk_box_pack_start(GTK_BOX(radio->box), GTK_WIDGET(radio->indicator), FALSE, FALSE, 0);
+  gtk_box_pack_start(GTK_BOX(radio->box), GTK_WIDGET(radio->graph), FALSE, FALSE, 0);
+  gtk_widget_show_all(radio->box);
+  gtk_box_pack_start(GTK_BOX(wavelan->box), radio->box, FALSE, FALSE, 0);
+}
+
+static void
+wavelan_radio_free(t_radio *radio)
+{
+  wavelan_ping_stop(radio);
+  if (radio->device != NULL) {
+    if (radio->keep_history)
+      sampler_device_keep_history(radio->device, FALSE);
+    sampler_device_unref(radio->device);
+  }
+  gtk_widget_destroy(radio->box);
+  wavelan_graph_free_surfaces(radio);
+  g_free(radio->interface);
+}
+
+static void
+wavelan_close_radios(t_wavelan *wavelan)
+{
+  guint i;
+
+  for (i = 0; i < wavelan->n_radios; i++)
+    wavelan_radio_free(&wavelan->radios[i]);
+
+  g_free(wavelan->radios);
+  wavelan->radios = NULL;
+  wavelan->n_radios = 0;
+}
+
+/* a live meter needs samples close enough to be worth reading */
+static void
+wavelan_set_interval(t_wavelan *wavelan)
+{
+  guint max_interval = wavelan->max_interval;
+
+  if (wavelan->show_throughput)
+    max_interval = MIN(max_interval, MAX(THROUGHPUT_MAX_INTERVAL, wavelan->min_interval));
+
+  sampler_set_interval(wavelan_sampled, wavelan, wavelan->min_interval, max_interval);
+}
+
+static void
+wavelan_reset(t_wavelan *wavelan)
+{
+  gchar **names = NULL;
+  guint i, n = 0;
+
+  TRACE ("Entered wavelan_reset");
+
+  wavelan_close_radios(wavelan);
+
+  TRACE ("Using interface %s", wavelan->interface);
+  if (wavelan->interface != NULL) {
+    names = g_strsplit(wavelan->interface, INTERFACE_SEPARATOR, -1);
+    for (i = 0; names[i] != NULL; i++) {
+      g_strstrip(names[i]);
+      if (*names[i] != '\0')
+        names[n++] = names[i];
+      else
+        g_free(names[i]);
     }
+    names[n] = NULL;
   }
-#if defined(__OpenBSD__) || defined(__NetBSD__)
-  close(sock);
-#endif
-  freeifaddrs(ifaddr);
-  return interfaces;
+
+  /* there is always at least one indicator, even without a device */
+  wavelan->n_radios = MAX(n, 1);
+  wavelan->radios = g_new0(t_radio, wavelan->n_radios);
+
+  for (i = 0; i < wavelan->n_radios; i++) {
+    const gchar *name = (i < n) ? names[i] : NULL;
+
+    wavelan_radio_init(wavelan, &wavelan->radios[i], name);
+
+    /* devices are shared with other instances showing the same interface */
+    if (name != NULL)
+      wavelan->radios[i].device = sampler_device_ref(name);
+  }
+  g_strfreev(names);
+
+  wavelan_set_interval(wavelan);
+
+  /* sample right away instead of waiting for the next tick */
+  sampler_refresh();
 }
 
 static void
@@ -374,6 +1552,7 @@ wavelan_read_config(XfcePanelPlugin *plugin, t_wavelan *wavelan)
   char *file;
   XfceRc *rc;
   const char *s;
+  gint min_interval, max_interval;
   
   TRACE ("Entered wavelan_read_config");
   
@@ -395,28 +1574,42 @@ wavelan_read_config(XfcePanelPlugin *plugin, t_wavelan *wavelan)
       wavelan->signal_colors = xfce_rc_read_bool_entry(rc, "SignalColors", FALSE);
       wavelan->show_icon = xfce_rc_read_bool_entry(rc, "ShowIcon", FALSE);
       wavelan->show_bar = xfce_rc_read_bool_entry(rc, "ShowBar", FALSE);
+      wavelan->show_graph = xfce_rc_read_bool_entry(rc, "ShowGraph", FALSE);
+      wavelan->show_throughput = xfce_rc_read_bool_entry(rc, "ShowThroughput", FALSE);
+      wavelan->keep_history = xfce_rc_read_bool_entry(rc, "KeepHistory", FALSE);
+      wavelan->ping = xfce_rc_read_bool_entry(rc, "Ping", FALSE);
+      g_free(wavelan->ping_host);
+      wavelan->ping_host = g_strdup(xfce_rc_read_entry(rc, "PingHost", NULL));
       if ((s = xfce_rc_read_entry (rc, "Command", NULL)) != NULL)
       {
         if (wavelan->command)
           g_free (wavelan->command);
         wavelan->command = g_strdup (s);
       }
+      min_interval = xfce_rc_read_int_entry(rc, "MinInterval", SAMPLER_MIN_INTERVAL);
+      max_interval = xfce_rc_read_int_entry(rc, "MaxInterval", SAMPLER_MAX_INTERVAL);
+      /* hand edited values, keep them within what the sampler supports */
+      min_interval = CLAMP(min_interval, SAMPLER_INTERVAL_FLOOR, SAMPLER_MAX_INTERVAL);
+      max_interval = CLAMP(max_interval, SAMPLER_INTERVAL_FLOOR, SAMPLER_MAX_INTERVAL);
+      wavelan->min_interval = MIN(min_interval, max_interval);
+      wavelan->max_interval = MAX(min_interval, max_interval);
       xfce_rc_close (rc);
     }
   }
 
-  if (wavelan->interface == NULL) {
-    GList *interfaces = wavelan_query_interfaces();
-    wavelan->interface = g_list_first(interfaces)->data;
-    g_list_free(interfaces);
-  }
+  /* follow whichever radio carries the traffic */
+  if (wavelan->interface == NULL)
+    wavelan->interface = g_strdup(SAMPLER_AUTO_INTERFACE);
   
   wavelan_reset(wavelan);
 }
 
 static gboolean tooltip_cb( GtkWidget *widget, gint x, gint y, gboolean keyboard, GtkTooltip * tooltip, t_wavelan *wavelan)
 {
-	gtk_tooltip_set_custom( tooltip, wavelan->tooltip_text );
+	/* only now is it worth formatting the samples */
+	if (wavelan->tip_stale)
+		wavelan_build_tip(wavelan);
+	gtk_tooltip_set_custom( tooltip, wavelan->tooltip_grid );
 	return TRUE;
 }
 
@@ -452,6 +1645,7 @@ wavelan_new(XfcePanelPlugin *plugin)
 {
   t_wavelan *wavelan;
   GtkSettings* settings;
+  guint i;
 
   TRACE ("Entered wavelan_new");
 
@@ -466,9 +1660,14 @@ wavelan_new(XfcePanelPlugin *plugin)
 #if defined(__linux__)
   wavelan->command = g_strdup("nm-connection-editor");
 #endif
-  wavelan->state = -2;
+  wavelan->min_interval = SAMPLER_MIN_INTERVAL;
+  wavelan->max_interval = SAMPLER_MAX_INTERVAL;
 
   wavelan->plugin = plugin;
+  wavelan->visible = -1;
+  wavelan->timings_logged = g_get_monotonic_time();
+  for (i = 0; i < STAGE_COUNT; i++)
+    wavelan->timings[i].wt_name = stage_names[i];
   
   wavelan->ebox = gtk_event_box_new();
   gtk_widget_set_has_tooltip(wavelan->ebox, TRUE);
@@ -479,40 +1678,30 @@ wavelan_new(XfcePanelPlugin *plugin)
   xfce_panel_plugin_add_action_widget(plugin, wavelan->ebox);
   gtk_container_add(GTK_CONTAINER(plugin), wavelan->ebox);
 
-  wavelan->tooltip_text = gtk_label_new(NULL);
-  g_object_ref( wavelan->tooltip_text );
+  wavelan->tooltip_grid = gtk_grid_new();
+  gtk_grid_set_column_spacing(GTK_GRID(wavelan->tooltip_grid), BORDER);
+  g_object_ref( wavelan->tooltip_grid );
+  wavelan->tip_stale = TRUE;
 
-  /* create box for img & progress bar */
+  /* create box for the per-radio indicators */
   wavelan->box = gtk_box_new(wavelan->orientation, 0);
 
-  /* setup progressbar */
-  wavelan->signal = gtk_progress_bar_new();
-  wavelan->css_provider = gtk_css_provider_new ();
-  gtk_style_context_add_provider (
-      GTK_STYLE_CONTEXT (gtk_widget_get_style_context (GTK_WIDGET (wavelan->signal))),
-      GTK_STYLE_PROVIDER (wavelan->css_provider),
-      GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-
   settings = gtk_settings_get_default();
   g_signal_connect_swapped(settings, "notify::gtk-icon-theme-name", G_CALLBACK(wavelan_refresh_icons), wavelan);
-  wavelan->signal_strength = INIT;
   wavelan_refresh_icons(wavelan);
-  wavelan->image = gtk_image_new();
-  gtk_image_set_from_icon_name (GTK_IMAGE (wavelan->image), strength_to_icon[wavelan->signal_strength], GTK_ICON_SIZE_BUTTON);
-
-  gtk_box_pack_start(GTK_BOX(wavelan->box), GTK_WIDGET(wavelan->image), FALSE, FALSE, 0);
-  gtk_box_pack_start(GTK_BOX(wavelan->box), GTK_WIDGET(wavelan->signal), FALSE, FALSE, 0);
-
 
   wavelan_set_size(plugin, xfce_panel_plugin_get_icon_size (plugin), wavelan);
   wavelan_set_orientation(plugin, xfce_panel_plugin_get_orientation (plugin),  wavelan);
   gtk_widget_show_all(wavelan->box);
   gtk_container_add(GTK_CONTAINER(wavelan->ebox), GTK_WIDGET(wavelan->box));
   gtk_widget_show_all(wavelan->ebox);
-  
+
+  sampler_subscribe(wavelan_sampled, wavelan);
+  service_ref();
+
   wavelan_read_config(plugin, wavelan);
 
-  wavelan_set_state(wavelan, wavelan->state);
+  wavelan_update_state(wavelan);
 
   return(wavelan);
 }
@@ -521,15 +1710,19 @@ static void
 wavelan_free(XfcePanelPlugin* plugin, t_wavelan *wavelan)
 {
   TRACE ("Entered wavelan_free");
+
+  /* the settings outlive us now that the panel keeps the module loaded */
+  g_signal_handlers_disconnect_by_data(gtk_settings_get_default(), wavelan);
   
   /* free tooltips */
-  g_object_unref(G_OBJECT(wavelan->tooltip_text));
+  g_object_unref(G_OBJECT(wavelan->tooltip_grid));
 
-  g_source_remove(wavelan->timer_id);
+  service_unref();
+  sampler_unsubscribe(wavelan_sampled, wavelan);
 
   /* free the device info */
-  if (wavelan->device != NULL)
-    wi_close(wavelan->device);
+  wavelan_close_radios(wavelan);
+  wavelan_free_icons(wavelan);
 
   if (wavelan->interface != NULL)
     g_free(wavelan->interface);
@@ -537,6 +1730,8 @@ wavelan_free(XfcePanelPlugin* plugin, t_wavelan *wavelan)
   if (wavelan->command != NULL)
     g_free(wavelan->command);
 
+  g_free(wavelan->ping_host);
+
   g_free(wavelan);
 }
 
@@ -569,10 +1764,20 @@ wavelan_write_config(XfcePanelPlugin *plugin, t_wavelan *wavelan)
   xfce_rc_write_bool_entry (rc, "SignalColors", wavelan->signal_colors);
   xfce_rc_write_bool_entry (rc, "ShowIcon", wavelan->show_icon);
   xfce_rc_write_bool_entry (rc, "ShowBar", wavelan->show_bar);
+  xfce_rc_write_bool_entry (rc, "ShowGraph", wavelan->show_graph);
+  xfce_rc_write_bool_entry (rc, "ShowThroughput", wavelan->show_throughput);
+  xfce_rc_write_bool_entry (rc, "KeepHistory", wavelan->keep_history);
   if (wavelan->command)
   {
     xfce_rc_write_entry (rc, "Command", wavelan->command);
   }
+  xfce_rc_write_bool_entry (rc, "Ping", wavelan->ping);
+  if (wavelan->ping_host)
+  {
+    xfce_rc_write_entry (rc, "PingHost", wavelan->ping_host);
+  }
+  xfce_rc_write_int_entry (rc, "MinInterval", wavelan->min_interval);
+  xfce_rc_write_int_entry (rc, "MaxInterval", wavelan->max_interval);
 
   xfce_rc_close(rc);
   
@@ -581,24 +1786,34 @@ wavelan_write_config(XfcePanelPlugin *plugin, t_wavelan *wavelan)
 static void
 wavelan_set_orientation(XfcePanelPlugin* plugin, GtkOrientation orientation, t_wavelan *wavelan)
 {
+  guint i;
+
   DBG("wavelan_set_orientation(%d)", orientation);
   wavelan->orientation = orientation;
   gtk_orientable_set_orientation(GTK_ORIENTABLE(wavelan->box), orientation);
-  gtk_orientable_set_orientation(GTK_ORIENTABLE(wavelan->signal), !orientation);
-  gtk_progress_bar_set_inverted(GTK_PROGRESS_BAR(wavelan->signal), (orientation == GTK_ORIENTATION_HORIZONTAL));
-  wavelan_set_state(wavelan, wavelan->state);
+  for (i = 0; i < wavelan->n_radios; i++) {
+    t_radio *radio = &wavelan->radios[i];
+    gtk_orientable_set_orientation(GTK_ORIENTABLE(radio->box), orientation);
+    wavelan_graph_set_size(wavelan, radio);
+  }
+  wavelan_update_state(wavelan);
 }
 
 static void
 wavelan_set_size(XfcePanelPlugin* plugin, int size, t_wavelan *wavelan)
 {
-  int border_width, image_size;
+  int border_width;
+  guint i;
   DBG("wavelan_set_size(%d)", size);
   size /= xfce_panel_plugin_get_nrows(plugin);
   xfce_panel_plugin_set_small (plugin, TRUE);
   border_width = size > 26 ? 2 : 1;
-  image_size = xfce_panel_plugin_get_icon_size (plugin);
-  gtk_image_set_pixel_size (GTK_IMAGE (wavelan->image), image_size);
+  wavelan->image_size = xfce_panel_plugin_get_icon_size (plugin);
+  wavelan_free_icons(wavelan);
+  for (i = 0; i < wavelan->n_radios; i++) {
+    wavelan_indicator_set_size(wavelan, &wavelan->radios[i]);
+    gtk_widget_queue_draw(wavelan->radios[i].indicator);
+  }
   gtk_container_set_border_width(GTK_CONTAINER(wavelan->box), border_width);
 }
 
@@ -618,7 +1833,7 @@ wavelan_autohide_changed(GtkToggleButton *button, t_wavelan *wavelan)
 {
   TRACE ("Entered wavelan_autohide_changed");
   wavelan->autohide = gtk_toggle_button_get_active(button);
-  wavelan_set_state(wavelan, wavelan->state);
+  wavelan_update_state(wavelan);
 }
 
 /* autohide on missing callback */
@@ -627,7 +1842,7 @@ wavelan_autohide_missing_changed(GtkToggleButton *button, t_wavelan *wavelan)
 {
   TRACE ("Entered wavelan_autohide_missing_changed");
   wavelan->autohide_missing = gtk_toggle_button_get_active(button);
-  wavelan_set_state(wavelan, wavelan->state);
+  wavelan_update_state(wavelan);
 }
 
 /* show icon callback */
@@ -636,7 +1851,7 @@ wavelan_show_icon_changed(GtkToggleButton *button, t_wavelan *wavelan)
 {
   TRACE ("Entered wavelan_show_icon_changed");
   wavelan->show_icon = gtk_toggle_button_get_active(button);
-  wavelan_set_state(wavelan, wavelan->state);
+  wavelan_update_state(wavelan);
 }
 
 /* show signal bar callback */
@@ -645,7 +1860,35 @@ wavelan_show_bar_changed(GtkToggleButton *button, t_wavelan *wavelan)
 {
   TRACE ("Entered wavelan_show_bar_changed");
   wavelan->show_bar = gtk_toggle_button_get_active(button);
-  wavelan_set_state(wavelan, wavelan->state);
+  wavelan_update_state(wavelan);
+}
+
+/* show history graph callback */
+static void
+wavelan_show_graph_changed(GtkToggleButton *button, t_wavelan *wavelan)
+{
+  TRACE ("Entered wavelan_show_graph_changed");
+  wavelan->show_graph = gtk_toggle_button_get_active(button);
+  wavelan_update_state(wavelan);
+}
+
+/* show throughput callback */
+static void
+wavelan_show_throughput_changed(GtkToggleButton *button, t_wavelan *wavelan)
+{
+  TRACE ("Entered wavelan_show_throughput_changed");
+  wavelan->show_throughput = gtk_toggle_button_get_active(button);
+  wavelan_set_interval(wavelan);
+  wavelan_update_state(wavelan);
+}
+
+/* keep history callback, the radios start over to load it */
+static void
+wavelan_keep_history_changed(GtkToggleButton *button, t_wavelan *wavelan)
+{
+  TRACE ("Entered wavelan_keep_history_changed");
+  wavelan->keep_history = gtk_toggle_button_get_active(button);
+  wavelan_reset(wavelan);
 }
 
 /* signal colors callback */
@@ -654,7 +1897,7 @@ wavelan_signal_colors_changed(GtkToggleButton *button, t_wavelan *wavelan)
 {
   TRACE ("Entered wavelan_signal_colors_changed");
   wavelan->signal_colors = gtk_toggle_button_get_active(button);
-  wavelan_set_state(wavelan, wavelan->state);
+  wavelan_update_state(wavelan);
 }
 
 /* command changed callback */
@@ -666,6 +1909,42 @@ wavelan_command_changed(GtkEntry *entry, t_wavelan *wavelan)
   wavelan->command = g_strdup(gtk_entry_get_text(entry));
 }
 
+/* start over with the new settings on the next sample */
+static void
+wavelan_ping_reset(t_wavelan *wavelan)
+{
+  guint i;
+
+  for (i = 0; i < wavelan->n_radios; i++) {
+    if (wavelan->radios[i].ping != NULL) {
+      wavelan_ping_stop(&wavelan->radios[i]);
+      wavelan_radio_retip(&wavelan->radios[i]);
+    }
+  }
+  wavelan_update_tip(wavelan);
+
+  if (wavelan->ping)
+    sampler_refresh();
+}
+
+/* latency probe callback */
+static void
+wavelan_ping_changed(GtkToggleButton *button, t_wavelan *wavelan)
+{
+  TRACE ("Entered wavelan_ping_changed");
+  wavelan->ping = gtk_toggle_button_get_active(button);
+  wavelan_ping_reset(wavelan);
+}
+
+/* latency probe host callback */
+static void
+wavelan_ping_host_changed(GtkEntry *entry, t_wavelan *wavelan)
+{
+  g_free(wavelan->ping_host);
+  wavelan->ping_host = g_strdup(gtk_entry_get_text(entry));
+  wavelan_ping_reset(wavelan);
+}
+
 static void
 wavelan_dialog_response (GtkWidget *dlg, int response, t_wavelan *wavelan)
 {
@@ -680,9 +1959,12 @@ static void
 wavelan_create_options (XfcePanelPlugin *plugin, t_wavelan *wavelan)
 {
   GtkWidget *dlg, *hbox, *label, *interface, *vbox, *autohide;
-  GtkWidget *autohide_missing, *warn_label, *signal_colors, *show_icon, *show_bar, *command;
+  GtkWidget *autohide_missing, *warn_label, *signal_colors, *show_icon, *show_bar, *show_graph, *show_throughput, *command;
+  GtkWidget *keep_history;
+  GtkWidget *ping, *ping_host;
   GtkWidget *combo;
-  GList     *interfaces, *lp;
+  gchar    **interfaces;
+  guint      i;
 
   TRACE ("Entered wavelan_create_options");
   
@@ -720,10 +2002,13 @@ wavelan_create_options (XfcePanelPlugin *plugin, t_wavelan *wavelan)
   gtk_label_set_xalign (GTK_LABEL (label), 0.0f);
   gtk_widget_show(label);
 
-  interfaces = wavelan_query_interfaces ();
+  interfaces = sampler_list_interfaces ();
   combo = gtk_combo_box_text_new_with_entry ();
-  for (lp = interfaces; lp != NULL; lp = lp->next)
-    gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), lp->data);
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), SAMPLER_AUTO_INTERFACE);
+  for (i = 0; interfaces[i] != NULL; i++)
+    gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), interfaces[i]);
+  gtk_widget_set_tooltip_text (combo, _("Separate several interfaces with commas to monitor all of them, "
+                                         "\"auto\" follows the wireless interface of the default route"));
   gtk_widget_show (combo);
   gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
 
@@ -790,6 +2075,39 @@ wavelan_create_options (XfcePanelPlugin *plugin, t_wavelan *wavelan)
   gtk_box_pack_start(GTK_BOX(hbox), show_bar, TRUE, TRUE, 0);
   gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
 
+  hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 12);
+  gtk_widget_show(hbox);
+  show_graph = gtk_check_button_new_with_mnemonic(_("Show signal _history"));
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(show_graph),
+      wavelan->show_graph);
+  g_signal_connect(show_graph, "toggled",
+      G_CALLBACK(wavelan_show_graph_changed), wavelan);
+  gtk_widget_show(show_graph);
+  gtk_box_pack_start(GTK_BOX(hbox), show_graph, TRUE, TRUE, 0);
+  gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
+
+  hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 12);
+  gtk_widget_show(hbox);
+  keep_history = gtk_check_button_new_with_mnemonic(_("_Keep the history across restarts"));
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(keep_history),
+      wavelan->keep_history);
+  g_signal_connect(keep_history, "toggled",
+      G_CALLBACK(wavelan_keep_history_changed), wavelan);
+  gtk_widget_show(keep_history);
+  gtk_box_pack_start(GTK_BOX(hbox), keep_history, TRUE, TRUE, 0);
+  gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
+
+  hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 12);
+  gtk_widget_show(hbox);
+  show_throughput = gtk_check_button_new_with_mnemonic(_("Show _throughput"));
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(show_throughput),
+      wavelan->show_throughput);
+  g_signal_connect(show_throughput, "toggled",
+      G_CALLBACK(wavelan_show_throughput_changed), wavelan);
+  gtk_widget_show(show_throughput);
+  gtk_box_pack_start(GTK_BOX(hbox), show_throughput, TRUE, TRUE, 0);
+  gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
+
   hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 12);
   gtk_widget_show(hbox);
   signal_colors = gtk_check_button_new_with_mnemonic(_("Enable sig_nal quality colors"));
@@ -801,6 +2119,25 @@ wavelan_create_options (XfcePanelPlugin *plugin, t_wavelan *wavelan)
   gtk_box_pack_start(GTK_BOX(hbox), signal_colors, TRUE, TRUE, 0);
   gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
 
+  hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 12);
+  gtk_widget_show(hbox);
+  ping = gtk_check_button_new_with_mnemonic(_("Measure _latency to"));
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(ping), wavelan->ping);
+  g_signal_connect(ping, "toggled",
+      G_CALLBACK(wavelan_ping_changed), wavelan);
+  gtk_widget_show(ping);
+  ping_host = gtk_entry_new();
+  gtk_entry_set_placeholder_text(GTK_ENTRY(ping_host), _("default gateway"));
+  gtk_widget_set_tooltip_text(ping_host, _("An IP address, names are not resolved"));
+  if (wavelan->ping_host != NULL)
+    gtk_entry_set_text(GTK_ENTRY(ping_host), wavelan->ping_host);
+  g_signal_connect(ping_host, "changed", G_CALLBACK(wavelan_ping_host_changed),
+      wavelan);
+  gtk_widget_show(ping_host);
+  gtk_box_pack_start(GTK_BOX(hbox), ping, FALSE, FALSE, 0);
+  gtk_box_pack_start(GTK_BOX(hbox), ping_host, TRUE, TRUE, 0);
+  gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
+
   hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 12);
   gtk_widget_show(hbox);
   label = gtk_label_new(_("Wifi Manager Command"));
@@ -816,14 +2153,38 @@ wavelan_create_options (XfcePanelPlugin *plugin, t_wavelan *wavelan)
   gtk_box_pack_start(GTK_BOX(hbox), command, TRUE, TRUE, 0);
   gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
 
-  for (lp = interfaces; lp != NULL; lp = lp ->next)
-    g_free (lp->data);
-  g_list_free (interfaces);
+  g_strfreev (interfaces);
 
   gtk_widget_show (dlg);
   
 }
 
+static void
+wavelan_show_timings (GtkMenuItem *item, t_wavelan *wavelan)
+{
+  GtkWidget *dialog;
+  GString *out;
+  gchar *markup;
+
+  out = g_string_new(NULL);
+  wavelan_timings_dump(wavelan, out);
+  markup = g_markup_printf_escaped("<big><b>%s</b></big>\n\n<tt>%s</tt>",
+                                   _("Latency of the wireless queries"), out->str);
+
+  /* not modal, the samples go on meanwhile */
+  dialog = gtk_message_dialog_new_with_markup (NULL,
+                                               GTK_DIALOG_DESTROY_WITH_PARENT,
+                                               GTK_MESSAGE_INFO,
+                                               GTK_BUTTONS_CLOSE,
+                                               "%s", markup);
+  gtk_window_set_title (GTK_WINDOW (dialog), _("Timings"));
+  g_signal_connect (dialog, "response", G_CALLBACK (gtk_widget_destroy), NULL);
+  gtk_widget_show (dialog);
+
+  g_free(markup);
+  g_string_free(out, TRUE);
+}
+
 static void
 wavelan_show_about (XfcePanelPlugin *plugin, t_wavelan *wavelan)
 {
@@ -843,10 +2204,12 @@ static void
 wavelan_construct (XfcePanelPlugin *plugin)
 {
   t_wavelan *wavelan = wavelan_new(plugin);
+  GtkWidget *item;
 
   TRACE ("Entered wavelan_construct");
 
   xfce_textdomain (GETTEXT_PACKAGE, PACKAGE_LOCALE_DIR, "UTF-8");
+  wavelan_init_formats();
 
   g_signal_connect (plugin, "orientation-changed",
                     G_CALLBACK (wavelan_set_orientation), wavelan);
@@ -866,24 +2229,23 @@ wavelan_construct (XfcePanelPlugin *plugin)
   
   xfce_panel_plugin_menu_show_about(plugin);
   g_signal_connect (plugin, "about", G_CALLBACK (wavelan_show_about), wavelan);
-}
 
-#if 0
-int main(int argc, char** argv)
-{
-	struct wi_device *device;
-	struct wi_stats stats;
-	if ((device = wi_open(argv[1])) == NULL)
-		errx(1, "failed to open %s\n", argv[1]);
+  item = gtk_menu_item_new_with_mnemonic (_("Show _Timings"));
+  g_signal_connect (item, "activate", G_CALLBACK (wavelan_show_timings), wavelan);
+  xfce_panel_plugin_menu_insert_item (plugin, GTK_MENU_ITEM (item));
+  gtk_widget_show (item);
+}
 
+XFCE_PANEL_PLUGIN_REGISTER(wavelan_construct);
 
-	if (wi_query(device, &stats) != WI_OK)
-		errx(2, "wi_query failed\n");
+/* the plugin runs inside the panel so that its instances share one
+ * sampler, whose worker thread and idle callbacks may outlive the last
+ * instance: never let the panel unload the module under them */
+G_MODULE_EXPORT const gchar *g_module_check_init(GModule *module);
 
-	printf("NWID:%s, quality:%d%%, rate:%dMb/s\n", stats.ws_netname, stats.ws_quality, stats.ws_rate);
-	wi_close(device);
-	return 0;
+G_MODULE_EXPORT const gchar *
+g_module_check_init(GModule *module)
+{
+  g_module_make_resident(module);
+  return(NULL);
 }
-#else
-XFCE_PANEL_PLUGIN_REGISTER(wavelan_construct);
-#endif
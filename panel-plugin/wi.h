@@ -25,10 +25,84 @@
 #ifndef __WI_H__
 #define __WI_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define WI_MAXSTRLEN  (512)
+#define WI_HWADDR_LEN (6)
 
 struct wi_device;
 
+/* transmit or receive rate of the link */
+struct wi_rate
+{
+  int   wr_bitrate;               /* 100 kb/s */
+  int   wr_mcs;                   /* MCS index, -1 for legacy rates */
+  int   wr_nss;                   /* spatial streams, 0 if unknown */
+  int   wr_width;                 /* channel width in MHz, 0 if unknown */
+  char  wr_mode[4];               /* "HT", "VHT", "HE" or "" for legacy */
+};
+
+/* details of the association, a field is only set if its bit is in
+ * wl_valid; nl80211 reports them all with the station */
+struct wi_link
+{
+  unsigned int    wl_valid;
+  int             wl_signal;              /* dBm */
+  int             wl_signal_avg;          /* dBm */
+  int             wl_noise;               /* dBm */
+  struct wi_rate  wl_tx_rate;
+  struct wi_rate  wl_rx_rate;
+  int             wl_frequency;           /* MHz */
+  int             wl_channel;
+  unsigned char   wl_bssid[WI_HWADDR_LEN];
+  unsigned int    wl_tx_retries;
+  unsigned int    wl_tx_failed;
+  unsigned int    wl_beacon_loss;
+  unsigned int    wl_connected_time;      /* s */
+  unsigned int    wl_inactive_time;       /* ms */
+  unsigned long long wl_rx_bytes;         /* counters, only their deltas matter */
+  unsigned long long wl_tx_bytes;
+};
+
+enum
+{
+  WI_LINK_SIGNAL          = 1 << 0,
+  WI_LINK_SIGNAL_AVG      = 1 << 1,
+  WI_LINK_NOISE           = 1 << 2,
+  WI_LINK_TX_RATE         = 1 << 3,
+  WI_LINK_RX_RATE         = 1 << 4,
+  WI_LINK_FREQUENCY       = 1 << 5,       /* and wl_channel */
+  WI_LINK_BSSID           = 1 << 6,
+  WI_LINK_TX_RETRIES      = 1 << 7,
+  WI_LINK_TX_FAILED       = 1 << 8,
+  WI_LINK_BEACON_LOSS     = 1 << 9,
+  WI_LINK_CONNECTED_TIME  = 1 << 10,
+  WI_LINK_INACTIVE_TIME   = 1 << 11,
+  WI_LINK_BYTES           = 1 << 12,      /* wl_rx_bytes and wl_tx_bytes */
+};
+
+/* the members of a struct wi_link as key/value pairs, with the keys of
+ * wavelan-probe --json and the Details of the D-Bus service */
+enum
+{
+  WI_FIELD_INT,           /* int */
+  WI_FIELD_UINT,          /* unsigned int */
+  WI_FIELD_UINT64,        /* unsigned long long */
+  WI_FIELD_RATE,          /* struct wi_rate */
+  WI_FIELD_BSSID,         /* unsigned char[WI_HWADDR_LEN] */
+};
+
+struct wi_link_field
+{
+  const char   *wf_key;
+  unsigned int  wf_valid;         /* WI_LINK_* set if the member is */
+  int           wf_type;          /* WI_FIELD_* */
+  size_t        wf_offset;        /* in struct wi_link */
+};
+
+#define WI_LINK_FIELD(link, field) ((const void *) ((const char *) (link) + (field)->wf_offset))
+
 struct wi_stats
 {
   char  ws_netname[WI_MAXSTRLEN]; /* current SSID */
@@ -36,8 +110,74 @@ struct wi_stats
   char  ws_qunit[4];              /* % or dBm ? */
   int   ws_rate;                  /* current rate (Mbps) */
   char  ws_vendor[WI_MAXSTRLEN];  /* device vendor name */
+  struct wi_link ws_link;         /* extended statistics, if available */
+};
+
+/* round trips of the last WI_PING_WINDOW probes, in microseconds, -1
+ * where there is none */
+#define WI_PING_WINDOW  (32)
+
+struct wi_ping_stats
+{
+  int   wp_sent;                  /* probes answered or lost */
+  int   wp_received;
+  int   wp_last;                  /* -1 if the last probe was lost */
+  int   wp_min;
+  int   wp_avg;
+  int   wp_max;
+  int   wp_jitter;                /* mean change between consecutive answers */
+};
+
+/* latency of a backend call, on the monotonic clock; bucket 0 of the
+ * histogram counts the calls under 1 us, bucket i > 0 those from
+ * 2^(i-1) us on, the last one has no upper bound */
+#define WI_TIMING_BUCKETS  (20)
+
+struct wi_timing
+{
+  const char         *wt_name;            /* of the trace marks */
+  unsigned int        wt_calls;
+  unsigned int        wt_errors;
+  unsigned long long  wt_total;           /* ns */
+  unsigned long long  wt_max;             /* ns */
+  unsigned int        wt_histogram[WI_TIMING_BUCKETS];
+};
+
+/* calls timed for every device, not all of them on every platform */
+enum
+{
+  WI_CALL_QUERY,          /* wi_query() as a whole */
+  WI_CALL_CARRIER,        /* media status */
+  WI_CALL_ESSID,
+  WI_CALL_RATE,
+  WI_CALL_STATS,          /* signal quality */
+  WI_CALL_RANGE,          /* capabilities, after wi_invalidate() */
+  WI_CALL_DRIVER,         /* vendor or driver name */
+  WI_CALL_NL80211,        /* station and interface request */
+  WI_CALL_NL80211_DUMP,   /* interfaces of a wi_query_many() batch */
+  WI_CALL_PROC,           /* /proc/net/wireless */
+  WI_CALL_BYTES,          /* traffic counters */
+  WI_CALL_COUNT
 };
 
+/* a sample as kept in a history, see wi_history.c */
+struct wi_history_record
+{
+  int64_t   wh_time;                /* ms since the epoch */
+  int8_t    wh_result;              /* wi_query() result */
+  uint8_t   wh_network;             /* in the network table, 0 if none */
+  int16_t   wh_quality;             /* in the unit of the history */
+  int16_t   wh_level;               /* dBm, WI_HISTORY_NO_LEVEL if unknown */
+  uint16_t  wh_rate;                /* Mb/s */
+};
+
+#define WI_HISTORY_CAPACITY       (1 << 18)   /* records, a 4 MB file */
+#define WI_HISTORY_NETWORKS       (254)
+#define WI_HISTORY_NAMELEN        (32)        /* as long as an SSID gets */
+#define WI_HISTORY_NO_NETWORK     (0)
+#define WI_HISTORY_OTHER_NETWORK  (255)       /* seen once the table was full */
+#define WI_HISTORY_NO_LEVEL       INT16_MIN
+
 enum
 {
   WI_OK         =  0,  /* everything ok */
@@ -46,9 +186,114 @@ enum
   WI_INVAL      = -3,  /* invalid parameters given */
 };
 
+enum
+{
+  WI_EVENT_LINK   = 1 << 0,  /* link appeared or changed state */
+  WI_EVENT_GONE   = 1 << 1,  /* link was removed */
+  WI_EVENT_ASSOC  = 1 << 2,  /* (dis)association, roaming or channel switch */
+  WI_EVENT_ROUTE  = 1 << 3,  /* a default route through the interface changed */
+};
+
+/* interface names replaying a trace instead of querying a device */
+#define WI_REPLAY_PREFIX       "replay:"      /* at the recorded pace */
+#define WI_REPLAY_FAST_PREFIX  "replay-fast:" /* one record per query */
+
+struct wi_history;
+struct wi_monitor;
+struct wi_ping;
+struct wi_recorder;
+struct wi_replay;
+
+/* interface is NULL if events were lost and everything must be refreshed */
+typedef void (*wi_monitor_func)(const char *interface, int events, void *data);
+
 extern struct wi_device* wi_open(const char *);
 extern void wi_close(struct wi_device *);
 extern int wi_query(struct wi_device *, struct wi_stats *);
+extern void wi_query_many(struct wi_device **, struct wi_stats *, int *, int);
+extern void wi_invalidate(struct wi_device *);
 extern const char *wi_strerror(int);
+extern const char *wi_result_name(int);
+
+/* terminated by an entry with a NULL wf_key */
+extern const struct wi_link_field wi_link_fields[];
+
+/* latencies of the calls made for a device, WI_CALL_COUNT of them */
+extern void wi_get_timings(struct wi_device *, struct wi_timing *);
+extern const char *wi_call_name(int);
+
+/* used by the backends and the plugin to time a call */
+extern void wi_timings_init(struct wi_timing *);
+extern unsigned long long wi_timing_begin(void);
+extern void wi_timing_end(struct wi_timing *, unsigned long long, int);
+extern unsigned long long wi_timing_percentile(const struct wi_timing *, double);
+
+/*
+ * Sysprof capture marks and USDT probes, built with -Dtracing=enabled.
+ * Every timed call leaves one, spans that are not timed use these;
+ * otherwise they compile to nothing.
+ */
+#ifdef WI_TRACING
+#define WI_TRACE_DECLARE(begin)     unsigned long long begin
+#define WI_TRACE_BEGIN(begin)       ((begin) = wi_timing_begin())
+#define WI_TRACE_END(begin, name)   wi_trace_mark((name), (begin), wi_timing_begin())
+extern void wi_trace_mark(const char *, unsigned long long, unsigned long long);
+#else
+#define WI_TRACE_DECLARE(begin)
+#define WI_TRACE_BEGIN(begin)       ((void)0)
+#define WI_TRACE_END(begin, name)   ((void)0)
+#endif
+
+/* wireless interfaces present, sorted and NULL terminated, or NULL */
+extern char **wi_list_interfaces(void);
+extern void wi_free_interfaces(char **);
+extern int wi_is_wireless(const char *);
+
+/* hardware address of an interface, WI_NOSUCHDEV if it is not present */
+extern int wi_get_hwaddr(const char *, unsigned char *);
+
+/* wireless interface carrying the preferred default route */
+extern int wi_get_route_interface(char *, size_t);
+
+/* address of the default gateway through an interface, as text */
+extern int wi_get_gateway(const char *, char *, size_t);
+
+/* link change notifications, wi_monitor_open() returns NULL if unsupported */
+extern struct wi_monitor *wi_monitor_open(void);
+extern void wi_monitor_close(struct wi_monitor *);
+extern int wi_monitor_get_fd(struct wi_monitor *);
+extern void wi_monitor_dispatch(struct wi_monitor *, wi_monitor_func, void *);
+
+/* latency probes to a numeric address, see wi_ping.c */
+extern struct wi_ping *wi_ping_open(const char *);
+extern void wi_ping_close(struct wi_ping *);
+extern int wi_ping_get_fd(struct wi_ping *);
+extern const char *wi_ping_get_address(struct wi_ping *);
+extern int wi_ping_send(struct wi_ping *);
+extern int wi_ping_dispatch(struct wi_ping *);
+extern void wi_ping_get_stats(struct wi_ping *, struct wi_ping_stats *);
+
+/* samples kept across restarts, see wi_history.c */
+extern struct wi_history *wi_history_open(const char *, unsigned int);
+extern struct wi_history *wi_history_map(const char *);
+extern void wi_history_close(struct wi_history *);
+extern int wi_history_append(struct wi_history *, long long, const struct wi_stats *, int);
+extern unsigned long long wi_history_first(const struct wi_history *);
+extern unsigned long long wi_history_end(const struct wi_history *);
+extern const struct wi_history_record *wi_history_get(const struct wi_history *, unsigned long long);
+extern unsigned long long wi_history_find(const struct wi_history *, long long);
+extern int wi_history_get_network(const struct wi_history *, unsigned int, char *, size_t);
+extern void wi_history_get_qunit(const struct wi_history *, char *, size_t);
+
+/* traces of wi_query() results, see wi_replay.c */
+extern struct wi_recorder *wi_recorder_open(const char *);
+extern int wi_recorder_write(struct wi_recorder *, const struct wi_stats *, int);
+extern void wi_recorder_close(struct wi_recorder *);
+
+/* used by the backends to serve replay devices */
+extern int wi_replay_match(const char *);
+extern struct wi_replay *wi_replay_open(const char *);
+extern void wi_replay_close(struct wi_replay *);
+extern int wi_replay_query(struct wi_replay *, struct wi_stats *);
 
 #endif  /* !__WI_H__ */
@@ -96,6 +96,12 @@ struct wi_device
 {
   char interface[WI_MAXSTRLEN];
   int socket;
+
+  /* set when a trace is replayed instead */
+  struct wi_replay *replay;
+
+  /* latency of the calls made for the device, see wi_get_timings() */
+  struct wi_timing timings[WI_CALL_COUNT];
 };
 
 static int _wi_carrier(const struct wi_device *);
@@ -106,6 +112,7 @@ static int _wi_getval(const struct wi_device *, struct ieee80211req_scan_result
 static int _wi_netname(const struct wi_device *, char *, size_t);
 static int _wi_quality(const struct wi_device *, int *);
 static int _wi_rate(const struct wi_device *, int *);
+static int _wi_query(struct wi_device *, struct wi_stats *);
 
 struct wi_device *
 wi_open(const char *interface)
@@ -115,8 +122,15 @@ wi_open(const char *interface)
   if (interface != NULL) {
     if ((device = (struct wi_device *)calloc(1, sizeof(*device))) != NULL) {
       strlcpy(device->interface, interface, WI_MAXSTRLEN);
+      wi_timings_init(device->timings);
 
-      if ((device->socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+      if (wi_replay_match(interface)) {
+        if ((device->replay = wi_replay_open(interface)) == NULL) {
+          free(device);
+          device = NULL;
+        }
+      }
+      else if ((device->socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
         free(device);
         device = NULL;
       }
@@ -130,19 +144,63 @@ void
 wi_close(struct wi_device *device)
 {
   if (device != NULL) {
-    close(device->socket);
+    if (device->replay != NULL)
+      wi_replay_close(device->replay);
+    else
+      close(device->socket);
     free(device);
   }
 }
 
+int
+wi_is_wireless(const char *interface)
+{
+  struct ifmediareq ifmr;
+  int sock, result;
+
+  if (interface == NULL || (sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    return(0);
+
+  bzero((void *)&ifmr, sizeof(ifmr));
+  strlcpy(ifmr.ifm_name, interface, sizeof(ifmr.ifm_name));
+  result = ioctl(sock, SIOCGIFMEDIA, &ifmr) == 0 &&
+           IFM_TYPE(ifmr.ifm_active) == IFM_IEEE80211;
+  close(sock);
+
+  return(result);
+}
+
 int
 wi_query(struct wi_device *device, struct wi_stats *stats)
 {
+  unsigned long long begin;
   int result;
 
   if (device == NULL || stats == NULL)
     return(WI_INVAL);
 
+  begin = wi_timing_begin();
+  if (device->replay != NULL)
+    result = wi_replay_query(device->replay, stats);
+  else
+    result = _wi_query(device, stats);
+  wi_timing_end(&device->timings[WI_CALL_QUERY], begin, result < WI_NOCARRIER);
+
+  return(result);
+}
+
+void
+wi_get_timings(struct wi_device *device, struct wi_timing *timings)
+{
+  memcpy(timings, device->timings, sizeof(device->timings));
+}
+
+static int
+_wi_query(struct wi_device *device, struct wi_stats *stats)
+{
+  unsigned long long begin;
+  int result;
+
   /* clear stats first */
   bzero((void *)stats, sizeof(*stats));
 
@@ -153,29 +211,43 @@ wi_query(struct wi_device *device, struct wi_stats *stats)
 #endif
   /* check vendor (independent of carrier state) */
 #if defined(__FreeBSD__) || defined(__FreeBSD_kernel__)
-  if ((result = _wi_vendor(device, stats->ws_vendor, WI_MAXSTRLEN)) != WI_OK)
+  begin = wi_timing_begin();
+  result = _wi_vendor(device, stats->ws_vendor, WI_MAXSTRLEN);
+  wi_timing_end(&device->timings[WI_CALL_DRIVER], begin, result != WI_OK);
+  if (result != WI_OK)
     return(result);
 #endif
 
   /* check carrier */
-  if ((result = _wi_carrier(device)) != WI_OK)
+  begin = wi_timing_begin();
+  result = _wi_carrier(device);
+  wi_timing_end(&device->timings[WI_CALL_CARRIER], begin, result < WI_NOCARRIER);
+  if (result != WI_OK)
     return(result);
-  else {
-    /* check netname (depends on carrier state) */
-    if ((result = _wi_netname(device,stats->ws_netname, WI_MAXSTRLEN)) != WI_OK)
-      return(result);
 
-    /* check quality (depends on carrier state) */
-    if ((result = _wi_quality(device, &stats->ws_quality)) != WI_OK)
-      return(result);
+  /* check netname (depends on carrier state) */
+  begin = wi_timing_begin();
+  result = _wi_netname(device,stats->ws_netname, WI_MAXSTRLEN);
+  wi_timing_end(&device->timings[WI_CALL_ESSID], begin, result != WI_OK);
+  if (result != WI_OK)
+    return(result);
 
-    /* check rate (depends on carrier state) */
-    if ((result = _wi_rate(device, &stats->ws_rate)) != WI_OK)
-      return(result);
+  /* check quality (depends on carrier state) */
+  begin = wi_timing_begin();
+  result = _wi_quality(device, &stats->ws_quality);
+  wi_timing_end(&device->timings[WI_CALL_STATS], begin, result != WI_OK);
+  if (result != WI_OK)
+    return(result);
 
-    /* everything ok, stats are up-to-date */
-    return(WI_OK);
-  }
+  /* check rate (depends on carrier state) */
+  begin = wi_timing_begin();
+  result = _wi_rate(device, &stats->ws_rate);
+  wi_timing_end(&device->timings[WI_CALL_RATE], begin, result != WI_OK);
+  if (result != WI_OK)
+    return(result);
+
+  /* everything ok, stats are up-to-date */
+  return(WI_OK);
 }
 
 static int
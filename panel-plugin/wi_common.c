@@ -22,6 +22,27 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#if !defined(__linux__)
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <net/if_dl.h>
+#include <net/if_types.h>
+
+#include <ifaddrs.h>
+#include <stdlib.h>
+#include <string.h>
+#endif
+
+#include <time.h>
+
+#ifdef HAVE_SYSPROF
+#include <sysprof-capture.h>
+#endif
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+
 #include <wi.h>
 
 /* Trick to mark strings for translation */
@@ -44,3 +65,283 @@ wi_strerror(int error)
     return N_("Unknown error");
   }
 }
+
+/* the result as wavelan-probe --json and the D-Bus service report it */
+const char *
+wi_result_name(int result)
+{
+  switch (result) {
+  case WI_OK:
+    return("ok");
+
+  case WI_NOCARRIER:
+    return("no-carrier");
+
+  case WI_NOSUCHDEV:
+    return("no-device");
+
+  default:
+    return("invalid");
+  }
+}
+
+#define WI_FIELD(key, valid, type, member) \
+  { key, valid, type, offsetof(struct wi_link, member) }
+
+const struct wi_link_field wi_link_fields[] =
+{
+  WI_FIELD("signal", WI_LINK_SIGNAL, WI_FIELD_INT, wl_signal),
+  WI_FIELD("signal_avg", WI_LINK_SIGNAL_AVG, WI_FIELD_INT, wl_signal_avg),
+  WI_FIELD("noise", WI_LINK_NOISE, WI_FIELD_INT, wl_noise),
+  WI_FIELD("tx", WI_LINK_TX_RATE, WI_FIELD_RATE, wl_tx_rate),
+  WI_FIELD("rx", WI_LINK_RX_RATE, WI_FIELD_RATE, wl_rx_rate),
+  WI_FIELD("frequency", WI_LINK_FREQUENCY, WI_FIELD_INT, wl_frequency),
+  WI_FIELD("channel", WI_LINK_FREQUENCY, WI_FIELD_INT, wl_channel),
+  WI_FIELD("bssid", WI_LINK_BSSID, WI_FIELD_BSSID, wl_bssid),
+  WI_FIELD("tx_retries", WI_LINK_TX_RETRIES, WI_FIELD_UINT, wl_tx_retries),
+  WI_FIELD("tx_failed", WI_LINK_TX_FAILED, WI_FIELD_UINT, wl_tx_failed),
+  WI_FIELD("beacon_loss", WI_LINK_BEACON_LOSS, WI_FIELD_UINT, wl_beacon_loss),
+  WI_FIELD("connected_time", WI_LINK_CONNECTED_TIME, WI_FIELD_UINT, wl_connected_time),
+  WI_FIELD("inactive_time", WI_LINK_INACTIVE_TIME, WI_FIELD_UINT, wl_inactive_time),
+  WI_FIELD("rx_bytes", WI_LINK_BYTES, WI_FIELD_UINT64, wl_rx_bytes),
+  WI_FIELD("tx_bytes", WI_LINK_BYTES, WI_FIELD_UINT64, wl_tx_bytes),
+  { NULL, 0, 0, 0 }
+};
+
+const char *
+wi_call_name(int call)
+{
+  static const char *names[WI_CALL_COUNT] =
+  {
+    "query", "carrier", "essid", "rate", "stats", "range", "driver",
+    "nl80211", "nl80211-dump", "proc", "bytes",
+  };
+
+  return((call >= 0 && call < WI_CALL_COUNT) ? names[call] : "unknown");
+}
+
+/* names the WI_CALL_COUNT timings of a device after their calls */
+void
+wi_timings_init(struct wi_timing *timings)
+{
+  int i;
+
+  for (i = 0; i < WI_CALL_COUNT; i++)
+    timings[i].wt_name = wi_call_name(i);
+}
+
+#ifdef WI_TRACING
+/* a span on the monotonic clock, the one sysprof uses */
+void
+wi_trace_mark(const char *name, unsigned long long begin, unsigned long long end)
+{
+  if (name == NULL)
+    return;
+
+#ifdef HAVE_SYSPROF
+  sysprof_collector_mark(begin, end - begin, "wavelan", name, NULL);
+#endif
+#ifdef HAVE_SYS_SDT_H
+  /* perf probe sdt_wavelan:mark, or bpftrace usdt:...:wavelan:mark */
+  DTRACE_PROBE3(wavelan, mark, name, begin, end - begin);
+#endif
+}
+#endif
+
+unsigned long long
+wi_timing_begin(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return((unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/* account for a call started at begin */
+void
+wi_timing_end(struct wi_timing *timing, unsigned long long begin, int failed)
+{
+  unsigned long long end = wi_timing_begin(), elapsed = end - begin, us;
+  int bucket = 0;
+
+#ifdef WI_TRACING
+  wi_trace_mark(timing->wt_name, begin, end);
+#endif
+
+  for (us = elapsed / 1000; us > 0 && bucket < WI_TIMING_BUCKETS - 1; us >>= 1)
+    bucket++;
+
+  timing->wt_calls++;
+  if (failed)
+    timing->wt_errors++;
+  timing->wt_total += elapsed;
+  if (elapsed > timing->wt_max)
+    timing->wt_max = elapsed;
+  timing->wt_histogram[bucket]++;
+}
+
+/* upper bound of the bucket holding the given fraction of the calls,
+ * in ns; the maximum for the last bucket */
+unsigned long long
+wi_timing_percentile(const struct wi_timing *timing, double fraction)
+{
+  unsigned long long seen = 0;
+  int bucket;
+
+  if (timing->wt_calls == 0)
+    return(0);
+
+  for (bucket = 0; bucket < WI_TIMING_BUCKETS - 1; bucket++) {
+    seen += timing->wt_histogram[bucket];
+    if (seen >= fraction * timing->wt_calls)
+      break;
+  }
+
+  if (bucket == WI_TIMING_BUCKETS - 1 || (1ULL << bucket) * 1000 > timing->wt_max)
+    return(timing->wt_max);
+  return((1ULL << bucket) * 1000);
+}
+
+#if !defined(__linux__)
+/* no batched interface on this platform, query one device after another */
+void
+wi_query_many(struct wi_device **devices, struct wi_stats *stats, int *results, int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++)
+    results[i] = wi_query(devices[i], &stats[i]);
+}
+
+/* nothing is cached across queries on this platform */
+void
+wi_invalidate(struct wi_device *device)
+{
+}
+
+/* no link notifications on this platform, the plugin keeps polling */
+struct wi_monitor *
+wi_monitor_open(void)
+{
+  return(NULL);
+}
+
+void
+wi_monitor_close(struct wi_monitor *monitor)
+{
+}
+
+int
+wi_monitor_get_fd(struct wi_monitor *monitor)
+{
+  return(-1);
+}
+
+void
+wi_monitor_dispatch(struct wi_monitor *monitor, wi_monitor_func func, void *data)
+{
+}
+
+static int
+_wi_compare_names(const void *a, const void *b)
+{
+  return(strcmp(*(char * const *) a, *(char * const *) b));
+}
+
+/* every ethernet-like link the backend recognises as a radio */
+char **
+wi_list_interfaces(void)
+{
+  struct ifaddrs *ifaddr, *ifa;
+  char **names, **grown;
+  size_t n = 0, size = 8;
+
+  if (getifaddrs(&ifaddr) == -1)
+    return(NULL);
+
+  if ((names = calloc(size, sizeof(*names))) == NULL) {
+    freeifaddrs(ifaddr);
+    return(NULL);
+  }
+
+  for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
+    if (ifa->ifa_addr == NULL || ifa->ifa_addr->sa_family != AF_LINK ||
+        ((struct if_data *) ifa->ifa_data)->ifi_type != IFT_ETHER ||
+        !wi_is_wireless(ifa->ifa_name))
+      continue;
+
+    if (n + 1 == size) {
+      if ((grown = realloc(names, 2 * size * sizeof(*names))) == NULL)
+        break;
+      names = grown;
+      size *= 2;
+    }
+    if ((names[n] = strdup(ifa->ifa_name)) != NULL)
+      n++;
+  }
+  names[n] = NULL;
+  freeifaddrs(ifaddr);
+
+  qsort(names, n, sizeof(*names), _wi_compare_names);
+
+  return(names);
+}
+
+void
+wi_free_interfaces(char **names)
+{
+  char **p;
+
+  if (names == NULL)
+    return;
+
+  for (p = names; *p != NULL; p++)
+    free(*p);
+  free(names);
+}
+
+int
+wi_get_hwaddr(const char *interface, unsigned char *hwaddr)
+{
+  struct ifaddrs *ifaddr, *ifa;
+  struct sockaddr_dl *sdl;
+  int result = WI_NOSUCHDEV;
+
+  if (interface == NULL || hwaddr == NULL)
+    return(WI_INVAL);
+
+  if (getifaddrs(&ifaddr) == -1)
+    return(WI_NOSUCHDEV);
+
+  for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
+    if (ifa->ifa_addr == NULL || ifa->ifa_addr->sa_family != AF_LINK ||
+        strcmp(ifa->ifa_name, interface) != 0)
+      continue;
+
+    sdl = (struct sockaddr_dl *) ifa->ifa_addr;
+    if (sdl->sdl_alen == WI_HWADDR_LEN) {
+      memcpy(hwaddr, LLADDR(sdl), WI_HWADDR_LEN);
+      result = WI_OK;
+    }
+    break;
+  }
+  freeifaddrs(ifaddr);
+
+  return(result);
+}
+
+/* routes are not looked up on this platform, callers fall back to the
+ * first wireless interface */
+int
+wi_get_route_interface(char *interface, size_t len)
+{
+  return(WI_NOSUCHDEV);
+}
+
+/* nor gateways, a host to probe has to be configured */
+int
+wi_get_gateway(const char *interface, char *address, size_t len)
+{
+  return(WI_NOSUCHDEV);
+}
+#endif
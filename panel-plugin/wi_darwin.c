@@ -62,6 +62,12 @@
 struct wi_device {
   char interface[WI_MAXSTRLEN];
   int socket;
+
+  /* set when a trace is replayed instead */
+  struct wi_replay* replay;
+
+  /* latency of the calls made for the device, see wi_get_timings() */
+  struct wi_timing timings[WI_CALL_COUNT];
 };
 
 static int _wi_carrier(const struct wi_device*);
@@ -70,6 +76,7 @@ static int _wi_getval(const struct wi_device*, struct apple80211req*);
 static int _wi_netname(const struct wi_device*, char*, size_t);
 static int _wi_quality(const struct wi_device*, int*);
 static int _wi_rate(const struct wi_device*, int*);
+static int _wi_query(struct wi_device*, struct wi_stats*);
 
 struct wi_device* wi_open(const char* interface) {
   struct wi_device* device = NULL;
@@ -77,8 +84,14 @@ struct wi_device* wi_open(const char* interface) {
   if (interface != NULL) {
     if ((device = (struct wi_device*)calloc(1, sizeof(*device))) != NULL) {
       strlcpy(device->interface, interface, WI_MAXSTRLEN);
-
-      if ((device->socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+      wi_timings_init(device->timings);
+
+      if (wi_replay_match(interface)) {
+        if ((device->replay = wi_replay_open(interface)) == NULL) {
+          free(device);
+          device = NULL;
+        }
+      } else if ((device->socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
         free(device);
         device = NULL;
       }
@@ -90,17 +103,65 @@ struct wi_device* wi_open(const char* interface) {
 
 void wi_close(struct wi_device* device) {
   if (device != NULL) {
-    close(device->socket);
+    if (device->replay != NULL)
+      wi_replay_close(device->replay);
+    else
+      close(device->socket);
     free(device);
   }
 }
 
+/* only Apple 802.11 drivers answer SIOCGA80211 */
+int wi_is_wireless(const char* interface) {
+  struct wi_device device;
+  struct apple80211req areq;
+  char ssid[APPLE80211_MAX_SSID_LEN + 1];
+  int result;
+
+  if (interface == NULL)
+    return (0);
+
+  bzero((void*)&device, sizeof(device));
+  strlcpy(device.interface, interface, WI_MAXSTRLEN);
+  if ((device.socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    return (0);
+
+  bzero((void*)&areq, sizeof(areq));
+  areq.type = APPLE80211_IOC_SSID;
+  areq.len = APPLE80211_MAX_SSID_LEN;
+  areq.data = ssid;
+
+  result = _wi_getval(&device, &areq) == WI_OK;
+  close(device.socket);
+
+  return (result);
+}
+
 int wi_query(struct wi_device* device, struct wi_stats* stats) {
+  unsigned long long begin;
   int result;
 
   if (device == NULL || stats == NULL)
     return (WI_INVAL);
 
+  begin = wi_timing_begin();
+  if (device->replay != NULL)
+    result = wi_replay_query(device->replay, stats);
+  else
+    result = _wi_query(device, stats);
+  wi_timing_end(&device->timings[WI_CALL_QUERY], begin, result < WI_NOCARRIER);
+
+  return (result);
+}
+
+void wi_get_timings(struct wi_device* device, struct wi_timing* timings) {
+  memcpy(timings, device->timings, sizeof(device->timings));
+}
+
+static int _wi_query(struct wi_device* device, struct wi_stats* stats) {
+  unsigned long long begin;
+  int result;
+
   /* clear stats first */
   bzero((void*)stats, sizeof(*stats));
 
@@ -111,25 +172,36 @@ int wi_query(struct wi_device* device, struct wi_stats* stats) {
   strlcpy(stats->ws_vendor, _("Unknown"), WI_MAXSTRLEN);
 
   /* check carrier */
-  if ((result = _wi_carrier(device)) != WI_OK)
+  begin = wi_timing_begin();
+  result = _wi_carrier(device);
+  wi_timing_end(&device->timings[WI_CALL_CARRIER], begin,
+                result < WI_NOCARRIER);
+  if (result != WI_OK)
     return (result);
-  else {
-    /* check netname (depends on carrier state) */
-    if ((result = _wi_netname(device, stats->ws_netname, WI_MAXSTRLEN)) !=
-        WI_OK)
-      return (result);
-
-    /* check quality (depends on carrier state) */
-    if ((result = _wi_quality(device, &stats->ws_quality)) != WI_OK)
-      return (result);
-
-    /* check rate (depends on carrier state) */
-    if ((result = _wi_rate(device, &stats->ws_rate)) != WI_OK)
-      return (result);
-
-    /* everything ok, stats are up-to-date */
-    return (WI_OK);
-  }
+
+  /* check netname (depends on carrier state) */
+  begin = wi_timing_begin();
+  result = _wi_netname(device, stats->ws_netname, WI_MAXSTRLEN);
+  wi_timing_end(&device->timings[WI_CALL_ESSID], begin, result != WI_OK);
+  if (result != WI_OK)
+    return (result);
+
+  /* check quality (depends on carrier state) */
+  begin = wi_timing_begin();
+  result = _wi_quality(device, &stats->ws_quality);
+  wi_timing_end(&device->timings[WI_CALL_STATS], begin, result != WI_OK);
+  if (result != WI_OK)
+    return (result);
+
+  /* check rate (depends on carrier state) */
+  begin = wi_timing_begin();
+  result = _wi_rate(device, &stats->ws_rate);
+  wi_timing_end(&device->timings[WI_CALL_RATE], begin, result != WI_OK);
+  if (result != WI_OK)
+    return (result);
+
+  /* everything ok, stats are up-to-date */
+  return (WI_OK);
 }
 
 static int _wi_carrier(const struct wi_device* device) {
@@ -0,0 +1,455 @@
+/* Copyright (c) 2025 The Xfce development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * History of samples, kept in a file of fixed size records so that a
+ * reader can mmap() it and look up a time range right away.
+ *
+ * The file starts with a 64 byte header, followed by a table of
+ * WI_HISTORY_NETWORKS network names of WI_HISTORY_NAMELEN bytes each,
+ * NUL padded, and by a ring of as many struct wi_history_record as the
+ * capacity given when the file was created. The whole file is
+ * allocated up front and never grows.
+ *
+ * Records are numbered from the creation of the file: record n sits in
+ * slot n % capacity and the header counts the records written so far.
+ * Only the oldest slot is ever overwritten, so the capacity - 1 records
+ * before the count stay readable while the writer goes on.
+ *
+ * Integers are stored in the byte order of the host, which the header
+ * tells, so that records are used in place; a file moved to a host of
+ * the other byte order is started over.
+ */
+
+#include <sys/types.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <wi.h>
+
+#define WI_HISTORY_MAGIC    "WLHS"
+#define WI_HISTORY_VERSION  1
+#define WI_HISTORY_ORDER    0x0102
+#define WI_HISTORY_HEADER   64
+#define WI_HISTORY_TABLE    (WI_HISTORY_HEADER + WI_HISTORY_NETWORKS * WI_HISTORY_NAMELEN)
+
+struct wi_history_header
+{
+  char      wh_magic[4];
+  uint16_t  wh_order;               /* WI_HISTORY_ORDER as written */
+  uint8_t   wh_version;
+  uint8_t   wh_record_size;
+  uint32_t  wh_capacity;            /* records in the ring */
+  uint32_t  wh_networks;            /* names in the table */
+  uint64_t  wh_written;             /* records appended since creation */
+  int64_t   wh_created;             /* ms since the epoch */
+  char      wh_qunit[4];            /* unit of wh_quality, as in wi_stats */
+  uint8_t   wh_reserved[28];
+};
+
+_Static_assert(sizeof(struct wi_history_header) == WI_HISTORY_HEADER, "history header");
+_Static_assert(sizeof(struct wi_history_record) == 16, "history record");
+
+struct wi_history
+{
+  int fd;
+  unsigned char *map;
+  size_t size;
+  int writable;
+  struct wi_history_header *header;
+  struct wi_history_record *records;
+  unsigned int network;             /* of the previous record */
+};
+
+static size_t
+_wi_history_size(unsigned int capacity)
+{
+  return(WI_HISTORY_TABLE + (size_t)capacity * sizeof(struct wi_history_record));
+}
+
+static int
+_wi_history_valid(const struct wi_history_header *header, size_t size)
+{
+  return(memcmp(header->wh_magic, WI_HISTORY_MAGIC, 4) == 0 &&
+         header->wh_order == WI_HISTORY_ORDER &&
+         header->wh_version == WI_HISTORY_VERSION &&
+         header->wh_record_size == sizeof(struct wi_history_record) &&
+         header->wh_capacity > 1 &&
+         header->wh_networks <= WI_HISTORY_NETWORKS &&
+         size >= _wi_history_size(header->wh_capacity));
+}
+
+static struct wi_history *
+_wi_history_new(int fd, size_t size, int writable)
+{
+  struct wi_history *history;
+  void *map;
+
+  map = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    return(NULL);
+
+  if ((history = calloc(1, sizeof(*history))) == NULL) {
+    munmap(map, size);
+    return(NULL);
+  }
+
+  history->fd = fd;
+  history->map = map;
+  history->size = size;
+  history->writable = writable;
+  history->header = map;
+  history->records = (struct wi_history_record *)(history->map + WI_HISTORY_TABLE);
+
+  return(history);
+}
+
+/* reserve the blocks, a write through the mapping to a full disk
+ * would raise SIGBUS instead of failing */
+static int
+_wi_history_allocate(int fd, size_t size)
+{
+#ifndef __APPLE__
+  int error;
+
+  if ((error = posix_fallocate(fd, 0, size)) == 0)
+    return(0);
+  if (error != EINVAL && error != EOPNOTSUPP)
+    return(-1);
+#endif
+
+  return(ftruncate(fd, size));
+}
+
+/* a new, empty file in place of the one given */
+static int
+_wi_history_create(const char *path, unsigned int capacity)
+{
+  struct wi_history_header header;
+  struct timeval tv;
+  int fd;
+
+  unlink(path);
+  if ((fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600)) < 0)
+    return(-1);
+
+  if (flock(fd, LOCK_EX | LOCK_NB) < 0 ||
+      _wi_history_allocate(fd, _wi_history_size(capacity)) < 0)
+    goto fail;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.wh_magic, WI_HISTORY_MAGIC, 4);
+  header.wh_order = WI_HISTORY_ORDER;
+  header.wh_version = WI_HISTORY_VERSION;
+  header.wh_record_size = sizeof(struct wi_history_record);
+  header.wh_capacity = capacity;
+  gettimeofday(&tv, NULL);
+  header.wh_created = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+
+  if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+    goto fail;
+
+  return(fd);
+
+fail:
+  close(fd);
+  unlink(path);
+  return(-1);
+}
+
+/*
+ * Open a history for appending, creating it if needed. A file of
+ * another capacity or format is started over. Only one writer at a
+ * time: NULL is returned with errno EWOULDBLOCK while another holds it.
+ */
+struct wi_history *
+wi_history_open(const char *path, unsigned int capacity)
+{
+  struct wi_history_header header;
+  struct wi_history *history;
+  struct stat st;
+  int fd, created;
+
+  if (path == NULL || capacity < 2 || capacity > UINT32_MAX / sizeof(struct wi_history_record)) {
+    errno = EINVAL;
+    return(NULL);
+  }
+
+  /* the lock of the file in place keeps other writers out, also while
+   * it is replaced */
+  if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0)
+    return(NULL);
+  if (flock(fd, LOCK_EX | LOCK_NB) < 0 || fstat(fd, &st) < 0) {
+    close(fd);
+    return(NULL);
+  }
+
+  created = st.st_size != (off_t)_wi_history_size(capacity) ||
+            pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+            !_wi_history_valid(&header, st.st_size) ||
+            header.wh_capacity != capacity;
+  if (created) {
+    int fresh = _wi_history_create(path, capacity);
+
+    close(fd);
+    if ((fd = fresh) < 0)
+      return(NULL);
+  }
+
+  if ((history = _wi_history_new(fd, _wi_history_size(capacity), 1)) == NULL) {
+    close(fd);
+    return(NULL);
+  }
+
+  return(history);
+}
+
+/* open a history read-only, wherever its writer is */
+struct wi_history *
+wi_history_map(const char *path)
+{
+  struct wi_history_header header;
+  struct wi_history *history;
+  struct stat st;
+  int fd;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return(NULL);
+  }
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+    return(NULL);
+
+  if (fstat(fd, &st) < 0 ||
+      pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      !_wi_history_valid(&header, st.st_size)) {
+    close(fd);
+    errno = EINVAL;
+    return(NULL);
+  }
+
+  if ((history = _wi_history_new(fd, _wi_history_size(header.wh_capacity), 0)) == NULL) {
+    close(fd);
+    return(NULL);
+  }
+
+  return(history);
+}
+
+void
+wi_history_close(struct wi_history *history)
+{
+  if (history != NULL) {
+    munmap(history->map, history->size);
+    close(history->fd);
+    free(history);
+  }
+}
+
+static const char *
+_wi_history_name(const struct wi_history *history, unsigned int network)
+{
+  return((const char *)history->map + WI_HISTORY_HEADER + (network - 1) * WI_HISTORY_NAMELEN);
+}
+
+/* index of a network in the table, added if missing */
+static unsigned int
+_wi_history_network(struct wi_history *history, const char *netname)
+{
+  struct wi_history_header *header = history->header;
+  size_t len = strnlen(netname, WI_HISTORY_NAMELEN);
+  unsigned int network;
+  char *name;
+
+  if (*netname == '\0')
+    return(WI_HISTORY_NO_NETWORK);
+
+  /* mostly the same as last time */
+  network = history->network;
+  if (network != WI_HISTORY_NO_NETWORK && network != WI_HISTORY_OTHER_NETWORK &&
+      strncmp(_wi_history_name(history, network), netname, WI_HISTORY_NAMELEN) == 0)
+    return(network);
+
+  for (network = 1; network <= header->wh_networks; network++) {
+    if (strncmp(_wi_history_name(history, network), netname, WI_HISTORY_NAMELEN) == 0)
+      return(network);
+  }
+
+  if (header->wh_networks == WI_HISTORY_NETWORKS)
+    return(WI_HISTORY_OTHER_NETWORK);
+
+  /* the name is in place before readers can see it */
+  name = (char *)_wi_history_name(history, network);
+  memcpy(name, netname, len);
+  __atomic_store_n(&header->wh_networks, network, __ATOMIC_RELEASE);
+
+  return(network);
+}
+
+int
+wi_history_append(struct wi_history *history, long long time,
+                  const struct wi_stats *stats, int result)
+{
+  struct wi_history_header *header;
+  struct wi_history_record *record;
+  uint64_t written;
+
+  if (history == NULL || !history->writable || stats == NULL)
+    return(WI_INVAL);
+
+  header = history->header;
+  written = header->wh_written;
+  record = &history->records[written % header->wh_capacity];
+
+  memset(record, 0, sizeof(*record));
+  record->wh_time = time;
+  record->wh_result = result;
+
+  if (result == WI_OK) {
+    record->wh_network = _wi_history_network(history, stats->ws_netname);
+    record->wh_quality = stats->ws_quality < INT16_MIN ? INT16_MIN :
+                         stats->ws_quality > INT16_MAX ? INT16_MAX : stats->ws_quality;
+    record->wh_rate = stats->ws_rate < 0 ? 0 :
+                      stats->ws_rate > UINT16_MAX ? UINT16_MAX : stats->ws_rate;
+
+    if (stats->ws_link.wl_valid & WI_LINK_SIGNAL)
+      record->wh_level = stats->ws_link.wl_signal;
+    else if (strcmp(stats->ws_qunit, "dBm") == 0)
+      record->wh_level = record->wh_quality;
+    else
+      record->wh_level = WI_HISTORY_NO_LEVEL;
+
+    if (memcmp(header->wh_qunit, stats->ws_qunit, sizeof(header->wh_qunit)) != 0)
+      memcpy(header->wh_qunit, stats->ws_qunit, sizeof(header->wh_qunit));
+  }
+  else
+    record->wh_level = WI_HISTORY_NO_LEVEL;
+
+  history->network = record->wh_network;
+
+  /* publish the record only once it is complete */
+  __atomic_store_n(&header->wh_written, written + 1, __ATOMIC_RELEASE);
+
+  return(WI_OK);
+}
+
+/* number of the oldest record still readable */
+unsigned long long
+wi_history_first(const struct wi_history *history)
+{
+  uint64_t written = wi_history_end(history);
+
+  /* the oldest slot is the next one overwritten */
+  return(written >= history->header->wh_capacity ?
+         written - history->header->wh_capacity + 1 : 0);
+}
+
+/* number of the next record appended */
+unsigned long long
+wi_history_end(const struct wi_history *history)
+{
+  return(__atomic_load_n(&history->header->wh_written, __ATOMIC_ACQUIRE));
+}
+
+/*
+ * Record n, NULL if it is not written yet or gone. The record is read
+ * in place, it stays valid until capacity - 1 more are appended.
+ */
+const struct wi_history_record *
+wi_history_get(const struct wi_history *history, unsigned long long n)
+{
+  if (n < wi_history_first(history) || n >= wi_history_end(history))
+    return(NULL);
+
+  return(&history->records[n % history->header->wh_capacity]);
+}
+
+/* number of the first record at or after time, records being in the
+ * order they were taken; wi_history_end() if there is none */
+unsigned long long
+wi_history_find(const struct wi_history *history, long long time)
+{
+  unsigned long long low = wi_history_first(history), high = wi_history_end(history);
+
+  while (low < high) {
+    unsigned long long middle = low + (high - low) / 2;
+
+    if (history->records[middle % history->header->wh_capacity].wh_time < time)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  return(low);
+}
+
+/* name of a network of the table, "" for WI_HISTORY_NO_NETWORK */
+int
+wi_history_get_network(const struct wi_history *history, unsigned int network,
+                       char *name, size_t size)
+{
+  size_t len;
+
+  if (history == NULL || name == NULL || size == 0)
+    return(WI_INVAL);
+
+  if (network == WI_HISTORY_NO_NETWORK) {
+    *name = '\0';
+    return(WI_OK);
+  }
+
+  if (network > __atomic_load_n(&history->header->wh_networks, __ATOMIC_ACQUIRE))
+    return(WI_INVAL);
+
+  len = strnlen(_wi_history_name(history, network), WI_HISTORY_NAMELEN);
+  if (len >= size)
+    len = size - 1;
+  memcpy(name, _wi_history_name(history, network), len);
+  name[len] = '\0';
+
+  return(WI_OK);
+}
+
+/* unit of the quality of the records, "%" or "dBm" */
+void
+wi_history_get_qunit(const struct wi_history *history, char *qunit, size_t size)
+{
+  size_t len = strnlen(history->header->wh_qunit, sizeof(history->header->wh_qunit));
+
+  if (size == 0)
+    return;
+  if (len >= size)
+    len = size - 1;
+  memcpy(qunit, history->header->wh_qunit, len);
+  qunit[len] = '\0';
+}
@@ -28,6 +28,9 @@
 #include <libxfce4util/libxfce4util.h>
 
 #include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -35,6 +38,8 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <arpa/inet.h>
 
 /* On newer linux headers these need to be
  * included first. It is probably a losing
@@ -45,33 +50,388 @@
 
 /* Require wireless extensions */
 #include <linux/wireless.h> 
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+
+/* nl80211 is preferred, wireless extensions are the fallback */
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/nl80211.h>
+#include <linux/rtnetlink.h>
 
 #include <wi.h>
 
+/* large enough for a station dump message, see netlink(7) */
+#define WI_NL_BUFSIZE   (16384)
+
+/* private result of the nl80211 path: retry with wireless extensions */
+#define WI_NL_FALLBACK  (1)
+
+#define WI_NLA_OK(nla, rem)   ((rem) >= (int) sizeof(struct nlattr) && \
+                               (nla)->nla_len >= sizeof(struct nlattr) && \
+                               (nla)->nla_len <= (rem))
+#define WI_NLA_NEXT(nla, rem) ((rem) -= NLA_ALIGN((nla)->nla_len), \
+                               (struct nlattr *) ((char *) (nla) + NLA_ALIGN((nla)->nla_len)))
+#define WI_NLA_DATA(nla)      ((void *) ((char *) (nla) + NLA_HDRLEN))
+#define WI_NLA_LEN(nla)       ((int) (nla)->nla_len - NLA_HDRLEN)
+
+/* where the stats of a device come from, $WAVELAN_BACKEND forces one */
+enum
+{
+  WI_BACKEND_AUTO,      /* nl80211, then wireless extensions, then procfs */
+  WI_BACKEND_NL80211,
+  WI_BACKEND_WEXT,
+  WI_BACKEND_PROC,      /* wireless extensions with /proc/net/wireless */
+};
+
+/* a row of /proc/net/wireless */
+struct wi_proc_row
+{
+  char interface[IFNAMSIZ];
+  double link;
+  long level;
+};
+
+/* sockets shared by all open devices */
+static struct
+{
+  int refcount;
+  int socket;
+  int backend;
+
+  /* generic netlink socket, -1 if nl80211 is not available */
+  int nl_socket;
+  guint16 nl80211_id;
+  guint32 nl_seq;
+
+  /* /proc/net/wireless, read at most once per query for all devices */
+  int proc_fd;
+  gboolean proc_fresh;
+  char *proc_buffer;
+  size_t proc_size;
+  struct wi_proc_row *proc_rows;
+  int n_proc_rows;
+  int proc_rows_size;
+} wi_shared = { 0, -1, WI_BACKEND_AUTO, -1, 0, 1, -1, FALSE, NULL, 0, NULL, 0, 0 };
+
 struct wi_device
 {
   char interface[WI_MAXSTRLEN];
   int socket;
+  int nl_socket;
+
+  /* set when a trace is replayed instead */
+  struct wi_replay *replay;
+
+  /* cached interface index, 0 if unknown */
+  int ifindex;
+
+  /* backend answering for the device, may fall back at runtime */
+  int backend;
+
+  /* statistics/rx_bytes and tx_bytes in sysfs, opened on first use by
+   * the wireless extensions path, -1 if closed */
+  int bytes_fd[2];
+
+  /* latency of the calls made for the device, see wi_get_timings() */
+  struct wi_timing timings[WI_CALL_COUNT];
+
+  /* capabilities, only reloaded after wi_invalidate() */
+  struct
+  {
+    gboolean valid;
+    double max_qual;
+    gboolean dbm;                     /* driver reports level in dBm */
+    int num_rates;
+    int rates[IW_MAX_BITRATES];       /* supported rates in kb/s */
+    char driver[WI_MAXSTRLEN];
+  } caps;
+};
+
+typedef void (*wi_nl_handler)(struct nlmsghdr *, void *);
+
+static void _wi_load_caps(struct wi_device *);
+static void _wi_bytes_close(struct wi_device *);
+
+static struct nlmsghdr *
+_wi_nl_msg_begin(char *buffer, size_t offset, guint16 type, guint16 flags,
+                 guint32 seq, guint8 cmd)
+{
+  struct nlmsghdr *nlh = (struct nlmsghdr *) (buffer + offset);
+  struct genlmsghdr *genl;
+
+  memset(nlh, 0, NLMSG_HDRLEN + GENL_HDRLEN);
+  nlh->nlmsg_len = NLMSG_HDRLEN + GENL_HDRLEN;
+  nlh->nlmsg_type = type;
+  nlh->nlmsg_flags = NLM_F_REQUEST | flags;
+  nlh->nlmsg_seq = seq;
+
+  genl = NLMSG_DATA(nlh);
+  genl->cmd = cmd;
+  genl->version = 1;
+
+  return(nlh);
+}
+
+static void
+_wi_nl_put_attr(struct nlmsghdr *nlh, guint16 type, const void *data, int len)
+{
+  struct nlattr *nla = (struct nlattr *) ((char *) nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+
+  nla->nla_type = type;
+  nla->nla_len = NLA_HDRLEN + len;
+  memcpy(WI_NLA_DATA(nla), data, len);
+  memset((char *) WI_NLA_DATA(nla) + len, 0, NLA_ALIGN(nla->nla_len) - nla->nla_len);
+
+  nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NLA_ALIGN(nla->nla_len);
+}
+
+static void
+_wi_nl_parse(struct nlattr **tb, int max, struct nlattr *head, int len)
+{
+  struct nlattr *nla;
+  int type;
+
+  memset(tb, 0, sizeof(struct nlattr *) * (max + 1));
+
+  for (nla = head; WI_NLA_OK(nla, len); nla = WI_NLA_NEXT(nla, len)) {
+    type = nla->nla_type & NLA_TYPE_MASK;
+    if (type <= max)
+      tb[type] = nla;
+  }
+}
+
+static void
+_wi_nl_parse_genl(struct nlattr **tb, int max, struct nlmsghdr *nlh)
+{
+  _wi_nl_parse(tb, max,
+               (struct nlattr *) ((char *) NLMSG_DATA(nlh) + GENL_HDRLEN),
+               (int) nlh->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN);
+}
+
+/*
+ * Send all requests in buffer with one sendmsg and collect the replies.
+ * Requests are numbered first_seq .. first_seq + count - 1 and each one
+ * must end in an ack, an error or NLMSG_DONE. Returns 0 or the first
+ * negative errno reported by the kernel.
+ */
+static int
+_wi_nl_transact(int sock, char *buffer, size_t len, guint32 first_seq,
+                int count, wi_nl_handler handler, void *data)
+{
+  struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+  char reply[WI_NL_BUFSIZE];
+  struct nlmsghdr *nlh;
+  guint32 total = count;
+  int n;
+  int error = 0;
+
+  if (sendto(sock, buffer, len, 0, (struct sockaddr *) &kernel, sizeof(kernel)) < 0)
+    return(-errno);
+
+  while (count > 0) {
+    if ((n = recv(sock, reply, sizeof(reply), 0)) < 0) {
+      if (errno == EINTR)
+        continue;
+      return(-errno);
+    }
+
+    for (nlh = (struct nlmsghdr *) reply; NLMSG_OK(nlh, n); nlh = NLMSG_NEXT(nlh, n)) {
+      /* stale reply to a request that timed out earlier */
+      if (nlh->nlmsg_seq - first_seq >= total)
+        continue;
+
+      if (nlh->nlmsg_type == NLMSG_DONE) {
+        count--;
+      }
+      else if (nlh->nlmsg_type == NLMSG_ERROR) {
+        struct nlmsgerr *err = NLMSG_DATA(nlh);
+        if (err->error != 0 && error == 0)
+          error = err->error;
+        count--;
+      }
+      else if (handler != NULL) {
+        handler(nlh, data);
+      }
+    }
+  }
+
+  return(error);
+}
+
+struct wi_nl_family
+{
+  guint16 id;
+  guint32 mlme_group;
+  guint32 config_group;
 };
 
+static void
+_wi_nl_family_cb(struct nlmsghdr *nlh, void *data)
+{
+  struct wi_nl_family *family = data;
+  struct nlattr *tb[CTRL_ATTR_MAX + 1];
+  struct nlattr *grp[CTRL_ATTR_MCAST_GRP_MAX + 1];
+  struct nlattr *nla;
+  const char *name;
+  guint32 id;
+  int rem;
+
+  _wi_nl_parse_genl(tb, CTRL_ATTR_MAX, nlh);
+  if (tb[CTRL_ATTR_FAMILY_ID] != NULL)
+    family->id = *(guint16 *) WI_NLA_DATA(tb[CTRL_ATTR_FAMILY_ID]);
+
+  if (tb[CTRL_ATTR_MCAST_GROUPS] == NULL)
+    return;
+
+  rem = WI_NLA_LEN(tb[CTRL_ATTR_MCAST_GROUPS]);
+  for (nla = WI_NLA_DATA(tb[CTRL_ATTR_MCAST_GROUPS]); WI_NLA_OK(nla, rem);
+       nla = WI_NLA_NEXT(nla, rem)) {
+    _wi_nl_parse(grp, CTRL_ATTR_MCAST_GRP_MAX, WI_NLA_DATA(nla), WI_NLA_LEN(nla));
+    if (grp[CTRL_ATTR_MCAST_GRP_NAME] == NULL || grp[CTRL_ATTR_MCAST_GRP_ID] == NULL)
+      continue;
+
+    name = WI_NLA_DATA(grp[CTRL_ATTR_MCAST_GRP_NAME]);
+    id = *(guint32 *) WI_NLA_DATA(grp[CTRL_ATTR_MCAST_GRP_ID]);
+    if (strcmp(name, NL80211_MULTICAST_GROUP_MLME) == 0)
+      family->mlme_group = id;
+    else if (strcmp(name, NL80211_MULTICAST_GROUP_CONFIG) == 0)
+      family->config_group = id;
+  }
+}
+
+static int
+_wi_nl_open(struct wi_nl_family *family)
+{
+  struct sockaddr_nl local = { .nl_family = AF_NETLINK };
+  struct timeval timeout = { .tv_sec = 1 };
+  char buffer[128];
+  struct nlmsghdr *nlh;
+  int sock;
+
+  if ((sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC)) < 0)
+    return(-1);
+
+  /* never let a stuck driver freeze the panel */
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  if (bind(sock, (struct sockaddr *) &local, sizeof(local)) < 0) {
+    close(sock);
+    return(-1);
+  }
+
+  /* resolve the nl80211 family id and multicast groups */
+  memset(family, 0, sizeof(*family));
+  nlh = _wi_nl_msg_begin(buffer, 0, GENL_ID_CTRL, NLM_F_ACK, 1, CTRL_CMD_GETFAMILY);
+  _wi_nl_put_attr(nlh, CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME, sizeof(NL80211_GENL_NAME));
+  if (_wi_nl_transact(sock, buffer, nlh->nlmsg_len, 1, 1, _wi_nl_family_cb, family) < 0 ||
+      family->id == 0) {
+    TRACE ("nl80211 is not available");
+    close(sock);
+    return(-1);
+  }
+
+  return(sock);
+}
+
+static int
+_wi_ifindex(struct wi_device *device)
+{
+  struct ifreq ifr;
+
+  memset(&ifr, 0, sizeof(ifr));
+  g_strlcpy(ifr.ifr_name, device->interface, IFNAMSIZ);
+  if (ioctl(device->socket, SIOCGIFINDEX, &ifr) < 0)
+    return(0);
+
+  return(ifr.ifr_ifindex);
+}
+
+static gboolean
+_wi_shared_ref(void)
+{
+  struct wi_nl_family family;
+
+  const gchar *backend;
+
+  if (wi_shared.refcount++ > 0)
+    return(TRUE);
+
+  backend = g_getenv("WAVELAN_BACKEND");
+  if (g_strcmp0(backend, "nl80211") == 0)
+    wi_shared.backend = WI_BACKEND_NL80211;
+  else if (g_strcmp0(backend, "wext") == 0)
+    wi_shared.backend = WI_BACKEND_WEXT;
+  else if (g_strcmp0(backend, "proc") == 0)
+    wi_shared.backend = WI_BACKEND_PROC;
+  else
+    wi_shared.backend = WI_BACKEND_AUTO;
+
+  if ((wi_shared.socket = socket(PF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0) {
+    TRACE ("Failed to open socket, %d", wi_shared.socket);
+    wi_shared.refcount = 0;
+    return(FALSE);
+  }
+
+  wi_shared.nl_socket = _wi_nl_open(&family);
+  wi_shared.nl80211_id = family.id;
+
+  return(TRUE);
+}
+
+static void
+_wi_shared_unref(void)
+{
+  if (--wi_shared.refcount > 0)
+    return;
+
+  if (wi_shared.nl_socket >= 0)
+    close(wi_shared.nl_socket);
+  close(wi_shared.socket);
+  wi_shared.nl_socket = -1;
+  wi_shared.socket = -1;
+
+  if (wi_shared.proc_fd >= 0)
+    close(wi_shared.proc_fd);
+  wi_shared.proc_fd = -1;
+  g_clear_pointer(&wi_shared.proc_buffer, g_free);
+  g_clear_pointer(&wi_shared.proc_rows, g_free);
+  wi_shared.proc_size = 0;
+  wi_shared.n_proc_rows = wi_shared.proc_rows_size = 0;
+}
+
 struct wi_device *
 wi_open(const char *interface)
 {
   struct wi_device *device;
-  int sock;
 
   g_return_val_if_fail(interface != NULL, NULL);
 
-  if ((sock = socket(PF_INET, SOCK_DGRAM, 0)) < 0) {
-    TRACE ("Failed to open socket, %d", sock);
-    return(NULL);
+  if (wi_replay_match(interface)) {
+    device = g_new0(struct wi_device, 1);
+    g_strlcpy(device->interface, interface, WI_MAXSTRLEN);
+    wi_timings_init(device->timings);
+    if ((device->replay = wi_replay_open(interface)) == NULL) {
+      g_free(device);
+      return(NULL);
+    }
+    return(device);
   }
 
-  TRACE ("Socket Open for interface %s, %d",interface,sock);
+  if (!_wi_shared_ref())
+    return(NULL);
+
+  TRACE ("Socket Open for interface %s, %d",interface,wi_shared.socket);
   
   device = g_new0(struct wi_device, 1);
-  device->socket = sock;
+  device->socket = wi_shared.socket;
+  device->nl_socket = wi_shared.nl_socket;
+  device->backend = wi_shared.backend;
+  device->bytes_fd[0] = device->bytes_fd[1] = -1;
   g_strlcpy(device->interface, interface, WI_MAXSTRLEN);
+  wi_timings_init(device->timings);
+
+  _wi_load_caps(device);
 
   return(device);
 }
@@ -79,17 +439,52 @@ wi_open(const char *interface)
 void
 wi_close(struct wi_device *device)
 {
-  close(device->socket);
+  if (device->replay != NULL) {
+    wi_replay_close(device->replay);
+    g_free(device);
+    return;
+  }
+
+  _wi_bytes_close(device);
   g_free(device);
+  _wi_shared_unref();
 }
 
-static double
-wi_get_max_quality(struct wi_device *device)
+void
+wi_get_timings(struct wi_device *device, struct wi_timing *timings)
+{
+  memcpy(timings, device->timings, sizeof(device->timings));
+}
+
+void
+wi_invalidate(struct wi_device *device)
+{
+  g_return_if_fail(device != NULL);
+
+  if (device->replay != NULL)
+    return;
+
+  /* the device may have been replugged or replaced by another driver */
+  device->caps.valid = FALSE;
+  device->ifindex = 0;
+  device->backend = wi_shared.backend;
+  _wi_bytes_close(device);
+}
+
+static void
+_wi_load_caps(struct wi_device *device)
 {
   struct iwreq wreq;
-  double max_qual = 92.0;
+  struct ifreq ifr;
+  struct ethtool_drvinfo drvinfo;
   char range_buf[sizeof(struct iw_range) * 2]; // wireless tools says it is
                                               // large enough.
+  unsigned long long begin;
+  int i, result;
+
+  memset(&device->caps, 0, sizeof(device->caps));
+  device->caps.valid = TRUE;
+  device->caps.max_qual = 92.0;
 
   /* Set interface name */
   strncpy(wreq.ifr_name, device->interface, IFNAMSIZ);
@@ -99,44 +494,235 @@ wi_get_max_quality(struct wi_device *device)
   wreq.u.data.pointer = (caddr_t) range_buf;
   wreq.u.data.length = sizeof(range_buf);
   wreq.u.data.flags = 0;
-  if (ioctl(device->socket, SIOCGIWRANGE, &wreq) < 0) {
+  begin = wi_timing_begin();
+  result = ioctl(device->socket, SIOCGIWRANGE, &wreq);
+  wi_timing_end(&device->timings[WI_CALL_RANGE], begin, result < 0);
+  if (result < 0) {
     TRACE ("Couldn't get range information, taking default.");
   } else {
     struct iw_range *range = (struct iw_range *) range_buf;
-    max_qual = range->max_qual.qual;
-    if (max_qual <= 0) {
-      TRACE ("Got a negative value for max_qual, returning to default.");
-      max_qual = 92.0;
+    if (range->max_qual.qual > 0)
+      device->caps.max_qual = range->max_qual.qual;
+    else
+      TRACE ("Got a negative value for max_qual, keeping default.");
+
+    device->caps.dbm = (range->max_qual.updated & IW_QUAL_DBM) != 0;
+    device->caps.num_rates = MIN(range->num_bitrates, IW_MAX_BITRATES);
+    for (i = 0; i < device->caps.num_rates; i++)
+      device->caps.rates[i] = range->bitrate[i] / 1000;
+  }
+
+  /* driver name, e.g. iwlwifi */
+  memset(&ifr, 0, sizeof(ifr));
+  memset(&drvinfo, 0, sizeof(drvinfo));
+  g_strlcpy(ifr.ifr_name, device->interface, IFNAMSIZ);
+  drvinfo.cmd = ETHTOOL_GDRVINFO;
+  ifr.ifr_data = (caddr_t) &drvinfo;
+  begin = wi_timing_begin();
+  result = ioctl(device->socket, SIOCETHTOOL, &ifr);
+  wi_timing_end(&device->timings[WI_CALL_DRIVER], begin, result < 0);
+  if (result == 0 && drvinfo.driver[0] != '\0') {
+    drvinfo.driver[sizeof(drvinfo.driver) - 1] = '\0';
+    g_strlcpy(device->caps.driver, drvinfo.driver, WI_MAXSTRLEN);
+  }
+  else
+    g_strlcpy(device->caps.driver, _("Unknown"), WI_MAXSTRLEN);
+
+  TRACE ("Capabilities of %s: max_qual %f, dBm %d, %d rates, driver %s", device->interface,
+         device->caps.max_qual, device->caps.dbm, device->caps.num_rates, device->caps.driver);
+}
+
+/* convert dBm to percent the same way the BSD backends do */
+static int
+_wi_dbm_to_percent(int dbm)
+{
+  if (dbm <= -100)
+    return(0);
+  else if (dbm >= -50)
+    return(100);
+  else
+    return(2 * (100 + dbm));
+}
+
+/* parse a number of /proc/net/wireless, the trailing dot included */
+static double
+_wi_proc_number(const char **p, const char *end)
+{
+  double value = 0.0, scale = 0.1;
+  gboolean negative = FALSE;
+
+  while (*p < end && (**p == ' ' || **p == '\t'))
+    (*p)++;
+  if (*p < end && **p == '-') {
+    negative = TRUE;
+    (*p)++;
+  }
+  for (; *p < end && **p >= '0' && **p <= '9'; (*p)++)
+    value = value * 10 + (**p - '0');
+  if (*p < end && **p == '.') {
+    for ((*p)++; *p < end && **p >= '0' && **p <= '9'; (*p)++, scale /= 10)
+      value += (**p - '0') * scale;
+  }
+
+  return(negative ? -value : value);
+}
+
+/* split every row of the table in a single pass over the buffer */
+static void
+_wi_proc_parse(const char *p, const char *end)
+{
+  const char *eol, *colon, *name;
+  struct wi_proc_row *row;
+
+  wi_shared.n_proc_rows = 0;
+
+  for (; p < end; p = eol + 1) {
+    if ((eol = memchr(p, '\n', end - p)) == NULL)
+      eol = end;
+
+    /* the header rows have no colon */
+    if ((colon = memchr(p, ':', eol - p)) == NULL)
+      continue;
+    for (name = p; name < colon && *name == ' '; name++);
+    if (colon == name || colon - name >= IFNAMSIZ)
+      continue;
+
+    if (wi_shared.n_proc_rows == wi_shared.proc_rows_size) {
+      wi_shared.proc_rows_size = MAX(8, wi_shared.proc_rows_size * 2);
+      wi_shared.proc_rows = g_renew(struct wi_proc_row, wi_shared.proc_rows,
+                                    wi_shared.proc_rows_size);
+    }
+    row = &wi_shared.proc_rows[wi_shared.n_proc_rows++];
+    memcpy(row->interface, name, colon - name);
+    row->interface[colon - name] = '\0';
+
+    /* skip the status, then link and level */
+    for (p = colon + 1; p < eol && *p == ' '; p++);
+    for (; p < eol && *p != ' '; p++);
+    row->link = _wi_proc_number(&p, eol);
+    row->level = (long) _wi_proc_number(&p, eol);
+  }
+}
+
+/* read the whole table through a descriptor kept open */
+static gboolean
+_wi_proc_read(void)
+{
+  ssize_t n;
+
+  if (wi_shared.proc_fresh)
+    return(TRUE);
+
+  if (wi_shared.proc_fd < 0 &&
+      (wi_shared.proc_fd = open("/proc/net/wireless", O_RDONLY | O_CLOEXEC)) < 0)
+    return(FALSE);
+
+  for (;;) {
+    if (wi_shared.proc_size == 0) {
+      wi_shared.proc_size = 4096;
+      wi_shared.proc_buffer = g_malloc(wi_shared.proc_size);
+    }
+
+    if ((n = pread(wi_shared.proc_fd, wi_shared.proc_buffer, wi_shared.proc_size, 0)) < 0) {
+      if (errno == EINTR)
+        continue;
+      return(FALSE);
+    }
+
+    /* the buffer may have cut the table short */
+    if ((size_t) n < wi_shared.proc_size)
+      break;
+    wi_shared.proc_size *= 2;
+    wi_shared.proc_buffer = g_realloc(wi_shared.proc_buffer, wi_shared.proc_size);
+  }
+
+  _wi_proc_parse(wi_shared.proc_buffer, wi_shared.proc_buffer + n);
+  wi_shared.proc_fresh = TRUE;
+
+  return(TRUE);
+}
+
+static gboolean
+_wi_proc_lookup(struct wi_device *device, double *link, long *level)
+{
+  unsigned long long begin = wi_timing_begin();
+  gboolean found;
+  int i;
+
+  found = _wi_proc_read();
+  wi_timing_end(&device->timings[WI_CALL_PROC], begin, !found);
+  if (!found)
+    return(FALSE);
+
+  for (i = 0; i < wi_shared.n_proc_rows; i++) {
+    if (strcmp(wi_shared.proc_rows[i].interface, device->interface) == 0) {
+      *link = wi_shared.proc_rows[i].link;
+      /* a dBm level is printed signed, the ioctl gives it as a u8 */
+      *level = wi_shared.proc_rows[i].level;
+      if (*level < 0)
+        *level += 256;
+      return(TRUE);
     }
   }
 
-  return max_qual;
+  return(FALSE);
 }
 
-int
-wi_query(struct wi_device *device, struct wi_stats *stats)
+static void
+_wi_bytes_close(struct wi_device *device)
+{
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    if (device->bytes_fd[i] >= 0)
+      close(device->bytes_fd[i]);
+    device->bytes_fd[i] = -1;
+  }
+}
+
+/* read a counter of /sys/class/net/<interface>/statistics, the file
+ * stays open and is read again from the start on every query */
+static gboolean
+_wi_bytes_read(struct wi_device *device, int index, unsigned long long *value)
+{
+  static const char *names[2] = { "rx_bytes", "tx_bytes" };
+  char buffer[32];
+  gchar *path;
+  ssize_t n;
+
+  if (device->bytes_fd[index] < 0) {
+    path = g_strdup_printf("/sys/class/net/%s/statistics/%s",
+                           device->interface, names[index]);
+    device->bytes_fd[index] = open(path, O_RDONLY | O_CLOEXEC);
+    g_free(path);
+    if (device->bytes_fd[index] < 0)
+      return(FALSE);
+  }
+
+  /* the attribute is gone with the interface, reopen next time */
+  if ((n = pread(device->bytes_fd[index], buffer, sizeof(buffer) - 1, 0)) <= 0) {
+    close(device->bytes_fd[index]);
+    device->bytes_fd[index] = -1;
+    return(FALSE);
+  }
+
+  buffer[n] = '\0';
+  *value = g_ascii_strtoull(buffer, NULL, 10);
+  return(TRUE);
+}
+
+static int
+_wi_wext_query(struct wi_device *device, struct wi_stats *stats)
 {
-#if WIRELESS_EXT <= 11
-  char buffer[1024];
-  char *bp;
-  FILE *fp;
-#else
   int result;
-#endif
   double link;
   long level;
-  double max_qual = 92.0;
 
   struct iwreq wreq;
   struct iw_statistics wstats;
   char essid[IW_ESSID_MAX_SIZE + 1];
-
-  g_return_val_if_fail(device != NULL, WI_INVAL);
-  g_return_val_if_fail(stats != NULL, WI_INVAL);
-
-  /* FIXME */
-  g_strlcpy(stats->ws_qunit, "%", 2);
-  g_strlcpy(stats->ws_vendor, _("Unknown"), WI_MAXSTRLEN);
+  unsigned long long begin;
+  gboolean bytes;
 
   /* Set interface name */
   strncpy(wreq.ifr_name, device->interface, IFNAMSIZ);
@@ -145,7 +731,10 @@ wi_query(struct wi_device *device, struct wi_stats *stats)
   wreq.u.essid.pointer = (caddr_t) essid;
   wreq.u.essid.length = IW_ESSID_MAX_SIZE + 1;
   wreq.u.essid.flags = 0;
-  if (ioctl(device->socket, SIOCGIWESSID, &wreq) < 0) {
+  begin = wi_timing_begin();
+  result = ioctl(device->socket, SIOCGIWESSID, &wreq);
+  wi_timing_end(&device->timings[WI_CALL_ESSID], begin, result < 0);
+  if (result < 0) {
     TRACE ("Couldn't get ESSID");
     g_strlcpy(stats->ws_netname, "", WI_MAXSTRLEN);
   } else {
@@ -156,7 +745,10 @@ wi_query(struct wi_device *device, struct wi_stats *stats)
   }
 
   /* Get bit rate */
-  if (ioctl(device->socket, SIOCGIWRATE, &wreq) < 0) {
+  begin = wi_timing_begin();
+  result = ioctl(device->socket, SIOCGIWRATE, &wreq);
+  wi_timing_end(&device->timings[WI_CALL_RATE], begin, result < 0);
+  if (result < 0) {
     TRACE ("Couldn't get bit-rate");
     stats->ws_rate = 0;
   } else {
@@ -165,46 +757,49 @@ wi_query(struct wi_device *device, struct wi_stats *stats)
     stats->ws_rate = wreq.u.bitrate.value / (1000 * 1000);
   }
 
-#if WIRELESS_EXT > 11
-  /* Get interface stats through ioctl */
-  wreq.u.data.pointer = (caddr_t) &wstats;
-  wreq.u.data.length = sizeof(struct iw_statistics);
-  wreq.u.data.flags = 1;
-  if ((result = ioctl(device->socket, SIOCGIWSTATS, &wreq)) < 0) {
-    TRACE ("Returning NOSUCHDEV, got %d for socket %d", result, device->socket);
-    return(WI_NOSUCHDEV);
-  }
-  level = wstats.qual.level;
-  link = wstats.qual.qual;
-
-  max_qual = wi_get_max_quality(device);
-
-#else /* WIRELESS_EXT <= 11 */
-  /* Get interface stats through /proc/net/wireless */
-  if ((fp = fopen("/proc/net/wireless", "r")) == NULL) {
-    return(WI_NOSUCHDEV);
-  }
-
-  for (;;) {
-    if (fgets(buffer, sizeof(buffer), fp) == NULL)
+  if (device->backend == WI_BACKEND_PROC) {
+    if (!_wi_proc_lookup(device, &link, &level))
       return(WI_NOSUCHDEV);
+  }
+  else {
+    /* Get interface stats through ioctl */
+    wreq.u.data.pointer = (caddr_t) &wstats;
+    wreq.u.data.length = sizeof(struct iw_statistics);
+    wreq.u.data.flags = 1;
+    begin = wi_timing_begin();
+    result = ioctl(device->socket, SIOCGIWSTATS, &wreq);
+    wi_timing_end(&device->timings[WI_CALL_STATS], begin, result < 0);
+    if (result < 0) {
+      if (errno == ENODEV || wi_shared.backend != WI_BACKEND_AUTO ||
+          !_wi_proc_lookup(device, &link, &level)) {
+        TRACE ("Returning NOSUCHDEV, got %d for socket %d", result, device->socket);
+        return(WI_NOSUCHDEV);
+      }
+      TRACE ("SIOCGIWSTATS fails for %s, using /proc/net/wireless", device->interface);
+      device->backend = WI_BACKEND_PROC;
+    }
+    else {
+      level = wstats.qual.level;
+      link = wstats.qual.qual;
 
-    if (buffer[6] == ':') {
-      buffer[6] = '\0';
-      for (bp = buffer; isspace(*bp); ++bp);
-
-      if (strcmp(bp, device->interface) != 0)
-        continue;
-
-      /* we found our device, read the stats now */
-      bp = buffer + 12;
-      link = strtod(bp, &bp);
-      level = strtol(bp + 1, &bp, 10);
-      break;
+      /* the same statistics carry the absolute levels, if in dBm */
+      if (device->caps.dbm && (wstats.qual.updated & IW_QUAL_LEVEL_INVALID) == 0) {
+        stats->ws_link.wl_signal = (gint8) wstats.qual.level;
+        stats->ws_link.wl_valid |= WI_LINK_SIGNAL;
+      }
+      if (device->caps.dbm && (wstats.qual.updated & IW_QUAL_NOISE_INVALID) == 0) {
+        stats->ws_link.wl_noise = (gint8) wstats.qual.noise;
+        stats->ws_link.wl_valid |= WI_LINK_NOISE;
+      }
     }
   }
-  fclose(fp);
-#endif
+
+  begin = wi_timing_begin();
+  bytes = _wi_bytes_read(device, 0, &stats->ws_link.wl_rx_bytes) &&
+          _wi_bytes_read(device, 1, &stats->ws_link.wl_tx_bytes);
+  wi_timing_end(&device->timings[WI_CALL_BYTES], begin, !bytes);
+  if (bytes)
+    stats->ws_link.wl_valid |= WI_LINK_BYTES;
 
   /* check if we have a carrier signal */
   /* FIXME: does 0 mean no carrier? */
@@ -212,15 +807,974 @@ wi_query(struct wi_device *device, struct wi_stats *stats)
     return(WI_NOCARRIER);
 
   /* calculate link quality */
-  if (link <= 0)
+  if (link <= 0 && device->caps.dbm)
+    /* some drivers only report the level, which is a signed 8 bit dBm value */
+    stats->ws_quality = _wi_dbm_to_percent((gint8) level);
+  else if (link <= 0)
     stats->ws_quality = 0;
   else {
     /* thanks to google and wireless tools for this hint */
-    stats->ws_quality = (int)rint(log(link) / log(max_qual) * 100.0);
-    TRACE ("Quality: %2f, max quality: %2f", link, max_qual);
+    stats->ws_quality = (int)rint(log(link) / log(device->caps.max_qual) * 100.0);
+    TRACE ("Quality: %2f, max quality: %2f", link, device->caps.max_qual);
   }
 
   return(WI_OK);
 }
 
+struct wi_nl_result
+{
+  struct wi_stats *stats;
+  gboolean have_station;
+  int signal;           /* dBm */
+  int bitrate;          /* 100 kbit/s */
+};
+
+static int
+_wi_freq_to_channel(int freq)
+{
+  if (freq == 2484)
+    return(14);
+  else if (freq >= 2412 && freq < 2484)
+    return((freq - 2407) / 5);
+  else if (freq >= 5955 && freq <= 7115)
+    return((freq - 5950) / 5);
+  else if (freq >= 5000 && freq < 5955)
+    return((freq - 5000) / 5);
+  else if (freq >= 58320 && freq <= 70200)
+    return((freq - 56160) / 2160);
+
+  return(0);
+}
+
+static void
+_wi_nl_interface_cb(struct nlmsghdr *nlh, void *data)
+{
+  struct wi_nl_result *res = data;
+  struct wi_link *link = &res->stats->ws_link;
+  struct nlattr *tb[NL80211_ATTR_MAX + 1];
+  int len;
+
+  _wi_nl_parse_genl(tb, NL80211_ATTR_MAX, nlh);
+  if (tb[NL80211_ATTR_SSID] != NULL) {
+    /* SSID is a binary attribute, not null terminated */
+    len = MIN(WI_NLA_LEN(tb[NL80211_ATTR_SSID]), WI_MAXSTRLEN - 1);
+    memcpy(res->stats->ws_netname, WI_NLA_DATA(tb[NL80211_ATTR_SSID]), len);
+    res->stats->ws_netname[len] = '\0';
+  }
+
+  if (tb[NL80211_ATTR_WIPHY_FREQ] != NULL) {
+    link->wl_frequency = *(guint32 *) WI_NLA_DATA(tb[NL80211_ATTR_WIPHY_FREQ]);
+    link->wl_channel = _wi_freq_to_channel(link->wl_frequency);
+    link->wl_valid |= WI_LINK_FREQUENCY;
+  }
+}
+
+/* a nested NL80211_RATE_INFO_* attribute */
+static void
+_wi_nl_rate(struct nlattr *attr, struct wi_rate *rate)
+{
+  struct nlattr *rinfo[NL80211_RATE_INFO_MAX + 1];
+
+  _wi_nl_parse(rinfo, NL80211_RATE_INFO_MAX, WI_NLA_DATA(attr), WI_NLA_LEN(attr));
+
+  if (rinfo[NL80211_RATE_INFO_BITRATE32] != NULL)
+    rate->wr_bitrate = *(guint32 *) WI_NLA_DATA(rinfo[NL80211_RATE_INFO_BITRATE32]);
+  else if (rinfo[NL80211_RATE_INFO_BITRATE] != NULL)
+    rate->wr_bitrate = *(guint16 *) WI_NLA_DATA(rinfo[NL80211_RATE_INFO_BITRATE]);
+
+  rate->wr_mcs = -1;
+  if (rinfo[NL80211_RATE_INFO_HE_MCS] != NULL) {
+    rate->wr_mcs = *(guint8 *) WI_NLA_DATA(rinfo[NL80211_RATE_INFO_HE_MCS]);
+    if (rinfo[NL80211_RATE_INFO_HE_NSS] != NULL)
+      rate->wr_nss = *(guint8 *) WI_NLA_DATA(rinfo[NL80211_RATE_INFO_HE_NSS]);
+    g_strlcpy(rate->wr_mode, "HE", sizeof(rate->wr_mode));
+  }
+  else if (rinfo[NL80211_RATE_INFO_VHT_MCS] != NULL) {
+    rate->wr_mcs = *(guint8 *) WI_NLA_DATA(rinfo[NL80211_RATE_INFO_VHT_MCS]);
+    if (rinfo[NL80211_RATE_INFO_VHT_NSS] != NULL)
+      rate->wr_nss = *(guint8 *) WI_NLA_DATA(rinfo[NL80211_RATE_INFO_VHT_NSS]);
+    g_strlcpy(rate->wr_mode, "VHT", sizeof(rate->wr_mode));
+  }
+  else if (rinfo[NL80211_RATE_INFO_MCS] != NULL) {
+    /* HT indices count the streams in: 8 per stream */
+    rate->wr_mcs = *(guint8 *) WI_NLA_DATA(rinfo[NL80211_RATE_INFO_MCS]);
+    rate->wr_nss = rate->wr_mcs / 8 + 1;
+    g_strlcpy(rate->wr_mode, "HT", sizeof(rate->wr_mode));
+  }
+
+  /* the width is only flagged when it is not 20 MHz */
+  if (rinfo[NL80211_RATE_INFO_160_MHZ_WIDTH] != NULL ||
+      rinfo[NL80211_RATE_INFO_80P80_MHZ_WIDTH] != NULL)
+    rate->wr_width = 160;
+  else if (rinfo[NL80211_RATE_INFO_80_MHZ_WIDTH] != NULL)
+    rate->wr_width = 80;
+  else if (rinfo[NL80211_RATE_INFO_40_MHZ_WIDTH] != NULL)
+    rate->wr_width = 40;
+  else if (rinfo[NL80211_RATE_INFO_10_MHZ_WIDTH] != NULL)
+    rate->wr_width = 10;
+  else if (rinfo[NL80211_RATE_INFO_5_MHZ_WIDTH] != NULL)
+    rate->wr_width = 5;
+  else if (rate->wr_mcs >= 0)
+    rate->wr_width = 20;
+}
+
+static gboolean
+_wi_nl_u32(struct nlattr **sinfo, int type, unsigned int *value)
+{
+  if (sinfo[type] == NULL)
+    return(FALSE);
+
+  *value = *(guint32 *) WI_NLA_DATA(sinfo[type]);
+  return(TRUE);
+}
+
+/* 64 bit counter, or its 32 bit version from older kernels */
+static gboolean
+_wi_nl_u64(struct nlattr **sinfo, int type, int type32, unsigned long long *value)
+{
+  guint64 v;
+
+  if (sinfo[type] != NULL) {
+    memcpy(&v, WI_NLA_DATA(sinfo[type]), sizeof(v));
+    *value = v;
+    return(TRUE);
+  }
+
+  if (sinfo[type32] == NULL)
+    return(FALSE);
+
+  *value = *(guint32 *) WI_NLA_DATA(sinfo[type32]);
+  return(TRUE);
+}
+
+static void
+_wi_nl_station_cb(struct nlmsghdr *nlh, void *data)
+{
+  struct wi_nl_result *res = data;
+  struct wi_link *link = &res->stats->ws_link;
+  struct nlattr *tb[NL80211_ATTR_MAX + 1];
+  struct nlattr *sinfo[NL80211_STA_INFO_MAX + 1];
+
+  _wi_nl_parse_genl(tb, NL80211_ATTR_MAX, nlh);
+  if (tb[NL80211_ATTR_STA_INFO] == NULL)
+    return;
+
+  /* in managed mode the only station is the access point */
+  _wi_nl_parse(sinfo, NL80211_STA_INFO_MAX, WI_NLA_DATA(tb[NL80211_ATTR_STA_INFO]),
+               WI_NLA_LEN(tb[NL80211_ATTR_STA_INFO]));
+  res->have_station = TRUE;
+
+  if (tb[NL80211_ATTR_MAC] != NULL && WI_NLA_LEN(tb[NL80211_ATTR_MAC]) == WI_HWADDR_LEN) {
+    memcpy(link->wl_bssid, WI_NLA_DATA(tb[NL80211_ATTR_MAC]), WI_HWADDR_LEN);
+    link->wl_valid |= WI_LINK_BSSID;
+  }
+
+  if (sinfo[NL80211_STA_INFO_SIGNAL] != NULL) {
+    res->signal = *(gint8 *) WI_NLA_DATA(sinfo[NL80211_STA_INFO_SIGNAL]);
+    link->wl_signal = res->signal;
+    link->wl_valid |= WI_LINK_SIGNAL;
+  }
+
+  if (sinfo[NL80211_STA_INFO_SIGNAL_AVG] != NULL) {
+    link->wl_signal_avg = *(gint8 *) WI_NLA_DATA(sinfo[NL80211_STA_INFO_SIGNAL_AVG]);
+    link->wl_valid |= WI_LINK_SIGNAL_AVG;
+  }
+
+  if (sinfo[NL80211_STA_INFO_TX_BITRATE] != NULL) {
+    _wi_nl_rate(sinfo[NL80211_STA_INFO_TX_BITRATE], &link->wl_tx_rate);
+    res->bitrate = link->wl_tx_rate.wr_bitrate;
+    link->wl_valid |= WI_LINK_TX_RATE;
+  }
+
+  if (sinfo[NL80211_STA_INFO_RX_BITRATE] != NULL) {
+    _wi_nl_rate(sinfo[NL80211_STA_INFO_RX_BITRATE], &link->wl_rx_rate);
+    link->wl_valid |= WI_LINK_RX_RATE;
+  }
+
+  if (_wi_nl_u32(sinfo, NL80211_STA_INFO_TX_RETRIES, &link->wl_tx_retries))
+    link->wl_valid |= WI_LINK_TX_RETRIES;
+  if (_wi_nl_u32(sinfo, NL80211_STA_INFO_TX_FAILED, &link->wl_tx_failed))
+    link->wl_valid |= WI_LINK_TX_FAILED;
+  if (_wi_nl_u32(sinfo, NL80211_STA_INFO_BEACON_LOSS, &link->wl_beacon_loss))
+    link->wl_valid |= WI_LINK_BEACON_LOSS;
+  if (_wi_nl_u32(sinfo, NL80211_STA_INFO_CONNECTED_TIME, &link->wl_connected_time))
+    link->wl_valid |= WI_LINK_CONNECTED_TIME;
+  if (_wi_nl_u32(sinfo, NL80211_STA_INFO_INACTIVE_TIME, &link->wl_inactive_time))
+    link->wl_valid |= WI_LINK_INACTIVE_TIME;
+
+  /* traffic exchanged with the access point, in the same reply */
+  if (_wi_nl_u64(sinfo, NL80211_STA_INFO_RX_BYTES64, NL80211_STA_INFO_RX_BYTES,
+                 &link->wl_rx_bytes) &&
+      _wi_nl_u64(sinfo, NL80211_STA_INFO_TX_BYTES64, NL80211_STA_INFO_TX_BYTES,
+                 &link->wl_tx_bytes))
+    link->wl_valid |= WI_LINK_BYTES;
+}
+
+static void
+_wi_nl_dispatch_cb(struct nlmsghdr *nlh, void *data)
+{
+  struct genlmsghdr *genl = NLMSG_DATA(nlh);
+
+  if (genl->cmd == NL80211_CMD_NEW_INTERFACE)
+    _wi_nl_interface_cb(nlh, data);
+  else if (genl->cmd == NL80211_CMD_NEW_STATION)
+    _wi_nl_station_cb(nlh, data);
+}
+
+/*
+ * Query SSID, signal, bitrate and the rest of the link details with a
+ * single exchange: a GET_INTERFACE
+ * request and a GET_STATION dump are sent together and their replies
+ * are read back from the persistent socket. The GET_INTERFACE request
+ * is left out if the caller already knows the SSID.
+ */
+static int
+_wi_nl_query(struct wi_device *device, struct wi_stats *stats, gboolean with_interface)
+{
+  struct wi_nl_result res = { .stats = stats };
+  double link;
+  long level;
+  char buffer[256];
+  struct nlmsghdr *nlh;
+  guint32 ifindex, seq;
+  unsigned long long begin;
+  size_t len = 0;
+  int count = 0;
+  int error;
+
+  if (device->ifindex == 0 && (device->ifindex = _wi_ifindex(device)) == 0)
+    return(WI_NOSUCHDEV);
+
+  ifindex = device->ifindex;
+  seq = wi_shared.nl_seq;
+
+  if (with_interface) {
+    nlh = _wi_nl_msg_begin(buffer, len, wi_shared.nl80211_id, NLM_F_ACK, seq + count++,
+                           NL80211_CMD_GET_INTERFACE);
+    _wi_nl_put_attr(nlh, NL80211_ATTR_IFINDEX, &ifindex, sizeof(ifindex));
+    len += NLMSG_ALIGN(nlh->nlmsg_len);
+  }
+
+  nlh = _wi_nl_msg_begin(buffer, len, wi_shared.nl80211_id, NLM_F_DUMP, seq + count++,
+                         NL80211_CMD_GET_STATION);
+  _wi_nl_put_attr(nlh, NL80211_ATTR_IFINDEX, &ifindex, sizeof(ifindex));
+  len += nlh->nlmsg_len;
+
+  wi_shared.nl_seq += count;
+  begin = wi_timing_begin();
+  error = _wi_nl_transact(device->nl_socket, buffer, len, seq, count,
+                          _wi_nl_dispatch_cb, &res);
+  wi_timing_end(&device->timings[WI_CALL_NL80211], begin, error < 0);
+  if (error == -ENODEV) {
+    /* the interface is gone, was renamed/replugged, or is not cfg80211 */
+    if ((device->ifindex = _wi_ifindex(device)) == 0)
+      return(WI_NOSUCHDEV);
+    if ((guint32) device->ifindex != ifindex)
+      return(_wi_nl_query(device, stats, with_interface));
+    return(WI_NL_FALLBACK);
+  }
+  else if (error == -EOPNOTSUPP) {
+    return(WI_NL_FALLBACK);
+  }
+  else if (error < 0) {
+    TRACE ("nl80211 query failed, %d", error);
+    return(WI_NOSUCHDEV);
+  }
+
+  if (!res.have_station)
+    return(WI_NOCARRIER);
+
+  /* bitrate is in 100kb/s, transform to Mb/s */
+  stats->ws_rate = res.bitrate / 10;
+
+  if (stats->ws_link.wl_valid & WI_LINK_SIGNAL)
+    stats->ws_quality = _wi_dbm_to_percent(res.signal);
+  else if (_wi_proc_lookup(device, &link, &level) && level > 0)
+    /* cfg80211 prints the level of /proc/net/wireless in dBm */
+    stats->ws_quality = _wi_dbm_to_percent((gint8) level);
+  else
+    stats->ws_quality = 0;
+
+  return(WI_OK);
+}
+
+static void
+_wi_query_begin(struct wi_device *device, struct wi_stats *stats)
+{
+  if (!device->caps.valid)
+    _wi_load_caps(device);
+
+  /* FIXME */
+  g_strlcpy(stats->ws_qunit, "%", 2);
+  g_strlcpy(stats->ws_vendor, device->caps.driver, WI_MAXSTRLEN);
+  g_strlcpy(stats->ws_netname, "", WI_MAXSTRLEN);
+  memset(&stats->ws_link, 0, sizeof(stats->ws_link));
+}
+
+static int
+_wi_query(struct wi_device *device, struct wi_stats *stats, gboolean with_interface)
+{
+  int result;
+
+  if (device->backend == WI_BACKEND_AUTO || device->backend == WI_BACKEND_NL80211) {
+    if (device->nl_socket >= 0 &&
+        (result = _wi_nl_query(device, stats, with_interface)) != WI_NL_FALLBACK)
+      return(result);
+
+    if (wi_shared.backend == WI_BACKEND_NL80211)
+      return(WI_NOSUCHDEV);
+
+    TRACE ("nl80211 does not handle %s, using wireless extensions", device->interface);
+    device->backend = WI_BACKEND_WEXT;
+  }
+
+  return(_wi_wext_query(device, stats));
+}
+
+/* the query of a device, once _wi_query_begin() reset its stats */
+static int
+_wi_query_timed(struct wi_device *device, struct wi_stats *stats, gboolean with_interface)
+{
+  unsigned long long begin = wi_timing_begin();
+  int result;
+
+  if (device->replay != NULL)
+    result = wi_replay_query(device->replay, stats);
+  else
+    result = _wi_query(device, stats, with_interface);
+
+  wi_timing_end(&device->timings[WI_CALL_QUERY], begin, result < WI_NOCARRIER);
+
+  return(result);
+}
+
+int
+wi_query(struct wi_device *device, struct wi_stats *stats)
+{
+  g_return_val_if_fail(device != NULL, WI_INVAL);
+  g_return_val_if_fail(stats != NULL, WI_INVAL);
+
+  if (device->replay == NULL) {
+    wi_shared.proc_fresh = FALSE;
+    _wi_query_begin(device, stats);
+  }
+
+  return(_wi_query_timed(device, stats, TRUE));
+}
+
+struct wi_nl_batch
+{
+  struct wi_device **devices;
+  struct wi_stats *stats;
+  int count;
+};
+
+static void
+_wi_nl_interface_dump_cb(struct nlmsghdr *nlh, void *data)
+{
+  struct wi_nl_batch *batch = data;
+  struct wi_nl_result res;
+  struct nlattr *tb[NL80211_ATTR_MAX + 1];
+  int ifindex, i;
+
+  _wi_nl_parse_genl(tb, NL80211_ATTR_MAX, nlh);
+  if (tb[NL80211_ATTR_IFINDEX] == NULL)
+    return;
+
+  ifindex = *(guint32 *) WI_NLA_DATA(tb[NL80211_ATTR_IFINDEX]);
+  for (i = 0; i < batch->count; i++) {
+    if (batch->devices[i] != NULL && batch->devices[i]->ifindex == ifindex) {
+      memset(&res, 0, sizeof(res));
+      res.stats = &batch->stats[i];
+      _wi_nl_interface_cb(nlh, &res);
+    }
+  }
+}
+
+/*
+ * Query several devices at once. The SSIDs of all nl80211 interfaces
+ * come from a single GET_INTERFACE dump, after which only the station
+ * information is requested per device. Every query goes through the
+ * shared sockets.
+ */
+void
+wi_query_many(struct wi_device **devices, struct wi_stats *stats, int *results, int count)
+{
+  struct wi_nl_batch batch = { devices, stats, count };
+  struct wi_device *first = NULL;
+  char buffer[64];
+  struct nlmsghdr *nlh;
+  gboolean dumped = FALSE;
+  unsigned long long begin;
+  guint32 seq;
+  int i;
+
+  g_return_if_fail(devices != NULL && stats != NULL && results != NULL);
+
+  /* one read of /proc/net/wireless serves every device */
+  wi_shared.proc_fresh = FALSE;
+
+  for (i = 0; i < count; i++) {
+    if (devices[i] == NULL || devices[i]->replay != NULL)
+      continue;
+    _wi_query_begin(devices[i], &stats[i]);
+    if (devices[i]->ifindex == 0)
+      devices[i]->ifindex = _wi_ifindex(devices[i]);
+    if (first == NULL)
+      first = devices[i];
+  }
+
+  /* the dump serves the whole batch, it is charged to its first device */
+  if (count > 1 && first != NULL && wi_shared.nl_socket >= 0) {
+    seq = wi_shared.nl_seq++;
+    nlh = _wi_nl_msg_begin(buffer, 0, wi_shared.nl80211_id, NLM_F_DUMP, seq,
+                           NL80211_CMD_GET_INTERFACE);
+    begin = wi_timing_begin();
+    dumped = _wi_nl_transact(wi_shared.nl_socket, buffer, nlh->nlmsg_len, seq, 1,
+                             _wi_nl_interface_dump_cb, &batch) == 0;
+    wi_timing_end(&first->timings[WI_CALL_NL80211_DUMP], begin, !dumped);
+  }
+
+  for (i = 0; i < count; i++) {
+    if (devices[i] == NULL)
+      results[i] = WI_INVAL;
+    else
+      results[i] = _wi_query_timed(devices[i], &stats[i], !dumped);
+  }
+}
+
+static void
+_wi_names_add(GPtrArray *names, const char *name)
+{
+  guint i;
+
+  /* a handful of radios at most, a linear scan is enough */
+  for (i = 0; i < names->len; i++)
+    if (strcmp(g_ptr_array_index(names, i), name) == 0)
+      return;
+
+  g_ptr_array_add(names, g_strdup(name));
+}
+
+static gint
+_wi_names_compare(gconstpointer a, gconstpointer b)
+{
+  return(strcmp(*(const char * const *) a, *(const char * const *) b));
+}
+
+static void
+_wi_nl_name_cb(struct nlmsghdr *nlh, void *data)
+{
+  struct nlattr *tb[NL80211_ATTR_MAX + 1];
+  char ifname[IFNAMSIZ];
+
+  _wi_nl_parse_genl(tb, NL80211_ATTR_MAX, nlh);
+
+  /* P2P and NAN devices have no network interface */
+  if (tb[NL80211_ATTR_IFNAME] == NULL)
+    return;
+
+  g_strlcpy(ifname, WI_NLA_DATA(tb[NL80211_ATTR_IFNAME]),
+            MIN(WI_NLA_LEN(tb[NL80211_ATTR_IFNAME]), IFNAMSIZ));
+  _wi_names_add(data, ifname);
+}
+
+/* the interfaces of /proc/net/wireless, read apart from the table the
+ * queries share */
+static gboolean
+_wi_proc_names(GPtrArray *names)
+{
+  const char *p, *end, *eol, *colon, *name;
+  char ifname[IFNAMSIZ];
+  gchar *contents;
+  gsize length;
+
+  if (!g_file_get_contents("/proc/net/wireless", &contents, &length, NULL))
+    return(FALSE);
+
+  for (p = contents, end = contents + length; p < end; p = eol + 1) {
+    if ((eol = memchr(p, '\n', end - p)) == NULL)
+      eol = end;
+
+    /* the header rows have no colon */
+    if ((colon = memchr(p, ':', eol - p)) == NULL)
+      continue;
+    for (name = p; name < colon && *name == ' '; name++);
+    if (colon == name || colon - name >= IFNAMSIZ)
+      continue;
+
+    memcpy(ifname, name, colon - name);
+    ifname[colon - name] = '\0';
+    _wi_names_add(names, ifname);
+  }
+
+  g_free(contents);
+  return(TRUE);
+}
+
+/*
+ * List the wireless interfaces without walking every link of the
+ * system: nl80211 and /proc/net/wireless only report radios. sysfs is
+ * scanned only when neither of them is available.
+ *
+ * The listing may run beside a query of the open devices, so it uses
+ * a socket of its own rather than the shared ones.
+ */
+char **
+wi_list_interfaces(void)
+{
+  GPtrArray *names = g_ptr_array_new();
+  struct wi_nl_family family;
+  gboolean listed = FALSE;
+  char buffer[64];
+  struct nlmsghdr *nlh;
+  DIR *dir;
+  struct dirent *entry;
+  int sock;
+
+  if ((sock = _wi_nl_open(&family)) >= 0) {
+    nlh = _wi_nl_msg_begin(buffer, 0, family.id, NLM_F_DUMP, 2, NL80211_CMD_GET_INTERFACE);
+    listed = _wi_nl_transact(sock, buffer, nlh->nlmsg_len, 2, 1, _wi_nl_name_cb, names) == 0;
+    close(sock);
+  }
+
+  /* drivers without cfg80211 only show up in the wireless extensions */
+  if (_wi_proc_names(names))
+    listed = TRUE;
+
+  if (!listed && (dir = opendir("/sys/class/net")) != NULL) {
+    while ((entry = readdir(dir)) != NULL) {
+      if (entry->d_name[0] != '.' && wi_is_wireless(entry->d_name))
+        g_ptr_array_add(names, g_strdup(entry->d_name));
+    }
+    closedir(dir);
+  }
+
+  g_ptr_array_sort(names, _wi_names_compare);
+  g_ptr_array_add(names, NULL);
+
+  return((char **) g_ptr_array_free(names, FALSE));
+}
+
+void
+wi_free_interfaces(char **names)
+{
+  g_strfreev(names);
+}
+
+int
+wi_is_wireless(const char *interface)
+{
+  char path[64 + IFNAMSIZ];
+
+  g_return_val_if_fail(interface != NULL, FALSE);
+
+  if (*interface == '\0' || strchr(interface, '/') != NULL || strlen(interface) >= IFNAMSIZ)
+    return(FALSE);
+
+  /* cfg80211 drivers link their phy, the others only have wireless/ */
+  g_snprintf(path, sizeof(path), "/sys/class/net/%s/phy80211", interface);
+  if (access(path, F_OK) == 0)
+    return(TRUE);
+
+  g_snprintf(path, sizeof(path), "/sys/class/net/%s/wireless", interface);
+  return(access(path, F_OK) == 0);
+}
+
+/* the interface, metric and gateway of a default route of the main
+ * table; gateway is set to NULL for a route without one */
+static gboolean
+_wi_route_parse(struct nlmsghdr *nlh, int *ifindex, guint32 *metric, struct nlattr **gateway)
+{
+  struct rtmsg *rtm = NLMSG_DATA(nlh);
+  struct nlattr *tb[RTA_MAX + 1];
+  guint32 table;
+
+  if ((nlh->nlmsg_type != RTM_NEWROUTE && nlh->nlmsg_type != RTM_DELROUTE) ||
+      nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*rtm)) ||
+      rtm->rtm_dst_len != 0 || rtm->rtm_type != RTN_UNICAST)
+    return(FALSE);
+
+  /* struct rtattr and struct nlattr share the same layout */
+  _wi_nl_parse(tb, RTA_MAX, (struct nlattr *) RTM_RTA(rtm), (int) RTM_PAYLOAD(nlh));
+
+  table = (tb[RTA_TABLE] != NULL) ? *(guint32 *) WI_NLA_DATA(tb[RTA_TABLE]) : rtm->rtm_table;
+  if (table != RT_TABLE_MAIN || tb[RTA_OIF] == NULL)
+    return(FALSE);
+
+  *ifindex = *(gint32 *) WI_NLA_DATA(tb[RTA_OIF]);
+  *metric = (tb[RTA_PRIORITY] != NULL) ? *(guint32 *) WI_NLA_DATA(tb[RTA_PRIORITY]) : 0;
+  *gateway = tb[RTA_GATEWAY];
+
+  return(TRUE);
+}
+
+struct wi_route
+{
+  int socket;
+  int ifindex;                  /* only routes through it, 0 for any radio */
+  char interface[IFNAMSIZ];
+  char gateway[INET6_ADDRSTRLEN];
+  guint32 metric;
+  gboolean found;
+};
+
+static void
+_wi_route_cb(struct nlmsghdr *nlh, void *data)
+{
+  struct wi_route *route = data;
+  struct rtmsg *rtm = NLMSG_DATA(nlh);
+  struct nlattr *gateway;
+  struct ifreq ifr;
+  guint32 metric;
+  int ifindex;
+
+  if (!_wi_route_parse(nlh, &ifindex, &metric, &gateway) ||
+      (route->found && metric >= route->metric))
+    return;
+
+  if (route->ifindex != 0) {
+    if (ifindex != route->ifindex || gateway == NULL ||
+        WI_NLA_LEN(gateway) != (rtm->rtm_family == AF_INET6 ? 16 : 4) ||
+        inet_ntop(rtm->rtm_family, WI_NLA_DATA(gateway), route->gateway,
+                  sizeof(route->gateway)) == NULL)
+      return;
+  }
+  else {
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_ifindex = ifindex;
+    if (ioctl(route->socket, SIOCGIFNAME, &ifr) < 0 || !wi_is_wireless(ifr.ifr_name))
+      return;
+    g_strlcpy(route->interface, ifr.ifr_name, IFNAMSIZ);
+  }
+
+  route->metric = metric;
+  route->found = TRUE;
+}
+
+/* look for the best default route in a dump of the routing tables */
+static gboolean
+_wi_route_dump(struct wi_route *route)
+{
+  struct sockaddr_nl local = { .nl_family = AF_NETLINK };
+  struct
+  {
+    struct nlmsghdr nlh;
+    struct rtmsg rtm;
+  } request;
+  int sock;
+
+  if ((sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE)) < 0)
+    return(FALSE);
+  if (bind(sock, (struct sockaddr *) &local, sizeof(local)) < 0) {
+    close(sock);
+    return(FALSE);
+  }
+
+  memset(&request, 0, sizeof(request));
+  request.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(request.rtm));
+  request.nlh.nlmsg_type = RTM_GETROUTE;
+  request.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  request.nlh.nlmsg_seq = 1;
+  request.rtm.rtm_family = AF_UNSPEC;
+
+  _wi_nl_transact(sock, (char *) &request, request.nlh.nlmsg_len, 1, 1, _wi_route_cb, route);
+  close(sock);
+
+  return(route->found);
+}
+
+/*
+ * Find the radio the traffic would leave through: the wireless interface
+ * of the IPv4 or IPv6 default route with the lowest metric. Routes over
+ * other links are ignored, so a wired connection does not hide the radio
+ * that takes over when it goes down.
+ */
+int
+wi_get_route_interface(char *interface, size_t len)
+{
+  struct wi_route route;
+  gboolean found;
+
+  g_return_val_if_fail(interface != NULL && len > 0, WI_INVAL);
+
+  memset(&route, 0, sizeof(route));
+  if ((route.socket = socket(PF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0)
+    return(WI_NOSUCHDEV);
+
+  found = _wi_route_dump(&route);
+  close(route.socket);
+
+  if (!found)
+    return(WI_NOSUCHDEV);
+
+  g_strlcpy(interface, route.interface, len);
+  return(WI_OK);
+}
+
+/* the next hop of the default route through an interface, as text */
+int
+wi_get_gateway(const char *interface, char *address, size_t len)
+{
+  struct wi_route route;
+  struct ifreq ifr;
+  int sock, result;
+
+  g_return_val_if_fail(interface != NULL && address != NULL && len > 0, WI_INVAL);
+
+  if ((sock = socket(PF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0)
+    return(WI_NOSUCHDEV);
+
+  memset(&ifr, 0, sizeof(ifr));
+  g_strlcpy(ifr.ifr_name, interface, IFNAMSIZ);
+  result = ioctl(sock, SIOCGIFINDEX, &ifr);
+  close(sock);
+  if (result < 0)
+    return(WI_NOSUCHDEV);
+
+  memset(&route, 0, sizeof(route));
+  route.socket = -1;
+  route.ifindex = ifr.ifr_ifindex;
+  if (!_wi_route_dump(&route))
+    return(WI_NOSUCHDEV);
+
+  g_strlcpy(address, route.gateway, len);
+  return(WI_OK);
+}
+
+int
+wi_get_hwaddr(const char *interface, unsigned char *hwaddr)
+{
+  struct ifreq ifr;
+  int sock, result;
+
+  g_return_val_if_fail(interface != NULL && hwaddr != NULL, WI_INVAL);
+
+  /* may run beside a query, so the shared socket is not used */
+  if ((sock = socket(PF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0)
+    return(WI_NOSUCHDEV);
+
+  memset(&ifr, 0, sizeof(ifr));
+  g_strlcpy(ifr.ifr_name, interface, IFNAMSIZ);
+  result = ioctl(sock, SIOCGIFHWADDR, &ifr);
+  close(sock);
+
+  if (result < 0)
+    return(WI_NOSUCHDEV);
+
+  memcpy(hwaddr, ifr.ifr_hwaddr.sa_data, WI_HWADDR_LEN);
+  return(WI_OK);
+}
+
+struct wi_monitor
+{
+  int epoll;
+  int rt_socket;
+  int nl_socket;
+  int socket;
+
+  /* last name seen for each interface index, to report renames */
+  GHashTable *names;
+};
+
+struct wi_monitor *
+wi_monitor_open(void)
+{
+  struct wi_monitor *monitor;
+  struct sockaddr_nl local = { .nl_family = AF_NETLINK, .nl_groups = RTMGRP_LINK |
+                                                     RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE };
+  struct epoll_event ev = { .events = EPOLLIN };
+  struct wi_nl_family family;
+
+  monitor = g_new0(struct wi_monitor, 1);
+  monitor->rt_socket = -1;
+  monitor->nl_socket = -1;
+  monitor->socket = -1;
+  monitor->names = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+  if ((monitor->epoll = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    g_hash_table_destroy(monitor->names);
+    g_free(monitor);
+    return(NULL);
+  }
+
+  /* link add/remove, operstate and default route changes */
+  if ((monitor->rt_socket = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                                   NETLINK_ROUTE)) < 0 ||
+      bind(monitor->rt_socket, (struct sockaddr *) &local, sizeof(local)) < 0) {
+    TRACE ("Failed to open rtnetlink socket");
+    wi_monitor_close(monitor);
+    return(NULL);
+  }
+  ev.data.fd = monitor->rt_socket;
+  epoll_ctl(monitor->epoll, EPOLL_CTL_ADD, monitor->rt_socket, &ev);
+
+  /* association, disassociation and roaming; optional */
+  if ((monitor->nl_socket = _wi_nl_open(&family)) >= 0) {
+    if (family.mlme_group != 0)
+      setsockopt(monitor->nl_socket, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+                 &family.mlme_group, sizeof(family.mlme_group));
+    if (family.config_group != 0)
+      setsockopt(monitor->nl_socket, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+                 &family.config_group, sizeof(family.config_group));
+    ev.data.fd = monitor->nl_socket;
+    epoll_ctl(monitor->epoll, EPOLL_CTL_ADD, monitor->nl_socket, &ev);
+  }
+
+  /* only used to map interface indices to names */
+  monitor->socket = socket(PF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+  return(monitor);
+}
+
+void
+wi_monitor_close(struct wi_monitor *monitor)
+{
+  if (monitor->nl_socket >= 0)
+    close(monitor->nl_socket);
+  if (monitor->rt_socket >= 0)
+    close(monitor->rt_socket);
+  if (monitor->socket >= 0)
+    close(monitor->socket);
+  close(monitor->epoll);
+  g_hash_table_destroy(monitor->names);
+  g_free(monitor);
+}
+
+int
+wi_monitor_get_fd(struct wi_monitor *monitor)
+{
+  return(monitor->epoll);
+}
+
+static void
+_wi_monitor_rt_event(struct wi_monitor *monitor, struct nlmsghdr *nlh,
+                     wi_monitor_func func, void *data)
+{
+  struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+  struct nlattr *tb[IFLA_MAX + 1];
+  struct nlattr *gateway;
+  char ifname[IFNAMSIZ];
+  struct ifreq ifr;
+  const gchar *known;
+  gpointer key;
+  guint32 metric;
+  int len;
+
+  /* the traffic moved to another interface */
+  if (nlh->nlmsg_type == RTM_NEWROUTE || nlh->nlmsg_type == RTM_DELROUTE) {
+    memset(&ifr, 0, sizeof(ifr));
+    if (_wi_route_parse(nlh, &ifr.ifr_ifindex, &metric, &gateway) &&
+        monitor->socket >= 0 && ioctl(monitor->socket, SIOCGIFNAME, &ifr) == 0)
+      func(ifr.ifr_name, WI_EVENT_ROUTE, data);
+    return;
+  }
+
+  if (nlh->nlmsg_type != RTM_NEWLINK && nlh->nlmsg_type != RTM_DELLINK)
+    return;
+
+  /* struct rtattr and struct nlattr share the same layout */
+  _wi_nl_parse(tb, IFLA_MAX, (struct nlattr *) IFLA_RTA(ifi), (int) IFLA_PAYLOAD(nlh));
+
+  /* wireless extension events arrive as RTM_NEWLINK as well, nl80211
+   * reports the ones we are interested in */
+  if (tb[IFLA_WIRELESS] != NULL || tb[IFLA_IFNAME] == NULL)
+    return;
+
+  len = MIN(WI_NLA_LEN(tb[IFLA_IFNAME]), IFNAMSIZ);
+  g_strlcpy(ifname, WI_NLA_DATA(tb[IFLA_IFNAME]), len);
+
+  /* a renamed link only shows up under its new name, the old one is
+   * reported gone first */
+  key = GINT_TO_POINTER(ifi->ifi_index);
+  known = g_hash_table_lookup(monitor->names, key);
+  if (nlh->nlmsg_type == RTM_DELLINK) {
+    g_hash_table_remove(monitor->names, key);
+  }
+  else if (g_strcmp0(known, ifname) != 0) {
+    if (known != NULL)
+      func(known, WI_EVENT_GONE, data);
+    g_hash_table_insert(monitor->names, key, g_strdup(ifname));
+  }
+
+  func(ifname, nlh->nlmsg_type == RTM_DELLINK ? WI_EVENT_GONE : WI_EVENT_LINK, data);
+}
+
+static void
+_wi_monitor_nl_event(struct wi_monitor *monitor, struct nlmsghdr *nlh,
+                     wi_monitor_func func, void *data)
+{
+  struct genlmsghdr *genl = NLMSG_DATA(nlh);
+  struct nlattr *tb[NL80211_ATTR_MAX + 1];
+  struct ifreq ifr;
+
+  switch (genl->cmd) {
+  case NL80211_CMD_CONNECT:
+  case NL80211_CMD_DISCONNECT:
+  case NL80211_CMD_ROAM:
+  case NL80211_CMD_ASSOCIATE:
+  case NL80211_CMD_DISASSOCIATE:
+  case NL80211_CMD_DEAUTHENTICATE:
+  case NL80211_CMD_NEW_INTERFACE:
+  case NL80211_CMD_DEL_INTERFACE:
+  case NL80211_CMD_SET_INTERFACE:
+  case NL80211_CMD_CH_SWITCH_NOTIFY:
+    break;
+  default:
+    return;
+  }
+
+  _wi_nl_parse_genl(tb, NL80211_ATTR_MAX, nlh);
+  if (tb[NL80211_ATTR_IFINDEX] == NULL)
+    return;
+
+  memset(&ifr, 0, sizeof(ifr));
+  ifr.ifr_ifindex = *(guint32 *) WI_NLA_DATA(tb[NL80211_ATTR_IFINDEX]);
+  if (tb[NL80211_ATTR_IFNAME] != NULL)
+    g_strlcpy(ifr.ifr_name, WI_NLA_DATA(tb[NL80211_ATTR_IFNAME]), IFNAMSIZ);
+  else if (monitor->socket < 0 || ioctl(monitor->socket, SIOCGIFNAME, &ifr) < 0)
+    return;
+
+  func(ifr.ifr_name, WI_EVENT_ASSOC, data);
+}
+
+/*
+ * Drain all pending notifications without blocking and report them to
+ * func. If the kernel dropped messages, func is called once with a NULL
+ * interface, meaning that every interface should be refreshed.
+ */
+void
+wi_monitor_dispatch(struct wi_monitor *monitor, wi_monitor_func func, void *data)
+{
+  char buffer[WI_NL_BUFSIZE];
+  struct nlmsghdr *nlh;
+  int socks[2] = { monitor->rt_socket, monitor->nl_socket };
+  unsigned i;
+  int n;
+
+  g_return_if_fail(func != NULL);
+
+  for (i = 0; i < G_N_ELEMENTS(socks); i++) {
+    if (socks[i] < 0)
+      continue;
+
+    for (;;) {
+      if ((n = recv(socks[i], buffer, sizeof(buffer), MSG_DONTWAIT)) < 0) {
+        if (errno == EINTR)
+          continue;
+        if (errno == ENOBUFS)
+          func(NULL, WI_EVENT_LINK | WI_EVENT_ASSOC, data);
+        break;
+      }
+
+      for (nlh = (struct nlmsghdr *) buffer; NLMSG_OK(nlh, n); nlh = NLMSG_NEXT(nlh, n)) {
+        if (socks[i] == monitor->rt_socket)
+          _wi_monitor_rt_event(monitor, nlh, func, data);
+        else
+          _wi_monitor_nl_event(monitor, nlh, func, data);
+      }
+    }
+  }
+}
+
 #endif  /* !defined(__linux__) */
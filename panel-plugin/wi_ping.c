@@ -0,0 +1,345 @@
+/* Copyright (c) 2025 The Xfce development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Round trip probes to a host, normally the default gateway.
+ *
+ * An ICMP echo request is sent from an unprivileged datagram socket
+ * where the system allows it (Linux with net.ipv4.ping_group_range,
+ * the BSDs and macOS); otherwise a UDP datagram is sent to a port
+ * nobody listens on and the port unreachable error coming back is
+ * taken as the answer. The socket is non-blocking and connected, so
+ * the caller only has to watch wi_ping_get_fd() and call
+ * wi_ping_dispatch() when it becomes readable.
+ *
+ * Only one probe is in flight: a probe still unanswered when the next
+ * one is sent counts as lost. The statistics cover the last
+ * WI_PING_WINDOW probes.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <wi.h>
+
+/* first port tried by traceroute, unlikely to be open */
+#define WI_PING_PORT      "33434"
+
+#define WI_ICMP_ECHO      8
+#define WI_ICMP_REPLY     0
+#define WI_ICMP6_ECHO     128
+#define WI_ICMP6_REPLY    129
+
+struct wi_icmp
+{
+  uint8_t type;
+  uint8_t code;
+  uint16_t checksum;
+  uint16_t id;
+  uint16_t seq;
+  uint8_t payload[8];
+};
+
+struct wi_ping
+{
+  int fd;
+  int family;
+  int icmp;                     /* echo requests, else UDP */
+  char address[WI_MAXSTRLEN];
+
+  uint16_t seq;
+  int pending;                  /* a probe is in flight */
+  int64_t sent;                 /* monotonic us it was sent */
+
+  int rtts[WI_PING_WINDOW];     /* us, -1 if lost, oldest at head */
+  int head;
+  int count;
+};
+
+static int64_t
+_wi_ping_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return((int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+static uint16_t
+_wi_ping_checksum(const void *data, size_t len)
+{
+  const uint8_t *p = data;
+  uint32_t sum = 0;
+  size_t i;
+
+  for (i = 0; i + 1 < len; i += 2)
+    sum += (p[i] << 8) | p[i + 1];
+  if (len & 1)
+    sum += p[len - 1] << 8;
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+
+  return(htons(~sum & 0xffff));
+}
+
+static void
+_wi_ping_record(struct wi_ping *ping, int rtt)
+{
+  ping->rtts[(ping->head + ping->count) % WI_PING_WINDOW] = rtt;
+  if (ping->count < WI_PING_WINDOW)
+    ping->count++;
+  else
+    ping->head = (ping->head + 1) % WI_PING_WINDOW;
+  ping->pending = 0;
+}
+
+/* address is numeric, IPv6 link-local ones with their %interface */
+struct wi_ping *
+wi_ping_open(const char *address)
+{
+  struct addrinfo hints, *res = NULL;
+  struct wi_ping *ping;
+  int flags;
+
+  if (address == NULL)
+    return(NULL);
+
+  /* never a name, resolving could block */
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+  if (getaddrinfo(address, WI_PING_PORT, &hints, &res) != 0)
+    return(NULL);
+
+  if (res->ai_family != AF_INET && res->ai_family != AF_INET6) {
+    freeaddrinfo(res);
+    return(NULL);
+  }
+
+  if ((ping = calloc(1, sizeof(*ping))) == NULL) {
+    freeaddrinfo(res);
+    return(NULL);
+  }
+  ping->family = res->ai_family;
+  strncpy(ping->address, address, sizeof(ping->address) - 1);
+
+  ping->fd = socket(ping->family, SOCK_DGRAM,
+                    ping->family == AF_INET ? IPPROTO_ICMP : IPPROTO_ICMPV6);
+  if (ping->fd >= 0) {
+    ping->icmp = 1;
+    if (ping->family == AF_INET)
+      ((struct sockaddr_in *) res->ai_addr)->sin_port = 0;
+    else
+      ((struct sockaddr_in6 *) res->ai_addr)->sin6_port = 0;
+  }
+  else
+    ping->fd = socket(ping->family, SOCK_DGRAM, IPPROTO_UDP);
+
+  if (ping->fd < 0 ||
+      (flags = fcntl(ping->fd, F_GETFL)) < 0 ||
+      fcntl(ping->fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+      fcntl(ping->fd, F_SETFD, FD_CLOEXEC) < 0 ||
+      connect(ping->fd, res->ai_addr, res->ai_addrlen) < 0) {
+    if (ping->fd >= 0)
+      close(ping->fd);
+    free(ping);
+    freeaddrinfo(res);
+    return(NULL);
+  }
+
+  freeaddrinfo(res);
+  return(ping);
+}
+
+void
+wi_ping_close(struct wi_ping *ping)
+{
+  if (ping == NULL)
+    return;
+
+  close(ping->fd);
+  free(ping);
+}
+
+int
+wi_ping_get_fd(struct wi_ping *ping)
+{
+  return(ping->fd);
+}
+
+const char *
+wi_ping_get_address(struct wi_ping *ping)
+{
+  return(ping->address);
+}
+
+/* send the next probe, the previous one is lost if still in flight */
+int
+wi_ping_send(struct wi_ping *ping)
+{
+  struct wi_icmp icmp;
+  ssize_t n;
+
+  if (ping->pending)
+    _wi_ping_record(ping, -1);
+
+  memset(&icmp, 0, sizeof(icmp));
+  ping->seq++;
+  if (ping->icmp) {
+    /* Linux replaces the identifier with the socket's own */
+    icmp.type = (ping->family == AF_INET) ? WI_ICMP_ECHO : WI_ICMP6_ECHO;
+    icmp.id = htons(getpid() & 0xffff);
+    icmp.seq = htons(ping->seq);
+    /* the kernel computes the ICMPv6 one, which covers the IP header */
+    if (ping->family == AF_INET)
+      icmp.checksum = _wi_ping_checksum(&icmp, sizeof(icmp));
+  }
+  else
+    icmp.seq = htons(ping->seq);
+
+  ping->sent = _wi_ping_now();
+  do
+    n = send(ping->fd, &icmp, sizeof(icmp), 0);
+  while (n < 0 && errno == EINTR);
+
+  if (n < 0) {
+    _wi_ping_record(ping, -1);
+    return(WI_NOSUCHDEV);
+  }
+
+  ping->pending = 1;
+  return(WI_OK);
+}
+
+/* whether a datagram read from an echo socket answers the probe */
+static int
+_wi_ping_is_reply(struct wi_ping *ping, const uint8_t *p, ssize_t n)
+{
+  struct wi_icmp icmp;
+  size_t header;
+
+  /* macOS passes the IPv4 header along */
+  if (ping->family == AF_INET && n >= 20 && (p[0] >> 4) == 4) {
+    header = (p[0] & 0x0f) * 4;
+    if ((size_t) n < header)
+      return(0);
+    p += header;
+    n -= header;
+  }
+
+  if (n < 8)
+    return(0);
+  memcpy(&icmp, p, 8);
+
+  return(icmp.type == (ping->family == AF_INET ? WI_ICMP_REPLY : WI_ICMP6_REPLY) &&
+         ntohs(icmp.seq) == ping->seq);
+}
+
+/* read whatever arrived, returns 1 if the probe in flight completed */
+int
+wi_ping_dispatch(struct wi_ping *ping)
+{
+  uint8_t buffer[256];
+  int64_t now;
+  ssize_t n;
+  int done = 0;
+
+  for (;;) {
+    n = recv(ping->fd, buffer, sizeof(buffer), 0);
+    now = _wi_ping_now();
+
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    if (!ping->pending)
+      continue;
+
+    if (n < 0) {
+      /* the UDP probe was refused, which is the answer; any other
+       * error means it never got there */
+      if (!ping->icmp && errno == ECONNREFUSED)
+        _wi_ping_record(ping, (int) (now - ping->sent));
+      else
+        _wi_ping_record(ping, -1);
+      done = 1;
+    }
+    else if (!ping->icmp || _wi_ping_is_reply(ping, buffer, n)) {
+      _wi_ping_record(ping, (int) (now - ping->sent));
+      done = 1;
+    }
+  }
+
+  return(done);
+}
+
+void
+wi_ping_get_stats(struct wi_ping *ping, struct wi_ping_stats *stats)
+{
+  int64_t sum = 0, jitter = 0;
+  int i, rtt, prev = -1, pairs = 0;
+
+  memset(stats, 0, sizeof(*stats));
+  stats->wp_last = stats->wp_min = stats->wp_avg = stats->wp_max = stats->wp_jitter = -1;
+
+  for (i = 0; i < ping->count; i++) {
+    rtt = ping->rtts[(ping->head + i) % WI_PING_WINDOW];
+    stats->wp_sent++;
+    stats->wp_last = rtt;
+    if (rtt < 0) {
+      prev = -1;
+      continue;
+    }
+
+    stats->wp_received++;
+    sum += rtt;
+    if (stats->wp_min < 0 || rtt < stats->wp_min)
+      stats->wp_min = rtt;
+    if (rtt > stats->wp_max)
+      stats->wp_max = rtt;
+
+    /* variation between consecutive answers */
+    if (prev >= 0) {
+      jitter += (rtt > prev) ? rtt - prev : prev - rtt;
+      pairs++;
+    }
+    prev = rtt;
+  }
+
+  if (stats->wp_received > 0)
+    stats->wp_avg = sum / stats->wp_received;
+  if (pairs > 0)
+    stats->wp_jitter = jitter / pairs;
+}
@@ -0,0 +1,617 @@
+/* Copyright (c) 2025 The Xfce development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Traces of wi_query() results.
+ *
+ * A trace starts with a 16 byte header: the magic "WLTR", a version
+ * byte, three reserved bytes and the wall clock time of the recording
+ * in microseconds. Each sample follows as a record of
+ *
+ *   u32  milliseconds since the previous record
+ *   i8   wi_query() result
+ *   u8   flags telling which strings follow
+ *   i16  quality
+ *   u16  rate
+ *   for each string flag set, in order: u16 length and the bytes
+ *   if the link flag is set: u16 wl_valid, then each valid field of
+ *   the wi_link in the order of its bit, see _wi_put_link()
+ *
+ * Strings are only stored when they changed, so a steady link without
+ * details costs 10 bytes per sample. All integers are little endian.
+ * Version 1 traces, written before the link details, are still read.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include <wi.h>
+
+#define WI_TRACE_MAGIC    "WLTR"
+#define WI_TRACE_VERSION  2
+#define WI_TRACE_HEADER   16
+#define WI_TRACE_RECORD   10
+#define WI_TRACE_RATE     12
+/* wi_link bits known to version 2, and the most their fields take */
+#define WI_TRACE_LINK_VALID  ((WI_LINK_BYTES << 1) - 1)
+#define WI_TRACE_LINK_MAX    (2 + 3 * 2 + 2 * WI_TRACE_RATE + 4 + WI_HWADDR_LEN + 5 * 4 + 2 * 8)
+
+enum
+{
+  WI_TRACE_NETNAME  = 1 << 0,
+  WI_TRACE_QUNIT    = 1 << 1,
+  WI_TRACE_VENDOR   = 1 << 2,
+  WI_TRACE_LINK     = 1 << 3,  /* wi_link details follow the strings */
+};
+
+struct wi_recorder
+{
+  FILE *fp;
+  uint64_t last;            /* monotonic ms of the previous record */
+  int first;
+  struct wi_stats stats;    /* strings of the previous record */
+};
+
+struct wi_replay
+{
+  unsigned char *data;
+  size_t size;
+  size_t offset;            /* next record */
+  int realtime;
+
+  uint64_t start;           /* monotonic ms the current pass started */
+  uint64_t elapsed;         /* trace time up to offset */
+
+  int have_sample;
+  int result;
+  struct wi_stats stats;
+};
+
+static uint64_t
+_wi_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static void
+_wi_put16(unsigned char *p, uint16_t v)
+{
+  p[0] = v & 0xff;
+  p[1] = v >> 8;
+}
+
+static void
+_wi_put32(unsigned char *p, uint32_t v)
+{
+  _wi_put16(p, v & 0xffff);
+  _wi_put16(p + 2, v >> 16);
+}
+
+static void
+_wi_put64(unsigned char *p, uint64_t v)
+{
+  _wi_put32(p, v & 0xffffffff);
+  _wi_put32(p + 4, v >> 32);
+}
+
+static uint16_t
+_wi_get16(const unsigned char *p)
+{
+  return(p[0] | (p[1] << 8));
+}
+
+static uint32_t
+_wi_get32(const unsigned char *p)
+{
+  return(_wi_get16(p) | ((uint32_t)_wi_get16(p + 2) << 16));
+}
+
+static uint64_t
+_wi_get64(const unsigned char *p)
+{
+  return(_wi_get32(p) | ((uint64_t)_wi_get32(p + 4) << 32));
+}
+
+static uint16_t
+_wi_clamp16(int v)
+{
+  return((uint16_t)(int16_t)(v < INT16_MIN ? INT16_MIN : v > INT16_MAX ? INT16_MAX : v));
+}
+
+static size_t
+_wi_put_string(unsigned char *p, const char *s, size_t max)
+{
+  size_t len = strnlen(s, max - 1);
+
+  _wi_put16(p, len);
+  memcpy(p + 2, s, len);
+
+  return(2 + len);
+}
+
+/* u32 bitrate, i8 mcs, u8 nss, u16 width and the mode in 4 bytes */
+static size_t
+_wi_put_rate(unsigned char *p, const struct wi_rate *rate)
+{
+  _wi_put32(p, rate->wr_bitrate < 0 ? 0 : rate->wr_bitrate);
+  p[4] = (unsigned char)(signed char)(rate->wr_mcs < -1 ? -1 : rate->wr_mcs > 127 ? 127 : rate->wr_mcs);
+  p[5] = rate->wr_nss < 0 ? 0 : rate->wr_nss > 255 ? 255 : rate->wr_nss;
+  _wi_put16(p + 6, rate->wr_width < 0 ? 0 : rate->wr_width > UINT16_MAX ? UINT16_MAX : rate->wr_width);
+  memset(p + 8, 0, 4);
+  memcpy(p + 8, rate->wr_mode, strnlen(rate->wr_mode, sizeof(rate->wr_mode) - 1));
+
+  return(WI_TRACE_RATE);
+}
+
+static void
+_wi_get_rate(const unsigned char *p, struct wi_rate *rate)
+{
+  rate->wr_bitrate = _wi_get32(p);
+  rate->wr_mcs = (signed char)p[4];
+  rate->wr_nss = p[5];
+  rate->wr_width = _wi_get16(p + 6);
+  memcpy(rate->wr_mode, p + 8, sizeof(rate->wr_mode) - 1);
+  rate->wr_mode[sizeof(rate->wr_mode) - 1] = '\0';
+}
+
+/* signals in i16, counters and times in u32, the byte counters in u64 */
+static size_t
+_wi_put_link(unsigned char *p, const struct wi_link *link)
+{
+  size_t len = 2;
+
+  _wi_put16(p, link->wl_valid);
+  if (link->wl_valid & WI_LINK_SIGNAL) {
+    _wi_put16(p + len, _wi_clamp16(link->wl_signal));
+    len += 2;
+  }
+  if (link->wl_valid & WI_LINK_SIGNAL_AVG) {
+    _wi_put16(p + len, _wi_clamp16(link->wl_signal_avg));
+    len += 2;
+  }
+  if (link->wl_valid & WI_LINK_NOISE) {
+    _wi_put16(p + len, _wi_clamp16(link->wl_noise));
+    len += 2;
+  }
+  if (link->wl_valid & WI_LINK_TX_RATE)
+    len += _wi_put_rate(p + len, &link->wl_tx_rate);
+  if (link->wl_valid & WI_LINK_RX_RATE)
+    len += _wi_put_rate(p + len, &link->wl_rx_rate);
+  if (link->wl_valid & WI_LINK_FREQUENCY) {
+    _wi_put16(p + len, link->wl_frequency);
+    _wi_put16(p + len + 2, _wi_clamp16(link->wl_channel));
+    len += 4;
+  }
+  if (link->wl_valid & WI_LINK_BSSID) {
+    memcpy(p + len, link->wl_bssid, WI_HWADDR_LEN);
+    len += WI_HWADDR_LEN;
+  }
+  if (link->wl_valid & WI_LINK_TX_RETRIES) {
+    _wi_put32(p + len, link->wl_tx_retries);
+    len += 4;
+  }
+  if (link->wl_valid & WI_LINK_TX_FAILED) {
+    _wi_put32(p + len, link->wl_tx_failed);
+    len += 4;
+  }
+  if (link->wl_valid & WI_LINK_BEACON_LOSS) {
+    _wi_put32(p + len, link->wl_beacon_loss);
+    len += 4;
+  }
+  if (link->wl_valid & WI_LINK_CONNECTED_TIME) {
+    _wi_put32(p + len, link->wl_connected_time);
+    len += 4;
+  }
+  if (link->wl_valid & WI_LINK_INACTIVE_TIME) {
+    _wi_put32(p + len, link->wl_inactive_time);
+    len += 4;
+  }
+  if (link->wl_valid & WI_LINK_BYTES) {
+    _wi_put64(p + len, link->wl_rx_bytes);
+    _wi_put64(p + len + 8, link->wl_tx_bytes);
+    len += 16;
+  }
+
+  return(len);
+}
+
+/* bytes taken by the fields of wl_valid, as written by _wi_put_link() */
+static size_t
+_wi_link_size(unsigned int valid)
+{
+  size_t len = 2;
+
+  len += (valid & WI_LINK_SIGNAL) ? 2 : 0;
+  len += (valid & WI_LINK_SIGNAL_AVG) ? 2 : 0;
+  len += (valid & WI_LINK_NOISE) ? 2 : 0;
+  len += (valid & WI_LINK_TX_RATE) ? WI_TRACE_RATE : 0;
+  len += (valid & WI_LINK_RX_RATE) ? WI_TRACE_RATE : 0;
+  len += (valid & WI_LINK_FREQUENCY) ? 4 : 0;
+  len += (valid & WI_LINK_BSSID) ? WI_HWADDR_LEN : 0;
+  len += (valid & WI_LINK_TX_RETRIES) ? 4 : 0;
+  len += (valid & WI_LINK_TX_FAILED) ? 4 : 0;
+  len += (valid & WI_LINK_BEACON_LOSS) ? 4 : 0;
+  len += (valid & WI_LINK_CONNECTED_TIME) ? 4 : 0;
+  len += (valid & WI_LINK_INACTIVE_TIME) ? 4 : 0;
+  len += (valid & WI_LINK_BYTES) ? 16 : 0;
+
+  return(len);
+}
+
+static void
+_wi_get_link(const unsigned char *p, struct wi_link *link)
+{
+  size_t len = 2;
+
+  memset(link, 0, sizeof(*link));
+  link->wl_valid = _wi_get16(p);
+  if (link->wl_valid & WI_LINK_SIGNAL) {
+    link->wl_signal = (int16_t)_wi_get16(p + len);
+    len += 2;
+  }
+  if (link->wl_valid & WI_LINK_SIGNAL_AVG) {
+    link->wl_signal_avg = (int16_t)_wi_get16(p + len);
+    len += 2;
+  }
+  if (link->wl_valid & WI_LINK_NOISE) {
+    link->wl_noise = (int16_t)_wi_get16(p + len);
+    len += 2;
+  }
+  if (link->wl_valid & WI_LINK_TX_RATE) {
+    _wi_get_rate(p + len, &link->wl_tx_rate);
+    len += WI_TRACE_RATE;
+  }
+  if (link->wl_valid & WI_LINK_RX_RATE) {
+    _wi_get_rate(p + len, &link->wl_rx_rate);
+    len += WI_TRACE_RATE;
+  }
+  if (link->wl_valid & WI_LINK_FREQUENCY) {
+    link->wl_frequency = _wi_get16(p + len);
+    link->wl_channel = (int16_t)_wi_get16(p + len + 2);
+    len += 4;
+  }
+  if (link->wl_valid & WI_LINK_BSSID) {
+    memcpy(link->wl_bssid, p + len, WI_HWADDR_LEN);
+    len += WI_HWADDR_LEN;
+  }
+  if (link->wl_valid & WI_LINK_TX_RETRIES) {
+    link->wl_tx_retries = _wi_get32(p + len);
+    len += 4;
+  }
+  if (link->wl_valid & WI_LINK_TX_FAILED) {
+    link->wl_tx_failed = _wi_get32(p + len);
+    len += 4;
+  }
+  if (link->wl_valid & WI_LINK_BEACON_LOSS) {
+    link->wl_beacon_loss = _wi_get32(p + len);
+    len += 4;
+  }
+  if (link->wl_valid & WI_LINK_CONNECTED_TIME) {
+    link->wl_connected_time = _wi_get32(p + len);
+    len += 4;
+  }
+  if (link->wl_valid & WI_LINK_INACTIVE_TIME) {
+    link->wl_inactive_time = _wi_get32(p + len);
+    len += 4;
+  }
+  if (link->wl_valid & WI_LINK_BYTES) {
+    link->wl_rx_bytes = _wi_get64(p + len);
+    link->wl_tx_bytes = _wi_get64(p + len + 8);
+  }
+}
+
+struct wi_recorder *
+wi_recorder_open(const char *path)
+{
+  struct wi_recorder *recorder;
+  unsigned char header[WI_TRACE_HEADER];
+  struct timeval tv;
+  uint64_t start;
+
+  if (path == NULL)
+    return(NULL);
+
+  if ((recorder = calloc(1, sizeof(*recorder))) == NULL)
+    return(NULL);
+
+  if ((recorder->fp = fopen(path, "wb")) == NULL) {
+    free(recorder);
+    return(NULL);
+  }
+
+  gettimeofday(&tv, NULL);
+  start = (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+
+  memset(header, 0, sizeof(header));
+  memcpy(header, WI_TRACE_MAGIC, 4);
+  header[4] = WI_TRACE_VERSION;
+  _wi_put32(header + 8, start & 0xffffffff);
+  _wi_put32(header + 12, start >> 32);
+
+  if (fwrite(header, sizeof(header), 1, recorder->fp) != 1) {
+    wi_recorder_close(recorder);
+    return(NULL);
+  }
+
+  recorder->first = 1;
+
+  return(recorder);
+}
+
+int
+wi_recorder_write(struct wi_recorder *recorder, const struct wi_stats *stats, int result)
+{
+  unsigned char buffer[WI_TRACE_RECORD + 3 * (2 + WI_MAXSTRLEN) + WI_TRACE_LINK_MAX];
+  uint64_t now = _wi_now(), delta;
+  size_t len = WI_TRACE_RECORD;
+  int flags = 0;
+
+  if (recorder == NULL || stats == NULL)
+    return(WI_INVAL);
+
+  /* the first record carries every string */
+  if (recorder->first || strcmp(stats->ws_netname, recorder->stats.ws_netname) != 0)
+    flags |= WI_TRACE_NETNAME;
+  if (recorder->first || strcmp(stats->ws_qunit, recorder->stats.ws_qunit) != 0)
+    flags |= WI_TRACE_QUNIT;
+  if (recorder->first || strcmp(stats->ws_vendor, recorder->stats.ws_vendor) != 0)
+    flags |= WI_TRACE_VENDOR;
+  if (stats->ws_link.wl_valid & WI_TRACE_LINK_VALID)
+    flags |= WI_TRACE_LINK;
+
+  delta = recorder->first ? 0 : now - recorder->last;
+  _wi_put32(buffer, delta > UINT32_MAX ? UINT32_MAX : delta);
+  buffer[4] = (unsigned char)(signed char)result;
+  buffer[5] = flags;
+  _wi_put16(buffer + 6, _wi_clamp16(stats->ws_quality));
+  _wi_put16(buffer + 8, stats->ws_rate < 0 ? 0 :
+            stats->ws_rate > UINT16_MAX ? UINT16_MAX : stats->ws_rate);
+
+  if (flags & WI_TRACE_NETNAME)
+    len += _wi_put_string(buffer + len, stats->ws_netname, sizeof(stats->ws_netname));
+  if (flags & WI_TRACE_QUNIT)
+    len += _wi_put_string(buffer + len, stats->ws_qunit, sizeof(stats->ws_qunit));
+  if (flags & WI_TRACE_VENDOR)
+    len += _wi_put_string(buffer + len, stats->ws_vendor, sizeof(stats->ws_vendor));
+  if (flags & WI_TRACE_LINK) {
+    struct wi_link link = stats->ws_link;
+
+    link.wl_valid &= WI_TRACE_LINK_VALID;
+    len += _wi_put_link(buffer + len, &link);
+  }
+
+  /* flushed right away so a trace survives a crash */
+  if (fwrite(buffer, len, 1, recorder->fp) != 1 || fflush(recorder->fp) != 0)
+    return(WI_INVAL);
+
+  recorder->first = 0;
+  recorder->last = now;
+  recorder->stats = *stats;
+
+  return(WI_OK);
+}
+
+void
+wi_recorder_close(struct wi_recorder *recorder)
+{
+  if (recorder != NULL) {
+    fclose(recorder->fp);
+    free(recorder);
+  }
+}
+
+int
+wi_replay_match(const char *interface)
+{
+  return(interface != NULL &&
+         (strncmp(interface, WI_REPLAY_PREFIX, strlen(WI_REPLAY_PREFIX)) == 0 ||
+          strncmp(interface, WI_REPLAY_FAST_PREFIX, strlen(WI_REPLAY_FAST_PREFIX)) == 0));
+}
+
+struct wi_replay *
+wi_replay_open(const char *interface)
+{
+  struct wi_replay *replay;
+  const char *path;
+  FILE *fp;
+  long size;
+  int realtime;
+
+  if (interface == NULL)
+    return(NULL);
+  else if (strncmp(interface, WI_REPLAY_PREFIX, strlen(WI_REPLAY_PREFIX)) == 0) {
+    path = interface + strlen(WI_REPLAY_PREFIX);
+    realtime = 1;
+  }
+  else if (strncmp(interface, WI_REPLAY_FAST_PREFIX, strlen(WI_REPLAY_FAST_PREFIX)) == 0) {
+    path = interface + strlen(WI_REPLAY_FAST_PREFIX);
+    realtime = 0;
+  }
+  else
+    return(NULL);
+
+  if ((fp = fopen(path, "rb")) == NULL)
+    return(NULL);
+
+  if ((replay = calloc(1, sizeof(*replay))) == NULL) {
+    fclose(fp);
+    return(NULL);
+  }
+
+  /* traces are compact enough to be kept in memory */
+  if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < WI_TRACE_HEADER ||
+      fseek(fp, 0, SEEK_SET) != 0 ||
+      (replay->data = malloc(size)) == NULL ||
+      fread(replay->data, size, 1, fp) != 1 ||
+      memcmp(replay->data, WI_TRACE_MAGIC, 4) != 0 ||
+      replay->data[4] < 1 || replay->data[4] > WI_TRACE_VERSION) {
+    fclose(fp);
+    wi_replay_close(replay);
+    return(NULL);
+  }
+  fclose(fp);
+
+  replay->size = size;
+  replay->offset = WI_TRACE_HEADER;
+  replay->realtime = realtime;
+  replay->start = _wi_now();
+  replay->result = WI_NOSUCHDEV;
+
+  return(replay);
+}
+
+void
+wi_replay_close(struct wi_replay *replay)
+{
+  if (replay != NULL) {
+    free(replay->data);
+    free(replay);
+  }
+}
+
+static int
+_wi_replay_string(struct wi_replay *replay, size_t *offset, char *s, size_t max)
+{
+  size_t len;
+
+  if (*offset + 2 > replay->size)
+    return(-1);
+  len = _wi_get16(replay->data + *offset);
+  if (len >= max || *offset + 2 + len > replay->size)
+    return(-1);
+
+  memcpy(s, replay->data + *offset + 2, len);
+  s[len] = '\0';
+  *offset += 2 + len;
+
+  return(0);
+}
+
+/* decode the record at offset, -1 at the end of the trace */
+static int
+_wi_replay_next(struct wi_replay *replay)
+{
+  const unsigned char *p = replay->data + replay->offset;
+  size_t offset = replay->offset + WI_TRACE_RECORD;
+  int flags;
+
+  if (offset > replay->size)
+    return(-1);
+
+  flags = p[5];
+  if (((flags & WI_TRACE_NETNAME) &&
+       _wi_replay_string(replay, &offset, replay->stats.ws_netname, sizeof(replay->stats.ws_netname)) < 0) ||
+      ((flags & WI_TRACE_QUNIT) &&
+       _wi_replay_string(replay, &offset, replay->stats.ws_qunit, sizeof(replay->stats.ws_qunit)) < 0) ||
+      ((flags & WI_TRACE_VENDOR) &&
+       _wi_replay_string(replay, &offset, replay->stats.ws_vendor, sizeof(replay->stats.ws_vendor)) < 0))
+    return(-1);
+
+  /* a record without details, e.g. from version 1, has none */
+  if (flags & WI_TRACE_LINK) {
+    if (offset + 2 > replay->size ||
+        offset + _wi_link_size(_wi_get16(replay->data + offset)) > replay->size)
+      return(-1);
+    _wi_get_link(replay->data + offset, &replay->stats.ws_link);
+    offset += _wi_link_size(replay->stats.ws_link.wl_valid);
+  } else
+    memset(&replay->stats.ws_link, 0, sizeof(replay->stats.ws_link));
+
+  replay->elapsed += _wi_get32(p);
+  replay->result = (signed char)p[4];
+  replay->stats.ws_quality = (int16_t)_wi_get16(p + 6);
+  replay->stats.ws_rate = _wi_get16(p + 8);
+  replay->have_sample = 1;
+  replay->offset = offset;
+
+  return(0);
+}
+
+/* start over, traces are replayed in a loop */
+static void
+_wi_replay_rewind(struct wi_replay *replay)
+{
+  replay->start += replay->elapsed;
+  replay->elapsed = 0;
+  replay->offset = WI_TRACE_HEADER;
+  memset(&replay->stats, 0, sizeof(replay->stats));
+}
+
+/*
+ * In real time, the latest record whose time has come is returned;
+ * otherwise every call moves to the next record.
+ */
+int
+wi_replay_query(struct wi_replay *replay, struct wi_stats *stats)
+{
+  uint64_t now;
+
+  if (replay == NULL || stats == NULL)
+    return(WI_INVAL);
+
+  if (!replay->realtime) {
+    if (_wi_replay_next(replay) < 0) {
+      _wi_replay_rewind(replay);
+      if (_wi_replay_next(replay) < 0)
+        replay->have_sample = 0;
+    }
+  }
+  else {
+    now = _wi_now() - replay->start;
+    for (;;) {
+      if (replay->offset + WI_TRACE_RECORD > replay->size) {
+        /* a trace without duration would loop forever */
+        if (replay->elapsed == 0 || now < replay->elapsed)
+          break;
+        now -= replay->elapsed;
+        _wi_replay_rewind(replay);
+        continue;
+      }
+      if (replay->have_sample &&
+          replay->elapsed + _wi_get32(replay->data + replay->offset) > now)
+        break;
+      if (_wi_replay_next(replay) < 0) {
+        /* truncated record, stop there */
+        replay->size = replay->offset;
+        if (!replay->have_sample)
+          break;
+      }
+    }
+  }
+
+  if (!replay->have_sample)
+    return(WI_NOSUCHDEV);
+
+  *stats = replay->stats;
+
+  return(replay->result);
+}